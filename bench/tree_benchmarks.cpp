@@ -0,0 +1,284 @@
+#include <benchmark/benchmark.h>
+#include "tree.h"
+#include "tree_enumerator.h"
+#include "tree_generator.h"
+#include "tree_optimizer.h"
+#include "partition_table.h"
+#include "subtree_store.h"
+#include "task_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <span>
+#include <thread>
+
+using namespace vinci;
+
+// Every operator new in the process is counted, so "bytes_allocated" covers
+// the global heap, pmr arenas' upstream blocks and standard containers alike
+namespace {
+    std::atomic<size_t> allocatedBytes{0};
+}
+
+void* operator new(size_t size) {
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* block = std::malloc(size == 0 ? 1 : size)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+// GCC pairs its inlined view of the replaced operators with std::free and
+// warns, although replacing both sides like this is well-defined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* block) noexcept { std::free(block); }
+void operator delete(void* block, size_t) noexcept { std::free(block); }
+
+namespace {
+    /**
+     * @brief Reports bytes allocated per iteration and, optionally, trees per second
+     */
+    class Allocations {
+    public:
+        explicit Allocations(benchmark::State& state)
+            : state_(state), start_(allocatedBytes.load(std::memory_order_relaxed)) {}
+
+        ~Allocations() {
+            double bytes = static_cast<double>(allocatedBytes.load(std::memory_order_relaxed) - start_);
+            state_.counters["bytes_allocated"] = benchmark::Counter(bytes, benchmark::Counter::kAvgIterations);
+            if (trees_ > 0) {
+                state_.counters["trees_per_second"] =
+                    benchmark::Counter(static_cast<double>(trees_), benchmark::Counter::kIsRate);
+            }
+        }
+
+        void addTrees(size_t count) { trees_ += count; }
+
+    private:
+        benchmark::State& state_;
+        size_t start_;
+        size_t trees_ = 0;
+    };
+
+    // Canonical trees with n nodes and at most m leaves, the sample shared below
+    std::vector<Tree> sampleTrees(size_t n, size_t m) {
+        std::vector<Tree> trees;
+        for (TreeEnumerator it(n, m); it.valid(); it.next()) {
+            trees.push_back(it.tree());
+        }
+        return trees;
+    }
+
+    // Thread counts 1, 2, 4, ... up to the hardware thread count
+    void threadArgs(benchmark::internal::Benchmark* bench, std::vector<std::pair<int64_t, int64_t>> cases) {
+        int64_t hardware = std::max<int64_t>(1, std::thread::hardware_concurrency());
+        for (auto [n, m] : cases) {
+            for (int64_t threads = 1; threads <= hardware; threads *= 2) {
+                bench->Args({n, m, threads});
+            }
+            if ((hardware & (hardware - 1)) != 0) {
+                bench->Args({n, m, hardware});
+            }
+        }
+    }
+}
+
+static void BM_SortToCanonical(benchmark::State& state) {
+    // Rebuild each tree with its children reversed so the sort has work to do
+    std::vector<Tree> scrambled;
+    for (const Tree& tree : sampleTrees(state.range(0), state.range(0))) {
+        auto children = tree.getChildren();
+        Tree reversed;
+        for (auto it = children.rbegin(); it != children.rend(); ++it) {
+            reversed.addChild(*it);
+        }
+        scrambled.push_back(std::move(reversed));
+    }
+
+    Allocations allocations(state);
+    for (auto _ : state) {
+        for (const Tree& tree : scrambled) {
+            Tree copy = tree;
+            copy.sortToCanonical();
+            benchmark::DoNotOptimize(copy);
+        }
+        allocations.addTrees(scrambled.size());
+    }
+}
+BENCHMARK(BM_SortToCanonical)->Arg(10)->Arg(14);
+
+static void BM_ToString(benchmark::State& state) {
+    std::vector<Tree> trees = sampleTrees(state.range(0), state.range(0));
+
+    Allocations allocations(state);
+    size_t bytes = 0;
+    for (auto _ : state) {
+        for (const Tree& tree : trees) {
+            std::string text = tree.toString();
+            bytes += text.size();
+            benchmark::DoNotOptimize(text);
+        }
+        allocations.addTrees(trees.size());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_ToString)->Arg(10)->Arg(14);
+
+static void BM_PartitionIterator(benchmark::State& state) {
+    size_t n = state.range(0);
+    size_t partitions = 0;
+    for (auto _ : state) {
+        for (PartitionIterator it(n, n); it.valid(); it.next()) {
+            benchmark::DoNotOptimize(it.current().data());
+            ++partitions;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(partitions));
+}
+BENCHMARK(BM_PartitionIterator)->Arg(20)->Arg(30)->Arg(45);
+
+static void BM_PartitionTableLookup(benchmark::State& state) {
+    // Every subtree cell asks for its partition list; after the first call it is a lookup
+    size_t n = state.range(0);
+    PartitionTable table(n);
+    for (auto _ : state) {
+        for (size_t size = 0; size <= n; ++size) {
+            benchmark::DoNotOptimize(table.get(size, size).size());
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (n + 1)));
+}
+BENCHMARK(BM_PartitionTableLookup)->Arg(30);
+
+static void BM_MemoizedCells(benchmark::State& state) {
+    // Cold serial run of the memoized engine: dominated by building the
+    // (n, m) subtree cells through generateTreesRecursive
+    size_t n = state.range(0);
+    size_t m = state.range(1);
+    TreeGenerator generator;
+    generator.setEngine(TreeGenerator::Engine::Memoized);
+
+    Allocations allocations(state);
+    for (auto _ : state) {
+        generator.clearCache();
+        allocations.addTrees(generator.generate(n, m, [](const Tree&) {}, false));
+    }
+}
+BENCHMARK(BM_MemoizedCells)
+    ->Args({12, 12})->Args({14, 5})->Args({16, 16})->Args({18, 6})->Args({30, 3})
+    ->Unit(benchmark::kMillisecond);
+
+static void runGenerate(benchmark::State& state, TreeGenerator::Engine engine) {
+    size_t n = state.range(0);
+    size_t m = state.range(1);
+    size_t threads = state.range(2);
+
+    Allocations allocations(state);
+    for (auto _ : state) {
+        // A fresh generator per iteration, so the memoized cache starts cold
+        TreeGenerator generator;
+        generator.setEngine(engine);
+        generator.setThreadCount(threads);
+        allocations.addTrees(generator.generate(n, m, [](const Tree&) {}, true));
+    }
+}
+
+static void BM_GenerateMemoized(benchmark::State& state) {
+    runGenerate(state, TreeGenerator::Engine::Memoized);
+}
+BENCHMARK(BM_GenerateMemoized)
+    ->Apply([](auto* bench) { threadArgs(bench, {{16, 16}, {18, 6}, {22, 5}}); })
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_GeneratePerThread(benchmark::State& state) {
+    // Same runs as BM_GenerateMemoized, but each worker consumes its own
+    // batches instead of draining every tree through the calling thread
+    size_t n = state.range(0);
+    size_t m = state.range(1);
+
+    Allocations allocations(state);
+    for (auto _ : state) {
+        TreeGenerator generator;
+        generator.setEngine(TreeGenerator::Engine::Memoized);
+        generator.setThreadCount(state.range(2));
+        allocations.addTrees(generator.generatePerThread(n, m, [](size_t) {
+            return [](std::span<const Tree> batch) { benchmark::DoNotOptimize(batch.data()); };
+        }, true));
+    }
+}
+BENCHMARK(BM_GeneratePerThread)
+    ->Apply([](auto* bench) { threadArgs(bench, {{16, 16}, {18, 6}, {22, 5}}); })
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_GenerateLevelSequence(benchmark::State& state) {
+    runGenerate(state, TreeGenerator::Engine::LevelSequence);
+}
+BENCHMARK(BM_GenerateLevelSequence)
+    ->Args({16, 16, 1})->Args({18, 6, 1})->Args({22, 5, 1})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_GenerateAuto(benchmark::State& state) {
+    // Auto with an explicit thread count: the level sequence walk on one
+    // thread, the parallel memoized engine on more
+    runGenerate(state, TreeGenerator::Engine::Auto);
+}
+BENCHMARK(BM_GenerateAuto)
+    ->Apply([](auto* bench) { threadArgs(bench, {{16, 16}, {18, 6}, {22, 5}}); })
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_CountThroughFunction(benchmark::State& state) {
+    // A trivial consumer behind std::function: one indirect call per tree
+    TreeGenerator generator;
+    generator.setEngine(TreeGenerator::Engine::LevelSequence);
+    size_t leaves = 0;
+    TreeGenerator::TreeCallback count = [&leaves](const Tree& tree) { leaves += tree.getLeafCount(); };
+    for (auto _ : state) {
+        generator.generate(state.range(0), state.range(1), count, false);
+    }
+    benchmark::DoNotOptimize(leaves);
+    state.SetItemsProcessed(static_cast<int64_t>(generator.getCount() * state.iterations()));
+}
+BENCHMARK(BM_CountThroughFunction)->Args({18, 6})->Args({20, 8})->Unit(benchmark::kMillisecond);
+
+static void BM_CountInlined(benchmark::State& state) {
+    // The same consumer through the templated overload, inlined into the batch loop
+    TreeGenerator generator;
+    generator.setEngine(TreeGenerator::Engine::LevelSequence);
+    size_t leaves = 0;
+    for (auto _ : state) {
+        generator.generate(state.range(0), state.range(1),
+                           [&leaves](const Tree& tree) { leaves += tree.getLeafCount(); }, false);
+    }
+    benchmark::DoNotOptimize(leaves);
+    state.SetItemsProcessed(static_cast<int64_t>(generator.getCount() * state.iterations()));
+}
+BENCHMARK(BM_CountInlined)->Args({18, 6})->Args({20, 8})->Unit(benchmark::kMillisecond);
+
+static void BM_GenerateExactLeaves(benchmark::State& state) {
+    runGenerate(state, TreeGenerator::Engine::ExactLeaves);
+}
+BENCHMARK(BM_GenerateExactLeaves)
+    ->Args({16, 16, 1})->Args({18, 6, 1})->Args({30, 3, 1})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_BuildCacheParallel(benchmark::State& state) {
+    size_t n = state.range(0);
+    size_t k = state.range(1);
+    TaskPool pool(state.range(2));
+
+    Allocations allocations(state);
+    for (auto _ : state) {
+        SubtreeStore cells(n, k, SubtreeStore::Interning::Append);
+        TreeOptimizer::buildCacheParallel(n, k, cells, &pool);
+        allocations.addTrees(cells.internedCount());
+    }
+}
+BENCHMARK(BM_BuildCacheParallel)
+    ->Apply([](auto* bench) { threadArgs(bench, {{15, 15}, {19, 6}}); })
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
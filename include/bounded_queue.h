@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace vinci {
+
+/**
+ * @brief Fixed-capacity single-producer/single-consumer ring buffer
+ *
+ * The producer blocks in push() while the ring is full, so a slow consumer
+ * throttles its producer instead of letting results pile up in memory.
+ * Every push and close() bumps a shared `readySignal` counter, which lets one
+ * consumer sleep on a single atomic while it drains several queues.
+ * A consumer that gives up calls cancel(), after which push() discards
+ * instead of blocking, so producers can finish without a reader.
+ */
+template<typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(size_t capacity, std::atomic<std::uint64_t>& readySignal)
+        : buffer_(std::bit_ceil(std::max(capacity, size_t(2)))),
+          mask_(buffer_.size() - 1),
+          readySignal_(readySignal) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /**
+     * @brief Append an item, waiting for space if the ring is full (producer only)
+     * Once the queue is cancelled the item is dropped.
+     */
+    void push(T&& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        while (tail - head >= buffer_.size()) {
+            if (cancelled_.load(std::memory_order_acquire)) {
+                return;
+            }
+            head_.wait(head, std::memory_order_acquire);
+            head = head_.load(std::memory_order_acquire);
+        }
+        if (cancelled_.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        buffer_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        signal();
+    }
+
+    /**
+     * @brief Take the oldest item if one is available (consumer only)
+     */
+    bool tryPop(T& out) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        out = std::move(buffer_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        head_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Mark the producer as finished (producer only)
+     */
+    void close() {
+        closed_.store(true, std::memory_order_release);
+        signal();
+    }
+
+    /**
+     * @brief Stop taking items and release a producer blocked in push() (consumer only)
+     * The queue is unusable afterwards except for close().
+     */
+    void cancel() {
+        cancelled_.store(true, std::memory_order_release);
+        // Move head so a producer waiting on its old value wakes and sees the flag
+        head_.fetch_add(1, std::memory_order_acq_rel);
+        head_.notify_all();
+    }
+
+    /**
+     * @brief True once the producer has closed the queue and every item was taken
+     */
+    bool drained() const {
+        return closed_.load(std::memory_order_acquire) &&
+               head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    void signal() {
+        readySignal_.fetch_add(1, std::memory_order_release);
+        readySignal_.notify_one();
+    }
+
+    std::vector<T> buffer_;
+    size_t mask_;
+    std::atomic<std::uint64_t>& readySignal_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    std::atomic<bool> closed_{false};
+    std::atomic<bool> cancelled_{false};
+};
+
+} // namespace vinci
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "tree.h"
+#include <cstddef>
+#include <limits>
+
+namespace vinci {
+
+/**
+ * @brief Structural limits on generated trees beyond the leaf limit
+ *
+ * Applied while trees are built rather than by filtering finished ones:
+ * depth and out-degree bound every subtree, so the exact-leaf cells are
+ * keyed on the depth still allowed and the root's children are capped as
+ * they are chosen. minLeaves only concerns the whole tree and skips the
+ * smaller leaf counts outright. Depth counts edges, so a single node has
+ * depth 0.
+ */
+struct GenerationConstraints {
+    static constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+
+    size_t maxDepth = kUnlimited;     // Edges on the longest root-to-leaf path
+    size_t maxChildren = kUnlimited;  // Children of any one node
+    size_t minLeaves = 0;             // Leaves of the whole tree
+
+    // Whether the limits restrict the shape of subtrees (not just the leaf count)
+    bool limitsShape() const { return maxDepth != kUnlimited || maxChildren != kUnlimited; }
+
+    // Whether any limit is set
+    bool any() const { return limitsShape() || minLeaves > 0; }
+
+    /**
+     * @brief Whether a tree meets every limit
+     */
+    bool admits(const Tree& tree) const;
+};
+
+} // namespace vinci
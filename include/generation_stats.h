@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace vinci {
+
+/**
+ * @brief Phase timers and counters of one TreeGenerator::generate() call
+ *
+ * Collected only while TreeGenerator::setStatsEnabled(true) is in effect;
+ * otherwise just trees, threads and elapsed are filled in. Every worker
+ * accumulates into its own copy and the copies are summed when the run ends,
+ * so collection takes no locks and no atomics.
+ *
+ * Phase times are exclusive (a cell built while collecting child options is
+ * charged to its own phases, not to childOptions) and summed over threads, so
+ * with several workers they can add up to more than `elapsed`. The phase
+ * breakdown and cache counters cover the Memoized engine; the other engines
+ * report callback time only.
+ */
+struct GenerationStats {
+    using Duration = std::chrono::nanoseconds;
+
+    size_t trees = 0;
+    size_t threads = 0;          // Worker threads used (1 for serial runs)
+    Duration elapsed{0};         // Wall time of the whole call
+    Duration prewarm{0};         // Wall time of the single-threaded pre-warm, inclusive
+
+    // Exclusive time per phase, summed over threads
+    Duration partitionEnumeration{0};  // Looking up / enumerating integer partitions
+    Duration childOptions{0};          // Referencing each part's cell and bucketing it by leaf count
+    Duration combinations{0};          // generateCombinations
+    Duration callback{0};              // Inside the user's consumer, per delivered batch
+
+    size_t rootPartitions = 0;         // Root partitions this run (or shard) generated
+    size_t candidates = 0;             // Trees assembled by generateCombinations, cells included
+    size_t leafPrunedOptions = 0;      // Child options skipped whole by the leaf budget
+    size_t infeasiblePartitions = 0;   // Partitions whose parts cannot share the leaf limit
+    size_t dedupHits = 0;              // Interned trees already present in the subtree store
+    size_t cacheHits = 0;              // Subtree cells found published
+    size_t cacheFiltered = 0;          // Cells derived from a cell with a higher leaf limit
+    size_t cacheFileLoads = 0;         // Cells copied out of the cache file
+    size_t cacheMisses = 0;            // Cells generated from partitions
+
+    // Sum every field except elapsed, prewarm and threads
+    GenerationStats& operator+=(const GenerationStats& other);
+
+    // Human-readable multi-line report
+    std::string toText() const;
+
+    // Single JSON object; times in milliseconds
+    std::string toJson() const;
+};
+
+} // namespace vinci
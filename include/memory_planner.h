@@ -0,0 +1,100 @@
+#pragma once
+
+#include "tree_counter.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+
+namespace vinci {
+
+/**
+ * @brief Predicted memory of one generation run and the settings chosen to fit it
+ */
+struct MemoryPlan {
+    size_t cacheBytes = 0;      // Subtree cells and interned trees kept for the run
+    size_t workerBytes = 0;     // Per worker: streaming queue, flush buffer and child options
+    size_t batchBytes = 0;      // Largest finished batch held before delivery, outside the workers
+    size_t threads = 1;         // Workers that fit the budget (at most the requested count)
+    size_t prewarmDepth = 0;    // Node count pre-warmed before the workers start
+    size_t flushTrees = 0;      // Finished trees a worker buffers before handing them on
+    bool fits = true;           // Whether the run fits the budget at all
+
+    // Predicted peak of the whole run
+    size_t peakBytes() const;
+
+    // One-line summary in MiB
+    std::string toText() const;
+};
+
+/**
+ * @brief Predicts peak memory of the generation engines from exact tree counts
+ *
+ * Replaces a node-count heuristic with the TreeCounter table: the subtree
+ * cells an engine keeps are sized from the number of trees in each (nodes,
+ * leaves) cell times the real footprint of a Tree of that size, plus the
+ * per-worker and per-batch buffers of the run. With a budget, the planner
+ * lowers the worker count and the trees buffered per worker until the run
+ * fits, and reports whether it can fit at all. Predictions are upper bounds:
+ * a sharded run is charged for the whole cache.
+ */
+class MemoryPlanner {
+public:
+    // Trees a worker buffers at least, and at most, before handing them on
+    static constexpr size_t kMinFlushTrees = 1024;
+    static constexpr size_t kMaxFlushTrees = 1 << 16;
+
+    /**
+     * @brief Tables for runs with n nodes and at most m leaves
+     * Counts that do not fit in 128 bits make every plan fail rather than throw.
+     */
+    MemoryPlanner(size_t n, size_t m);
+
+    /**
+     * @brief Bytes of one Tree with `nodes` nodes, including its heap spill
+     */
+    static size_t treeBytes(size_t nodes);
+
+    /**
+     * @brief Memory the process may still use, in bytes; 0 if unknown
+     * On Linux: MemAvailable, further limited by the cgroup's memory limit
+     * minus its usage, so a container is sized by its own limit.
+     */
+    static size_t availableMemory();
+
+    /**
+     * @brief Plan a Memoized run on up to `threads` workers
+     * The shared store holds every distinct subtree below n nodes within the
+     * leaf limit, plus one pointer per tree in each leaf-limit cell, plus
+     * the vector the largest cell is built in before it is interned. The
+     * pre-warm depth is the deepest level up to n/2 whose cells, with every
+     * level below, fit both one worker's share of the cache and the budget
+     * left after the workers and batch.
+     */
+    MemoryPlan memoized(size_t threads, size_t budget) const;
+
+    /**
+     * @brief Bytes the Memoized store keeps for the subtrees of `nodes` nodes
+     * Interned trees plus the pointers of every leaf-limit cell at that size.
+     */
+    size_t levelBytes(size_t nodes) const;
+
+    /**
+     * @brief Plan an ExactLeaves run
+     * The cell table below n is held whole, and each exact leaf count of the
+     * n-node trees is delivered as one batch.
+     */
+    MemoryPlan exactLeaves(size_t budget) const;
+
+private:
+    // Trees with `nodes` nodes and at most `leaves` leaves, clamped to size_t
+    size_t atMost(size_t nodes, size_t leaves) const;
+
+    // Trees with `nodes` nodes and exactly `leaves` leaves, clamped to size_t
+    size_t exact(size_t nodes, size_t leaves) const;
+
+    size_t n_;
+    size_t m_;
+    std::optional<TreeCounter> counter_;  // Empty if the counts overflow
+};
+
+} // namespace vinci
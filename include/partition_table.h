@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace vinci {
+
+// One integer partition, parts in non-increasing order
+using Partition = std::span<const size_t>;
+
+/**
+ * @brief In-place successor walk over the partitions of n into at most k parts
+ *
+ * Partitions are visited in decreasing lexicographic order, starting from {n}
+ * (Knuth's Algorithm P, restricted to k parts): each step lowers the rightmost
+ * part that allows the rest to be refilled within k parts, then refills greedily.
+ * The only storage is one buffer of at most min(n, k) parts, allocated up front.
+ */
+class PartitionIterator {
+public:
+    PartitionIterator(size_t n, size_t maxParts);
+
+    // False once every partition has been visited
+    bool valid() const { return valid_; }
+
+    // Current partition; valid until the next call to next()
+    Partition current() const { return {parts_.data(), size_}; }
+
+    // Advance to the next partition
+    void next();
+
+private:
+    // Fill parts_[from..] with `rest` split greedily into parts of at most `cap`
+    void fill(size_t from, size_t rest, size_t cap);
+
+    std::vector<size_t> parts_;
+    size_t size_ = 0;
+    size_t maxParts_;
+    bool valid_ = true;
+};
+
+/**
+ * @brief Partitions of n into at most k parts, memoized per (n, k)
+ *
+ * Each list is enumerated once by PartitionIterator and stored flat, so
+ * repeated requests (one per subtree cell in the generator) are lookups.
+ * get() is thread-safe: the first caller builds a list while concurrent
+ * callers wait for it. k >= n shares the list of k = n.
+ */
+class PartitionTable {
+public:
+    /**
+     * @brief Flat, immutable list of partitions
+     */
+    class List {
+    public:
+        size_t size() const { return offsets_.size() - 1; }
+        Partition operator[](size_t i) const {
+            return {parts_.data() + offsets_[i], offsets_[i + 1] - offsets_[i]};
+        }
+
+    private:
+        friend class PartitionTable;
+        std::vector<size_t> parts_;
+        std::vector<std::uint32_t> offsets_{0};
+    };
+
+    explicit PartitionTable(size_t maxN = 0) { grow(maxN); }
+
+    PartitionTable(const PartitionTable&) = delete;
+    PartitionTable& operator=(const PartitionTable&) = delete;
+
+    /**
+     * @brief Make room for every n <= maxN, keeping built lists
+     * Not thread-safe; call only while no get() is running.
+     */
+    void grow(size_t maxN);
+
+    /**
+     * @brief Partitions of n (<= maxNodes()) into at most k parts
+     */
+    const List& get(size_t n, size_t k);
+
+    size_t maxNodes() const { return rows_.size() - 1; }
+
+private:
+    struct Slot {
+        std::once_flag once;
+        List list;
+    };
+
+    // rows_[n] holds slots k = 0..n; rows never move once created
+    std::vector<std::unique_ptr<Slot[]>> rows_;
+};
+
+} // namespace vinci
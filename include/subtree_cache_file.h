@@ -0,0 +1,100 @@
+#pragma once
+
+#include "tree.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace vinci {
+
+/**
+ * @brief Read-only, memory-mapped file of canonical subtrees
+ *
+ * Cells are indexed by (nodes, exact leaf count), so one file serves every
+ * leaf limit up to the one it was written for: the subtrees with n nodes and
+ * at most m leaves are the union of cells (n, 1..m). A cell is stored as the
+ * concatenated level sequences of its trees (n levels each), which is the
+ * Tree representation itself, so loading a cell is a copy out of the
+ * mapping with no generation work.
+ *
+ * Layout (native byte order, checked on open): a header with magic, version,
+ * byte-order mark, maxNodes and maxLeaves; one {offset, count} entry per cell;
+ * then the level data.
+ */
+class SubtreeCacheFile {
+public:
+    // Trees of exact (nodes, leaves), supplied to write()
+    using CellSource = std::function<std::vector<const Tree*>(size_t nodes, size_t leaves)>;
+
+    ~SubtreeCacheFile();
+
+    SubtreeCacheFile(const SubtreeCacheFile&) = delete;
+    SubtreeCacheFile& operator=(const SubtreeCacheFile&) = delete;
+
+    /**
+     * @brief Map an existing cache file
+     * @return nullptr if the file is missing, truncated or not a cache file
+     */
+    static std::unique_ptr<SubtreeCacheFile> open(const std::string& path);
+
+    /**
+     * @brief Write every cell with up to maxNodes nodes and maxLeaves leaves
+     * The file is written to a temporary name and renamed into place, so
+     * readers never map a partial file.
+     * @throws std::system_error if the file cannot be written
+     */
+    static void write(const std::string& path, size_t maxNodes, size_t maxLeaves,
+                      const CellSource& cells);
+
+    size_t maxNodes() const { return maxN_; }
+    size_t maxLeaves() const { return maxLeaves_; }
+
+    /**
+     * @brief True if every tree with n nodes and at most m leaves is in the file
+     */
+    bool covers(size_t n, size_t m) const;
+
+    // Number of trees in cell (n, leaves); 0 outside the file's range
+    size_t cellSize(size_t n, size_t leaves) const;
+
+    /**
+     * @brief Concatenated level sequences of cell (n, leaves), n levels per tree
+     */
+    std::span<const Tree::Level> cellLevels(size_t n, size_t leaves) const;
+
+    /**
+     * @brief Append the trees of cell (n, leaves) to `out`
+     */
+    void appendCell(size_t n, size_t leaves, std::vector<Tree>& out) const;
+
+private:
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrder;
+        std::uint32_t maxNodes;
+        std::uint32_t maxLeaves;
+    };
+
+    struct Entry {
+        std::uint64_t offset;  // bytes from the start of the file
+        std::uint64_t count;   // trees in the cell
+    };
+
+    SubtreeCacheFile() = default;
+
+    const Entry& entry(size_t n, size_t leaves) const {
+        return entries_[n * (maxLeaves_ + 1) + leaves];
+    }
+
+    void* mapping_ = nullptr;
+    size_t mappedSize_ = 0;
+    size_t maxN_ = 0;
+    size_t maxLeaves_ = 0;
+    const Entry* entries_ = nullptr;
+};
+
+} // namespace vinci
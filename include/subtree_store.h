@@ -0,0 +1,191 @@
+#pragma once
+
+#include "tree.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+namespace vinci {
+
+/**
+ * @brief Append-only subtree cache shared by all generator threads
+ *
+ * Cells are indexed by (nodes, leaves) and hold pointers to interned trees;
+ * what the leaf index means is up to the owner (TreeGenerator keys by leaf
+ * limit, TreeOptimizer by exact leaf count). Every distinct subtree is stored
+ * once (hash-consing), however many cells it appears in, so cache memory does
+ * not grow with the thread count. Owners whose cells are disjoint by
+ * construction can skip the duplicate lookup with Interning::Append.
+ *
+ * The store outlives a single run: grow() widens the table in place, keeping
+ * every published cell, so a long-lived generator only builds what a larger
+ * query adds.
+ *
+ * A cell is built at most once: the first thread to request it runs the
+ * builder while later requesters wait for it to be published. Once published,
+ * a cell and the trees it points to are immutable, and lookups are a single
+ * acquire load with no locking. Only interning new trees takes a lock, with
+ * the intern table sharded by fingerprint to keep contention low.
+ */
+class SubtreeStore {
+public:
+    using Cell = std::vector<const Tree*>;
+
+    /**
+     * @brief How intern() treats a tree that is already stored
+     */
+    enum class Interning {
+        Deduplicate,  // Return the stored copy (trees may repeat across cells)
+        Append        // Store every tree; the caller guarantees they are distinct
+    };
+
+    SubtreeStore() { reset(0, 0); }
+    SubtreeStore(size_t maxN, size_t maxLeaves, Interning interning = Interning::Deduplicate)
+        : interning_(interning) {
+        reset(maxN, maxLeaves);
+    }
+
+    SubtreeStore(const SubtreeStore&) = delete;
+    SubtreeStore& operator=(const SubtreeStore&) = delete;
+
+    /**
+     * @brief Drop all cells and trees and size the table for (maxN, maxLeaves)
+     * Not thread-safe; call only while no generation is running.
+     */
+    void reset(size_t maxN, size_t maxLeaves);
+
+    /**
+     * @brief Make room for cells up to (maxN, maxLeaves), keeping existing cells
+     * Never shrinks the table. Not thread-safe; call only while no generation
+     * is running.
+     */
+    void grow(size_t maxN, size_t maxLeaves);
+
+    /**
+     * @brief Published cell for (n, maxLeaves), or nullptr if not built yet
+     */
+    const Cell* find(size_t n, size_t maxLeaves) const {
+        const Slot& slot = slotAt(n, maxLeaves);
+        return slot.state.load(std::memory_order_acquire) == kReady ? slot.cell.get() : nullptr;
+    }
+
+    /**
+     * @brief Smallest published cell (n, m) with m > maxLeaves, or nullptr
+     * Filtering it by leaf count yields the cell for (n, maxLeaves).
+     */
+    const Cell* findSuperset(size_t n, size_t maxLeaves) const {
+        for (size_t m = maxLeaves + 1; m <= maxLeaves_; ++m) {
+            if (const Cell* cell = find(n, m)) {
+                return cell;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Return the cell for (n, maxLeaves), building it on first use
+     * @param build Callable returning either std::vector<Tree> of unique
+     *              canonical trees (interned here) or a Cell of trees already
+     *              in this store; it may itself request cells with fewer nodes.
+     *              If it throws, the exception propagates and the cell stays
+     *              unbuilt, so the next caller (or a waiting thread) builds it.
+     */
+    template<typename Build>
+    const Cell& getOrBuild(size_t n, size_t maxLeaves, Build&& build) {
+        Slot& slot = slotAt(n, maxLeaves);
+        std::uint8_t state = slot.state.load(std::memory_order_acquire);
+        while (state != kReady) {
+            std::uint8_t expected = kEmpty;
+            if (slot.state.compare_exchange_strong(expected, kBuilding, std::memory_order_acq_rel)) {
+                try {
+                    auto cell = std::make_unique<Cell>();
+                    if constexpr (std::is_same_v<std::invoke_result_t<Build>, Cell>) {
+                        *cell = build();
+                    } else {
+                        std::vector<Tree> trees = build();
+                        cell->reserve(trees.size());
+                        for (auto& tree : trees) {
+                            cell->push_back(intern(std::move(tree)));
+                        }
+                    }
+                    slot.cell = std::move(cell);
+                } catch (...) {
+                    // Hand the slot back so waiters (and later callers) retry
+                    // instead of waiting on a build that will never finish
+                    slot.state.store(kEmpty, std::memory_order_release);
+                    slot.state.notify_all();
+                    throw;
+                }
+                slot.state.store(kReady, std::memory_order_release);
+                slot.state.notify_all();
+                return *slot.cell;
+            }
+
+            // Another thread is building this cell; cells only depend on smaller
+            // node counts, so waiting here cannot deadlock
+            state = expected;
+            if (state == kBuilding) {
+                slot.state.wait(kBuilding, std::memory_order_acquire);
+                state = slot.state.load(std::memory_order_acquire);
+            }
+        }
+        return *slot.cell;
+    }
+
+    /**
+     * @brief Canonical shared copy of a tree (thread-safe)
+     * The returned tree stays valid and unchanged until reset() or destruction.
+     */
+    const Tree* intern(Tree&& tree);
+
+    // Number of distinct trees stored
+    size_t internedCount() const;
+
+    // Number of intern() calls answered with an already stored tree
+    size_t internHits() const;
+
+    size_t maxNodes() const { return maxN_; }
+    size_t maxLeaves() const { return maxLeaves_; }
+
+private:
+    static constexpr std::uint8_t kEmpty = 0;
+    static constexpr std::uint8_t kBuilding = 1;
+    static constexpr std::uint8_t kReady = 2;
+    static constexpr size_t kShards = 64;
+
+    struct Slot {
+        std::atomic<std::uint8_t> state{kEmpty};
+        std::unique_ptr<Cell> cell;
+    };
+
+    struct TreePtrHash {
+        size_t operator()(const Tree* tree) const noexcept { return tree->getHash(); }
+    };
+    struct TreePtrEqual {
+        bool operator()(const Tree* a, const Tree* b) const noexcept { return *a == *b; }
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::deque<Tree> trees;  // deque keeps addresses stable on push_back
+        std::unordered_set<const Tree*, TreePtrHash, TreePtrEqual> index;
+        size_t hits = 0;
+    };
+
+    Slot& slotAt(size_t n, size_t maxLeaves) { return slots_[n * (maxLeaves_ + 1) + maxLeaves]; }
+    const Slot& slotAt(size_t n, size_t maxLeaves) const { return slots_[n * (maxLeaves_ + 1) + maxLeaves]; }
+
+    Interning interning_ = Interning::Deduplicate;
+    size_t maxN_ = 0;
+    size_t maxLeaves_ = 0;
+    std::unique_ptr<Slot[]> slots_;
+    std::unique_ptr<std::array<Shard, kShards>> shards_;
+};
+
+} // namespace vinci
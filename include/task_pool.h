@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vinci {
+
+/**
+ * @brief Persistent work-stealing thread pool for batches of tasks
+ *
+ * Each worker owns a deque: it pops its own tasks LIFO (good locality for
+ * tasks it just split off) and, when empty, steals FIFO from the other
+ * deques, which hands thieves the oldest and usually largest pieces of work.
+ * Tasks may submit further tasks. A batch completes when every task, including
+ * the ones it spawned, has finished; wait() blocks on a latch for that moment
+ * rather than polling, and idle workers sleep on an atomic until work arrives.
+ * A task that throws fails its batch: the first exception is kept, the
+ * batch's remaining tasks are dropped unrun, and wait() rethrows it.
+ */
+class TaskPool {
+public:
+    // Tasks receive the index of the worker running them, in [0, size())
+    using Task = std::function<void(size_t worker)>;
+
+    // Runs once on each worker thread before it takes any task
+    using WorkerInit = std::function<void(size_t worker)>;
+
+    /**
+     * @param numThreads Number of workers (at least one)
+     * @param pinThreads Pin worker i to the i-th CPU the process may run on
+     * @param init Optional per-worker setup; the constructor returns once every
+     *             worker has run it, so memory it allocates is first touched,
+     *             and therefore placed, on the worker's own NUMA node
+     */
+    explicit TaskPool(size_t numThreads, bool pinThreads = false, WorkerInit init = {});
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    /**
+     * @brief Start a batch of tasks, spread round-robin over the workers
+     * @param onDone Runs once, on the worker that finishes the batch's last task
+     * Only one batch may be in flight; call wait() before starting another.
+     */
+    void start(std::vector<Task> tasks, std::function<void()> onDone = {});
+
+    /**
+     * @brief Add a task to the running batch (callable from inside a task)
+     * Tasks submitted from a worker go to that worker's own deque.
+     */
+    void submit(Task task);
+
+    /**
+     * @brief Block until the current batch has completed
+     * Rethrows the first exception a task of the batch threw, once.
+     */
+    void wait();
+
+    size_t size() const { return workers_.size(); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push(size_t worker, Task task);
+    bool popOrSteal(size_t worker, Task& task);
+    void finishTask();
+    void fail(std::exception_ptr error);
+    void run(size_t worker, std::stop_token stoken, bool pin, const WorkerInit& init,
+             std::latch& started);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::jthread> threads_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<std::uint64_t> epoch_{0};
+    std::atomic<size_t> nextWorker_{0};
+    std::function<void()> onDone_;
+    std::mutex failureMutex_;
+    std::exception_ptr failure_;
+    std::atomic<bool> failed_{false};
+    std::unique_ptr<std::latch> done_;
+};
+
+} // namespace vinci
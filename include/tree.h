@@ -5,51 +5,165 @@
 #include <memory>
 #include <ostream>
 #include <compare>
+#include <concepts>
+#include <cstdint>
+#include <span>
+#include <functional>
+#include <memory_resource>
 
 namespace vinci {
 
 /**
  * @brief Represents a tree node with arbitrary number of children
+ *
+ * The tree is stored as its preorder level sequence: one depth entry per node,
+ * root at level 0. Sequences of up to kInlineCapacity nodes live inside the
+ * object itself, so copying a typical generated tree never touches the heap.
+ * The subtree rooted at position i is the contiguous range [i, j) where j is
+ * the next position whose level is <= level[i].
+ *
+ * Node count, leaf count and fingerprint are kept up to date by every
+ * constructor and mutation, so reading them never walks the sequence.
+ *
+ * Larger sequences spill to a block from the calling thread's heap resource
+ * (see ArenaScope). The block records its resource, so a tree is always freed
+ * where it was allocated, whichever thread destroys it.
  */
 class Tree {
 public:
+    using Level = std::uint16_t;
+
+    // Number of nodes stored without a heap allocation
+    static constexpr size_t kInlineCapacity = 32;
+
+    /**
+     * @brief Route this thread's heap spills to `resource` while in scope
+     * Scopes nest; the previous resource is restored on destruction. Trees
+     * allocated inside must not outlive the resource.
+     */
+    class ArenaScope {
+    public:
+        explicit ArenaScope(std::pmr::memory_resource* resource);
+        ~ArenaScope();
+
+        ArenaScope(const ArenaScope&) = delete;
+        ArenaScope& operator=(const ArenaScope&) = delete;
+
+    private:
+        std::pmr::memory_resource* previous_;
+    };
+
+    // Resource used for heap spills on the calling thread (new/delete by default)
+    static std::pmr::memory_resource* heapResource();
+
     Tree();
     explicit Tree(const std::vector<Tree>& children);
+    explicit Tree(std::span<const Tree> children);
+
+    Tree(const Tree& other);
+    Tree(Tree&& other) noexcept;
+    Tree& operator=(const Tree& other);
+    Tree& operator=(Tree&& other) noexcept;
+    ~Tree();
+
+    /**
+     * @brief Build a tree from a preorder level sequence
+     * levels[0] must be 0 and every following entry at most one deeper than
+     * its predecessor. The sequence is taken as-is (not canonicalized).
+     */
+    static Tree fromLevelSequence(std::span<const Level> levels);
+
+    /**
+     * @brief Build the canonical tree whose root has the given children
+     * The children are referenced, not copied, and must already be canonical:
+     * only their order among themselves is fixed, so no part of any child is
+     * re-sorted. Equivalent to Tree(children) for canonical inputs.
+     */
+    static Tree fromCanonicalChildren(std::span<const Tree* const> children);
 
     // Add a child to this tree
     void addChild(const Tree& child);
 
-    // Get the children of this tree
-    const std::vector<Tree>& getChildren() const { return children_; }
+    // Get the children of this tree (materialized from the level sequence)
+    std::vector<Tree> getChildren() const;
+
+    // Preorder level sequence of the tree, root first
+    std::span<const Level> getLevels() const { return {data(), size_}; }
 
     // Get the number of nodes in the tree (including root)
-    size_t getNodeCount() const;
+    size_t getNodeCount() const { return size_; }
 
-    // Get the number of leaf nodes in the tree
-    size_t getLeafCount() const;
+    // Get the number of leaf nodes in the tree (cached, O(1))
+    size_t getLeafCount() const { return leaves_; }
 
     // Check if this tree is a leaf
-    bool isLeaf() const { return children_.empty(); }
+    bool isLeaf() const { return size_ == 1; }
 
     // Sort children to canonical form for equivalence checking
     void sortToCanonical();
 
-    // String representation for printing and comparison
+    // String representation for printing
     std::string toString() const;
 
-    // Three-way comparison for canonical ordering (C++20)
-    auto operator<=>(const Tree& other) const {
-        return toString() <=> other.toString();
+    /**
+     * @brief Structural fingerprint of the level sequence
+     * Cached and kept up to date by every mutating operation, so this is O(1).
+     * Isomorphic trees share a fingerprint once both are in canonical form.
+     */
+    size_t getHash() const {
+        // Final avalanche so low bits are usable as a table index
+        std::uint64_t h = hash_;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return static_cast<size_t>(h);
     }
 
+    // Three-way comparison for canonical ordering (C++20)
+    // Lexicographic on level sequences; never builds strings
+    std::strong_ordering operator<=>(const Tree& other) const;
+
     // Equality comparison (C++20)
-    bool operator==(const Tree& other) const = default;
+    bool operator==(const Tree& other) const;
 
     // Print tree in a readable format
     void print(std::ostream& os, const std::string& prefix = "", bool isLast = true) const;
 
 private:
-    std::vector<Tree> children_;
+    bool isInline() const { return capacity_ == kInlineCapacity; }
+    Level* data() { return isInline() ? inline_ : heap_; }
+    const Level* data() const { return isInline() ? inline_ : heap_; }
+
+    // Grow storage to hold at least `capacity` levels, preserving contents
+    void reserve(size_t capacity);
+
+    // Heap block for `capacity` levels, tagged with the current heap resource
+    static Level* allocateLevels(size_t capacity);
+    static void freeLevels(Level* levels, size_t capacity);
+
+    // Fold levels [from, size_) into hash_
+    void extendHash(size_t from);
+
+    std::uint32_t size_;
+    std::uint32_t capacity_;
+    std::uint32_t leaves_;
+    std::uint64_t hash_;
+    union {
+        Level inline_[kInlineCapacity];
+        Level* heap_;
+    };
 };
 
+// Concept for tree callback functions (C++20)
+template<typename F>
+concept TreeCallbackType = std::invocable<F, const Tree&> &&
+                           std::same_as<void, std::invoke_result_t<F, const Tree&>>;
+
 } // namespace vinci
+
+template<>
+struct std::hash<vinci::Tree> {
+    size_t operator()(const vinci::Tree& tree) const noexcept {
+        return tree.getHash();
+    }
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "tree.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace vinci {
+
+// Exact tree counts; 128 bits cover every (n, <=m) query up to n≈85 with no leaf limit
+__extension__ typedef unsigned __int128 TreeCount;
+
+/**
+ * @brief Decimal representation of a TreeCount
+ */
+std::string countToString(TreeCount value);
+
+/**
+ * @brief Counts rooted unlabeled trees by (nodes, leaves) without building them
+ *
+ * A tree with n >= 2 nodes is a root over a forest of n-1 nodes, and its
+ * leaves are the leaves of that forest. The table of forests F(n, k) is built
+ * by adding one tree class (a nodes, b leaves) at a time: choosing j copies
+ * from the T(a, b) distinct trees of that class with repetition contributes
+ * C(T(a, b) + j - 1, j) F(n - ja, k - jb). Total cost is polynomial in N and M.
+ *
+ * The same tables rank and unrank trees in generation order: trees with n
+ * nodes are ordered by leaf count, then as the ExactLeaves engine emits cell
+ * (n, k). There a tree is its root's children, grouped by (nodes, leaves)
+ * class with classes descending (nodes first), the sequence of classes
+ * ordered descending and, for one sequence of classes, the children's
+ * positions in their own cells ordered lexicographically, first child most
+ * significant. Keeping F after every class added gives each block of that
+ * order its size, so seeking costs polynomial time instead of a walk.
+ */
+class TreeCounter {
+public:
+    /**
+     * @brief Tables built by the constructor
+     * Ranking also keeps the forest table after every tree class (O(N²M²)
+     * entries) for forests(), rank() and unrank().
+     */
+    enum class Tables { Counts, Ranking };
+
+    /**
+     * @brief A root child in generation order: its class and position in that class
+     */
+    struct Child {
+        size_t nodes;
+        size_t leaves;
+        TreeCount index;   // Position within cell (nodes, leaves)
+    };
+
+    /**
+     * @brief Build count tables for up to maxN nodes and maxLeaves leaves
+     * @throws std::overflow_error if a count in range does not fit in 128 bits
+     */
+    TreeCounter(size_t maxN, size_t maxLeaves, Tables tables = Tables::Counts);
+
+    /**
+     * @brief Number of trees with exactly n nodes and exactly k leaves
+     */
+    TreeCount exact(size_t n, size_t k) const;
+
+    /**
+     * @brief Number of trees with exactly n nodes and at most m leaves
+     */
+    TreeCount atMost(size_t n, size_t m) const;
+
+    size_t maxNodes() const { return maxN_; }
+    size_t maxLeaves() const { return maxK_; }
+
+    /**
+     * @brief Forests with `nodes` nodes and `leaves` leaves using only classes <= (a, b)
+     * Classes are ordered by nodes, then leaves; b = 0 admits exactly the
+     * classes with fewer than a nodes. Needs Tables::Ranking.
+     */
+    TreeCount forests(size_t a, size_t b, size_t nodes, size_t leaves) const;
+
+    /**
+     * @brief Position of a canonical tree among the trees with its node count
+     * The position is the same for every leaf limit the tree satisfies.
+     * @throws std::invalid_argument if the tree is not canonical
+     * @throws std::out_of_range if the tree is larger than the tables
+     */
+    TreeCount rank(const Tree& tree) const;
+
+    /**
+     * @brief Tree at `index` among the trees with n nodes and at most m leaves
+     * @throws std::out_of_range unless index < atMost(n, m)
+     */
+    Tree unrank(size_t n, size_t m, TreeCount index) const;
+
+    /**
+     * @brief Position of a canonical tree within cell (nodes, leaves)
+     */
+    TreeCount rankExact(const Tree& tree) const;
+
+    /**
+     * @brief Tree at `index` of cell (n, k)
+     * @throws std::out_of_range unless index < exact(n, k)
+     */
+    Tree unrankExact(size_t n, size_t k, TreeCount index) const;
+
+    /**
+     * @brief Position within cell (n, k) of the tree with these root children
+     * The children may come in any order.
+     */
+    TreeCount rankChildren(size_t n, size_t k, std::vector<Child> children) const;
+
+    /**
+     * @brief Root children of the tree at `index` of cell (n, k), in generation order
+     * @throws std::out_of_range unless index < exact(n, k)
+     */
+    std::vector<Child> unrankChildren(size_t n, size_t k, TreeCount index) const;
+
+private:
+    TreeCount& trees(size_t n, size_t k) { return trees_[n * (maxK_ + 1) + k]; }
+
+    // Throws std::logic_error unless the ranking tables were built
+    void requireRanking() const;
+
+    size_t maxN_;
+    size_t maxK_;
+    // trees_[n * (maxK_ + 1) + k] = T(n, k)
+    std::vector<TreeCount> trees_;
+    // Ranking tables: the forest table once classes <= (a, b) are in, for
+    // a < maxN_ and b <= maxK_, each maxN_ * (maxK_ + 1) entries
+    std::vector<TreeCount> upTo_;
+    bool ranking_ = false;
+};
+
+} // namespace vinci
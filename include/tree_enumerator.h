@@ -0,0 +1,119 @@
+#pragma once
+
+#include "tree.h"
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+
+namespace vinci {
+
+/**
+ * @brief Duplicate-free enumeration of rooted trees by level sequence successor
+ *
+ * Walks the canonical level sequences of all rooted unlabeled trees with n
+ * nodes in decreasing lexicographic order (Beyer–Hedetniemi), from the path
+ * 0,1,...,n-1 down to the star 0,1,...,1. Every tree is visited exactly once,
+ * so no sorting, deduplication or caching is needed.
+ *
+ * The leaf limit is enforced during the walk: as soon as a prefix of the
+ * sequence already pins down more than maxLeaves leaves, the whole block of
+ * sequences sharing that prefix is skipped in one step by jumping to its
+ * lexicographically smallest member (the prefix followed by depth-1 nodes).
+ */
+class TreeEnumerator {
+public:
+    using Level = Tree::Level;
+
+    /**
+     * @brief Position the enumerator on the first tree with n nodes and at most maxLeaves leaves
+     */
+    TreeEnumerator(size_t n, size_t maxLeaves);
+
+    /**
+     * @brief Whether the enumerator currently holds a tree
+     */
+    bool valid() const { return valid_; }
+
+    /**
+     * @brief Advance to the next tree
+     * @return false once the sequence is exhausted
+     */
+    bool next();
+
+    // Canonical level sequence of the current tree
+    std::span<const Level> levels() const { return levels_; }
+
+    // Number of leaves of the current tree
+    size_t leafCount() const { return leavesBefore_[n_] + 1; }
+
+    // Materialize the current tree
+    Tree tree() const { return Tree::fromLevelSequence(levels_); }
+
+private:
+    // Raw Beyer–Hedetniemi successor; false when the current tree is the star
+    bool successor();
+
+    // Recompute leavesBefore_[i] for i > from
+    void updateLeaves(size_t from);
+
+    // Skip forward until the current tree satisfies the leaf limit
+    bool settle();
+
+    size_t n_;
+    size_t maxLeaves_;
+    bool valid_;
+    std::vector<Level> levels_;
+    // leavesBefore_[i]: leaves among positions < i-1, i.e. those fixed by levels_[0..i)
+    std::vector<std::uint32_t> leavesBefore_;
+};
+
+/**
+ * @brief Lazy input range over the trees with n nodes and at most maxLeaves leaves
+ *
+ * A pull-style view of TreeEnumerator: nothing is generated until the
+ * consumer advances, and each step costs one successor, so std::views::take,
+ * std::ranges::find_if or an early break pay only for the trees they reach.
+ * No cache or deduplication set is built. Trees come in the enumerator's
+ * order and are materialized on dereference; the range is single-pass.
+ */
+class TreeRange {
+public:
+    class iterator {
+    public:
+        using value_type = Tree;
+        using difference_type = std::ptrdiff_t;
+        using iterator_concept = std::input_iterator_tag;
+
+        iterator() = default;
+        explicit iterator(TreeEnumerator* walk) : walk_(walk) {}
+
+        Tree operator*() const { return walk_->tree(); }
+
+        // Level sequence and leaf count of the current tree, without materializing it
+        std::span<const TreeEnumerator::Level> levels() const { return walk_->levels(); }
+        size_t leafCount() const { return walk_->leafCount(); }
+
+        iterator& operator++() {
+            walk_->next();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(const iterator& it, std::default_sentinel_t) { return !it.walk_->valid(); }
+
+    private:
+        TreeEnumerator* walk_ = nullptr;
+    };
+
+    TreeRange(size_t n, size_t maxLeaves) : walk_(n, maxLeaves) {}
+
+    iterator begin() { return iterator(&walk_); }
+    std::default_sentinel_t end() const { return std::default_sentinel; }
+
+private:
+    TreeEnumerator walk_;
+};
+
+} // namespace vinci
@@ -1,19 +1,28 @@
 #pragma once
 
 #include "tree.h"
+#include "tree_counter.h"
+#include "tree_enumerator.h"
+#include "subtree_store.h"
+#include "subtree_cache_file.h"
+#include "partition_table.h"
+#include "generation_stats.h"
+#include "generation_constraints.h"
+#include "memory_planner.h"
 #include <vector>
 #include <functional>
 #include <mutex>
 #include <atomic>
-#include <concepts>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
 
 namespace vinci {
 
-// Concept for tree callback functions (C++20)
-template<typename F>
-concept TreeCallbackType = std::invocable<F, const Tree&> &&
-                           std::same_as<void, std::invoke_result_t<F, const Tree&>>;
-
 /**
  * @brief Generates all non-equivalent trees with N nodes and at most M leaves
  */
@@ -21,6 +30,30 @@ class TreeGenerator {
 public:
     using TreeCallback = std::function<void(const Tree&)>;
 
+    /**
+     * @brief Receives generated trees a batch at a time
+     * The span and its trees are only valid during the call; copy what must
+     * outlive it.
+     */
+    using BatchCallback = std::function<void(std::span<const Tree>)>;
+
+    /**
+     * @brief Makes the consumer of one worker for generatePerThread()
+     * Called on the calling thread, once per worker index, before any tree is
+     * generated.
+     */
+    using ConsumerFactory = std::function<BatchCallback(size_t worker)>;
+
+    /**
+     * @brief Generation back ends, selected with setEngine()
+     */
+    enum class Engine {
+        Auto,           // LevelSequence for N >= 10, Memoized for the small serial cases
+        Memoized,       // Partition-based memoized generation with deduplication
+        LevelSequence,  // Duplicate-free successor walk (TreeEnumerator), no cache
+        ExactLeaves     // Exact-leaf cell table (TreeOptimizer), single-threaded streaming
+    };
+
     /**
      * @brief Generate all trees with N nodes and at most M leaves
      * @param n Total number of nodes
@@ -31,66 +64,394 @@ public:
      */
     size_t generate(size_t n, size_t m, TreeCallback callback, bool useMultithreading = true);
 
+    /**
+     * @brief Generate the `length` trees from position `start` of the rank order
+     * Positions are those of TreeCounter::rank(), which is the order the
+     * ExactLeaves engine emits. The first tree is found by unranking, so
+     * resuming a long run or taking any slice costs polynomial time instead of
+     * regenerating the trees before it, and disjoint slices split a run
+     * across processes. The engine and shard settings do not apply.
+     * @return Trees generated; fewer than `length` if the slice passes the last tree
+     */
+    size_t generate(size_t n, size_t m, TreeCount start, TreeCount length, TreeCallback callback);
+
+    /**
+     * @brief Generate all trees, with the callback inlined into the per-tree loop
+     * Trees reach the callback through generateBatches(), so only one
+     * indirect call is made per batch; the callback itself is specialized
+     * per type. Same threading guarantees as the std::function overload,
+     * which remains for callers that need a stable signature.
+     */
+    template<TreeCallbackType F>
+        requires (!std::same_as<std::remove_cvref_t<F>, TreeCallback>)
+    size_t generate(size_t n, size_t m, F&& callback, bool useMultithreading = true) {
+        return generateBatches(n, m, [&callback](std::span<const Tree> batch) {
+            for (const Tree& tree : batch) {
+                callback(tree);
+            }
+        }, useMultithreading);
+    }
+
+    /**
+     * @brief Generate all trees, delivering them in batches to one consumer
+     * Calls never overlap and all come from the calling thread, so the
+     * consumer needs no locking; a parallel run hands over each worker's
+     * queued trees as one span instead of one call per tree.
+     * @return Total count of generated trees
+     */
+    size_t generateBatches(size_t n, size_t m, BatchCallback consumer, bool useMultithreading = true);
+
+    /**
+     * @brief Generate all trees, each worker feeding its own consumer
+     * Worker w's consumer, made by makeConsumer(w), is called only on that
+     * worker with the trees it generated, so consumers run in parallel with
+     * no lock and no merge through the calling thread. A serial run makes a
+     * single consumer (worker 0). Auto picks the Memoized engine for parallel
+     * runs, the only engine that generates on several threads. Consumers are
+     * destroyed before this returns.
+     * @return Total count of generated trees
+     */
+    size_t generatePerThread(size_t n, size_t m, const ConsumerFactory& makeConsumer,
+                             bool useMultithreading = true);
+
+    /**
+     * @brief Pull-style lazy range over the trees with N nodes and at most M leaves
+     * Does only the work the consumer asks for: the level sequence walk of the
+     * LevelSequence engine, advanced one tree per increment, with no cache,
+     * dedup set or worker threads. Independent of this generator's settings.
+     */
+    static TreeRange trees(size_t n, size_t m) { return TreeRange(n, m); }
+
+    /**
+     * @brief Count trees with N nodes and at most M leaves without generating them
+     * Uses the (nodes, leaves) recurrence in TreeCounter, so it is not subject
+     * to the memory limits of generate().
+     * @throws std::overflow_error if the count does not fit in 128 bits
+     */
+    static TreeCount count(size_t n, size_t m);
+
     /**
      * @brief Get the count of generated trees (thread-safe)
      */
     size_t getCount() const { return count_.load(); }
 
+    // Trees buffered per worker thread before it waits for the consumer
+    static constexpr size_t kStreamQueueDepth = 1024;
+
+    // Root partitions with more combinations than this are split into pool tasks
+    static constexpr size_t kSplitThreshold = 4096;
+
+    /**
+     * @brief Select the back end used by generate()
+     */
+    void setEngine(Engine engine) { engine_ = engine; }
+    Engine getEngine() const { return engine_; }
+
+    /**
+     * @brief Engine a generate() call with these arguments will use
+     * Resolves Engine::Auto, shards (always Memoized) and constraints (always
+     * ExactLeaves). Under Auto, runs of N >= 10 use the level sequence walk
+     * unless parallel work was asked for: a thread count above one set with
+     * setThreadCount(), or per-worker consumers on several threads. A run
+     * whose memory plan does not fit may still fall back to the walk.
+     */
+    Engine resolvedEngine(size_t n, bool perWorker, bool useMultithreading) const;
+
+    /**
+     * @brief Number of worker threads for parallel generation
+     * @param threads Worker count; 0 (the default) uses every hardware thread
+     */
+    void setThreadCount(size_t threads) { threadCount_ = threads; }
+    size_t getThreadCount() const { return threadCount_; }
+
+    /**
+     * @brief Pin each worker thread to its own CPU
+     * Combined with per-worker buffers allocated on the worker itself, this
+     * keeps a worker's streaming queue and scratch memory on its NUMA node.
+     */
+    void setCpuAffinity(bool pin) { pinThreads_ = pin; }
+    bool getCpuAffinity() const { return pinThreads_; }
+
+    /**
+     * @brief Distinct subtrees kept between generate() calls
+     * Later calls extend this cache instead of rebuilding it; a query with a
+     * smaller leaf limit is served by filtering cells of a larger one.
+     */
+    size_t getCachedSubtreeCount() const { return store_.internedCount(); }
+
+    /**
+     * @brief Drop every cached subtree and release the generator's arena
+     * Not thread-safe; call only while no generate() is running.
+     */
+    void clearCache();
+
+    /**
+     * @brief Persist pre-warmed subtrees in a memory-mapped file
+     * Runs whose pre-warm range the file covers load those cells from the
+     * mapping instead of generating them; otherwise the cells are generated
+     * and the file is (re)written for the next run. An empty path disables it.
+     */
+    void setCacheFile(const std::string& path) {
+        cacheFilePath_ = path;
+        cacheFile_.reset();
+    }
+    const std::string& getCacheFile() const { return cacheFilePath_; }
+
+    /**
+     * @brief Collect phase timers and counters for getStats()
+     * Off by default: with it off, getStats() only has trees, threads and
+     * elapsed, and the hot paths skip every timer.
+     */
+    void setStatsEnabled(bool enabled) { statsEnabled_ = enabled; }
+    bool getStatsEnabled() const { return statsEnabled_; }
+
+    /**
+     * @brief Statistics of the most recent generate() call
+     */
+    const GenerationStats& getStats() const { return stats_; }
+
+    /**
+     * @brief Report live progress on stderr every `interval` during generate()
+     * Zero (the default) disables the reporter. It only reads atomic counters
+     * and is stopped and joined before generate() returns.
+     */
+    void setProgressInterval(std::chrono::milliseconds interval) { progressInterval_ = interval; }
+    std::chrono::milliseconds getProgressInterval() const { return progressInterval_; }
+
+    /**
+     * @brief Only generate trees meeting these depth, out-degree and leaf limits
+     * The limits are pushed into generation instead of filtering finished
+     * trees: a run with depth or out-degree limits always uses the
+     * ExactLeaves engine's constrained cells (see
+     * TreeOptimizer::generateConstrained()), and minLeaves skips whole leaf
+     * counts. Sharded and sliced runs enumerate the unconstrained order, so
+     * they reject any limit.
+     */
+    void setConstraints(const GenerationConstraints& constraints) { constraints_ = constraints; }
+    const GenerationConstraints& getConstraints() const { return constraints_; }
+
+    /**
+     * @brief Bytes a generate() call may use
+     * Before each run a MemoryPlanner predicts its peak from the exact tree
+     * counts and lowers the worker count and per-worker buffering to fit.
+     * A run that cannot fit falls back to the level sequence walk under
+     * Engine::Auto without constraints, and is refused (returning 0) otherwise. Zero (the default)
+     * uses MemoryPlanner::availableMemory(); if that is unknown the run is
+     * not limited.
+     */
+    void setMemoryBudget(size_t bytes) { memoryBudget_ = bytes; }
+    size_t getMemoryBudget() const { return memoryBudget_; }
+
+    /**
+     * @brief Memory plan of the most recent cache-based generate() call
+     */
+    const MemoryPlan& getMemoryPlan() const { return plan_; }
+
+    /**
+     * @brief Restrict generate() to shard `index` of `count`
+     * Root partitions (ways to split the non-root nodes among the root's
+     * children) are dealt out by shardPartitions(), so shards emit disjoint
+     * sets of trees whose union is the full result. Only the Memoized engine
+     * works by root partition, so a sharded generate() always uses it.
+     * @throws std::invalid_argument unless index < count
+     */
+    void setShard(size_t index, size_t count);
+    size_t getShardIndex() const { return shardIndex_; }
+    size_t getShardCount() const { return shardCount_; }
+
+    /**
+     * @brief Root partitions of an (n, m) run assigned to shard `index` of `count`
+     * Each partition is weighted by an upper bound on its trees, computed in
+     * exact integer arithmetic, and partitions are dealt heaviest first to the
+     * least-loaded shard (lowest index on ties). The split depends only on the
+     * arguments, so independent processes agree on it.
+     * @return Ascending indices into the partitions of n-1 in PartitionIterator order
+     * @throws std::invalid_argument unless index < count
+     */
+    static std::vector<size_t> shardPartitions(size_t n, size_t m, size_t index, size_t count);
+
 private:
+    // Generation temporaries; allocated from arena_ and discarded together
+    using TreeBuffer = std::pmr::vector<Tree>;
+
+    // Interned subtrees referenced in place (they live as long as store_)
+    using TreeRefs = std::pmr::vector<const Tree*>;
+
+    /**
+     * @brief Subtrees allowed at one child position, ordered by leaf count
+     * Trees with l leaves occupy [bucketEnd[l-1], bucketEnd[l]), so every
+     * option within a leaf budget is a prefix of `trees`. The options point
+     * into the subtree store; no tree is copied.
+     */
+    struct ChildOptions {
+        explicit ChildOptions(std::pmr::memory_resource* resource)
+            : trees(resource), bucketEnd(resource) {}
+
+        // Options with at most `leaves` leaves are [0, upTo(leaves))
+        size_t upTo(size_t leaves) const {
+            return bucketEnd[std::min(leaves, bucketEnd.size() - 1)];
+        }
+
+        TreeRefs trees;
+        std::pmr::vector<size_t> bucketEnd;
+        size_t minLeaves = 0;       // Fewest leaves of any option here
+        size_t reservedLeaves = 0;  // Sum of minLeaves over the later positions
+    };
+
+    // Hands a full result buffer on (to the consumer or a streaming queue) and empties it
+    using Flush = std::function<void(TreeBuffer&)>;
+
+    // Rank positions [start, start + length) requested from generate()
+    struct Slice {
+        TreeCount start;
+        TreeCount length;
+    };
+
     std::atomic<size_t> count_{0};
-    std::mutex callback_mutex_;
-    std::mutex cache_mutex_;
+    std::pmr::memory_resource* callerResource_ = nullptr;  // Heap of the thread that called generate()
+    Engine engine_ = Engine::Auto;
+    size_t threadCount_ = 0;
+    bool pinThreads_ = false;
+    size_t shardIndex_ = 0;
+    size_t shardCount_ = 1;
+    std::optional<Slice> slice_;  // Set only while a sliced generate() runs
+    GenerationConstraints constraints_;
+    size_t memoryBudget_ = 0;
+    MemoryPlan plan_;
+    size_t flushTrees_ = MemoryPlanner::kMinFlushTrees;  // From plan_; read by generateCombinations()
+
+    // Telemetry of the running / last generate() call
+    bool statsEnabled_ = false;
+    std::chrono::milliseconds progressInterval_{0};
+    GenerationStats stats_;
+    size_t runThreads_ = 1;
+    GenerationStats::Duration prewarmTime_{0};
+    std::atomic<size_t> partitionsDone_{0};
+    std::atomic<size_t> partitionsTotal_{0};
+    std::mutex statsMutex_;
+    std::deque<GenerationStats> threadStats_;  // One per attached thread; deque keeps them in place
+
+    // Workers a run would use before the memory plan: 1 when serial or N < 10
+    size_t resolvedThreads(size_t n, bool useMultithreading) const;
 
     /**
-     * @brief Generate all partitions of n into at most k parts
-     * This represents ways to distribute n nodes among children
+     * @brief Run generation inside its telemetry scope
+     * @param perWorker Give every worker its own consumer instead of draining
+     *                  all trees to makeConsumer(0) on the calling thread
      */
-    void generatePartitions(
-        size_t n,
-        size_t k,
-        std::vector<size_t>& current,
-        std::vector<std::vector<size_t>>& result
-    );
+    size_t run(size_t n, size_t m, const ConsumerFactory& makeConsumer, bool perWorker,
+               bool useMultithreading);
+
+    /**
+     * @brief Body of run()
+     */
+    size_t generateRun(size_t n, size_t m, const ConsumerFactory& makeConsumer, bool perWorker,
+                       bool useMultithreading);
+
+    /**
+     * @brief Give the calling thread its own accumulator for this run
+     * No-op unless stats are enabled.
+     */
+    void attachThreadStats();
 
     /**
      * @brief Recursive tree generation with memoization
+     * Reuses, in order: the published cell, a filtered cell with a higher leaf
+     * limit, the cache file, and only then generates from partitions.
      * @param n Number of nodes in subtree
      * @param maxLeaves Maximum leaves allowed in subtree
-     * @param results Output vector of generated trees
-     * @param localCache Thread-local cache for lock-free operation
+     * @return Cell of the shared subtree store holding every such tree
+     */
+    const SubtreeStore::Cell& generateTreesRecursive(size_t n, size_t maxLeaves);
+
+    /**
+     * @brief Reference the subtree cell for every part of a partition, bucketed by leaf count
+     * Each part is read at the limit left after every other part takes one
+     * leaf, so options that can never fit are not listed.
+     * @return false if the parts cannot share maxLeaves leaves
+     */
+    bool collectChildOptions(
+        Partition partition,
+        size_t maxLeaves,
+        std::vector<ChildOptions>& options
+    );
+
+    /**
+     * @brief Generate the distinct trees whose root children have the given sizes
+     * @param partition Child subtree sizes in non-increasing order
+     * @param maxLeaves Maximum leaves allowed in each tree
+     * @param results Output vector of unique canonical trees
+     * @param flush If set, called whenever `results` holds the plan's flushTrees
      */
-    void generateTreesRecursive(
-        size_t n,
+    void generatePartitionTrees(
+        Partition partition,
         size_t maxLeaves,
-        std::vector<Tree>& results,
-        std::vector<std::vector<std::vector<Tree>>>& localCache
+        TreeBuffer& results,
+        const Flush* flush = nullptr
     );
 
     /**
      * @brief Generate all ways to combine children into a tree
-     * Uses Cartesian product with canonical ordering
+     * Walks the Cartesian product of child options, taking option indices in
+     * non-increasing order across equal-sized parts so every multiset of
+     * children appears once. Position `index` tries options [optionBegin, optionEnd)
+     * one leaf bucket at a time, stopping at the first bucket that would leave
+     * the later positions less than their minimum out of `leafBudget`.
+     * With `flush`, full buffers are handed on as they fill, so a worker holds
+     * at most the plan's flushTrees finished trees.
      */
     void generateCombinations(
-        const std::vector<size_t>& partition,
-        size_t maxLeaves,
-        const std::vector<std::vector<Tree>>& childTrees,
+        Partition partition,
+        const std::vector<ChildOptions>& childTrees,
         size_t index,
-        std::vector<Tree>& current,
-        std::vector<Tree>& results
+        size_t optionBegin,
+        size_t optionEnd,
+        size_t leafBudget,
+        TreeRefs& current,
+        TreeBuffer& results,
+        const Flush* flush = nullptr
     );
 
+    /**
+     * @brief Stream trees straight from the level sequence enumerator
+     */
+    size_t generateLevelSequences(size_t n, size_t m, BatchCallback& consumer);
+
+    /**
+     * @brief Stream a slice of the rank order, unranking each tree's root children
+     */
+    size_t generateSlice(size_t n, size_t m, const Slice& slice, BatchCallback& consumer);
+
     /**
      * @brief Pre-warm cache for small values (single-threaded)
+     * Cells covered by the cache file are copied out of the mapping.
      */
     void prewarmCache(size_t maxN, size_t maxM);
 
     /**
-     * @brief Call the callback function in a thread-safe manner
+     * @brief Hand a batch to a consumer and count it
+     * Each consumer is only ever called from one thread, so no lock is taken.
      */
-    void invokeCallback(const Tree& tree, TreeCallback& callback);
+    void deliver(BatchCallback& consumer, std::span<const Tree> batch);
+
+    /**
+     * @brief Backing memory for a run's temporaries and tree heap spills
+     * Pooled per thread inside the resource, so workers do not contend on the
+     * global allocator; freed temporaries are reused by later runs and
+     * everything is released in bulk by clearCache(). Declared before store_
+     * so interned trees are destroyed first.
+     */
+    std::pmr::synchronized_pool_resource arena_;
+
+    // Memoization cache shared by all worker threads: cell (n, maxLeaves)
+    SubtreeStore store_;
+
+    // Ways to split a subtree's non-root nodes among its children, per node count
+    PartitionTable partitions_;
 
-    // Memoization cache: cache_[n][maxLeaves] = vector of trees
-    std::vector<std::vector<std::vector<Tree>>> cache_;
+    // On-disk pre-warm cache (see setCacheFile)
+    std::string cacheFilePath_;
+    std::unique_ptr<SubtreeCacheFile> cacheFile_;
 };
 
 } // namespace vinci
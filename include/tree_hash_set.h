@@ -0,0 +1,60 @@
+#pragma once
+
+#include "tree.h"
+#include <vector>
+#include <cstdint>
+
+namespace vinci {
+
+/**
+ * @brief Open-addressing set of canonical trees keyed on Tree::getHash()
+ *
+ * Trees are owned by the set and kept in insertion order, so the unique
+ * results can be moved out in one step with release(). Slots store the
+ * fingerprint next to the tree index, which keeps probing inside the slot
+ * table; the trees themselves are only touched to verify a fingerprint match.
+ */
+class TreeHashSet {
+public:
+    explicit TreeHashSet(size_t expectedSize = 0);
+
+    /**
+     * @brief Insert a tree (expected in canonical form)
+     * @return true if the tree was not already present
+     */
+    bool insert(const Tree& tree);
+    bool insert(Tree&& tree);
+
+    bool contains(const Tree& tree) const;
+
+    size_t size() const { return trees_.size(); }
+    bool empty() const { return trees_.empty(); }
+
+    // Unique trees in insertion order
+    const std::vector<Tree>& trees() const { return trees_; }
+
+    /**
+     * @brief Move the unique trees out and reset the set
+     */
+    std::vector<Tree> release();
+
+    void clear();
+
+private:
+    static constexpr std::uint32_t kEmpty = UINT32_MAX;
+
+    struct Slot {
+        std::uint64_t hash;
+        std::uint32_t index;
+    };
+
+    // Slot holding `tree`, or the empty slot where it would go
+    size_t findSlot(const Tree& tree, std::uint64_t hash) const;
+    void grow();
+
+    std::vector<Slot> slots_;
+    std::vector<Tree> trees_;
+    size_t mask_;
+};
+
+} // namespace vinci
@@ -1,21 +1,37 @@
 #pragma once
 
 #include "tree.h"
+#include "task_pool.h"
+#include "subtree_store.h"
+#include "generation_constraints.h"
 #include <vector>
 #include <functional>
+#include <span>
 
 namespace vinci {
 
 /**
- * @brief Specialized optimizations for tree generation with small M values
+ * @brief Exact-leaf-count tree generation from a (nodes, leaves) cell table
+ *
+ * Cell (n, k) holds every tree with n nodes and exactly k leaves. It is built
+ * from cells with fewer nodes: the root's children are chosen as a
+ * non-increasing sequence of (nodes, leaves) types whose sums are (n-1, k),
+ * and equal types take trees in non-increasing cell order. Every tree is
+ * therefore produced exactly once, with no deduplication, and the leaf limit
+ * is met by construction rather than by filtering.
+ *
+ * The table is a SubtreeStore keyed by exact leaf count, so cells are
+ * published once and immutable afterwards: any number of threads may read
+ * and build cells concurrently with no further synchronization.
  */
 class TreeOptimizer {
 public:
     using TreeCallback = std::function<void(const Tree&)>;
+    using BatchCallback = std::function<void(std::span<const Tree>)>;
 
     /**
      * @brief Generate trees with exactly k leaves and n total nodes
-     * Uses generic memoized approach that works for any k
+     * Builds the cell table below n, then cell (n, k)
      */
     static void generateWithExactLeaves(
         size_t n,
@@ -24,36 +40,40 @@ public:
     );
 
     /**
-     * @brief Generic memoized generation for any k
-     * Uses cached results from smaller k values
+     * @brief Cell (n, k) of the table, building it (and any missing inputs) on first use
+     * @param cells Table covering at least (n, k); safe to share between threads
+     */
+    static const SubtreeStore::Cell& exactCell(size_t n, size_t k, SubtreeStore& cells);
+
+    /**
+     * @brief Build the trees of cell (n, k) from the cells with fewer nodes
+     * Input cells that are not yet published are built through exactCell().
+     * @param cells Table covering at least (n-1, k)
      */
     static void generateWithExactLeavesGeneric(
         size_t n,
         size_t k,
         std::vector<Tree>& results,
-        std::vector<std::vector<std::vector<Tree>>>& cache
+        SubtreeStore& cells
     );
 
     /**
      * @brief Build cache in parallel for all (n, k) pairs up to maxN and maxK
-     * Uses parallel processing to populate cache efficiently
+     * Each cell is a task that starts once the cells it reads are built, so
+     * work follows the (nodes, leaves) wavefront with no per-level barrier.
+     * Cells already published in the table are kept.
+     * @param cells Table to fill, grown to (maxN, maxK) if smaller; growing is
+     *              not thread-safe, so size it up front when sharing it
+     * @param pool Workers to run on; nullptr uses a persistent shared pool.
+     *             Must not be a pool whose task is making this call.
      */
     static void buildCacheParallel(
         size_t maxN,
         size_t maxK,
-        std::vector<std::vector<std::vector<Tree>>>& cache
+        SubtreeStore& cells,
+        TaskPool* pool = nullptr
     );
 
-    /**
-     * @brief Check if we should use optimized algorithm
-     * Only use for tight leaf constraints where specialized algorithms excel
-     */
-    static bool shouldUseOptimized(size_t n, size_t m) {
-        // Use optimizer only when M is very small (≤4) and N is large enough to benefit
-        // For larger M, the parallel generator is more efficient
-        return n >= 15 && m <= 4;
-    }
-
     /**
      * @brief Generate all trees with callback (parallel)
      * Efficiently handles any M value with full CPU utilization
@@ -66,37 +86,75 @@ public:
     );
 
     /**
-     * @brief Generate all integer partitions of n into exactly k parts
-     * Results in non-increasing order
+     * @brief As generateAllWithCallback, with the callback inlined into the per-tree loop
      */
-    static void generateIntegerPartitions(
-        size_t n,
-        size_t k,
-        size_t minPart,
-        std::vector<size_t>& current,
-        std::vector<std::vector<size_t>>& result
-    );
+    template<TreeCallbackType F>
+        requires (!std::same_as<std::remove_cvref_t<F>, TreeCallback>)
+    static size_t generateAllWithCallback(size_t n, size_t maxM, F&& callback, bool showProgress = false) {
+        return generateAllInBatches(n, maxM, [&callback](std::span<const Tree> batch) {
+            for (const Tree& tree : batch) {
+                callback(tree);
+            }
+        }, showProgress);
+    }
 
-private:
     /**
-     * @brief Generate trees with exactly 1 leaf (single chain)
+     * @brief Generate all trees, one batch per exact leaf count
+     * Each batch is only valid during its call.
+     * @return Total count of generated trees
      */
-    static void generateSingleLeaf(size_t n, std::vector<Tree>& results);
+    static size_t generateAllInBatches(
+        size_t n,
+        size_t maxM,
+        const BatchCallback& consumer,
+        bool showProgress = false
+    );
 
     /**
-     * @brief Generate trees with exactly 2 leaves
+     * @brief Generate the trees meeting `constraints`, one batch per exact leaf count
+     * Depth and out-degree limits are pushed into cell construction (see
+     * generateConstrained()); minLeaves alone keeps the parallel cell table
+     * and skips the smaller leaf counts.
+     * @param pool Workers for the cell table (see buildCacheParallel());
+     *             nullptr uses the persistent shared pool
+     * @return Total count of generated trees
      */
-    static void generateTwoLeaves(size_t n, std::vector<Tree>& results);
+    static size_t generateAllInBatches(
+        size_t n,
+        size_t maxM,
+        const GenerationConstraints& constraints,
+        const BatchCallback& consumer,
+        bool showProgress = false,
+        TaskPool* pool = nullptr
+    );
 
     /**
-     * @brief Generate trees with exactly 3 leaves
+     * @brief Generate the trees within depth and out-degree limits, one batch per leaf count
+     * Cells are keyed on (nodes, leaves, depth still allowed) and the root's
+     * children are capped while child types are chosen, so trees that break
+     * a limit are never built and the work follows the size of the output.
+     * Cells are built serially on first use and dropped on return.
+     * @return Total count of generated trees
      */
-    static void generateThreeLeaves(size_t n, std::vector<Tree>& results);
+    static size_t generateConstrained(
+        size_t n,
+        size_t maxM,
+        const GenerationConstraints& constraints,
+        const BatchCallback& consumer
+    );
 
     /**
-     * @brief Generate trees with exactly 4 leaves
+     * @brief Generate all integer partitions of n into exactly k parts, each >= minPart
+     * Parts are in non-increasing order and appended to `current`, whose last
+     * entry (if any) bounds them. Built on PartitionIterator.
      */
-    static void generateFourLeaves(size_t n, std::vector<Tree>& results);
+    static void generateIntegerPartitions(
+        size_t n,
+        size_t k,
+        size_t minPart,
+        std::vector<size_t>& current,
+        std::vector<std::vector<size_t>>& result
+    );
 };
 
 } // namespace vinci
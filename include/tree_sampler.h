@@ -0,0 +1,83 @@
+#pragma once
+
+#include "tree.h"
+#include "tree_counter.h"
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <span>
+
+namespace vinci {
+
+/**
+ * @brief Draws uniformly random trees with N nodes and at most M leaves
+ *
+ * Exhaustive generation stops around N=30, but the (nodes, leaves) counts of
+ * TreeCounter stay cheap far beyond that, and they are all a recursive
+ * sampler needs. A tree is a root over a forest, and marking one forest node
+ * gives the identity
+ *     n F(n, k) = sum over j, d, l of d T(d, l) F(n - jd, k - jl),
+ * so a uniform forest is j copies of a uniform (d, l) tree plus a uniform
+ * forest of the rest, with (j, d, l) drawn with weight d T(d, l) F(n - jd, k - jl)
+ * (Nijenhuis-Wilf, split by leaf count). Draws are exact: every tree with
+ * n nodes and at most m leaves is equally likely.
+ */
+class TreeSampler {
+public:
+    using Rng = std::mt19937_64;
+    using TreeCallback = std::function<void(const Tree&)>;
+    using BatchCallback = std::function<void(std::span<const Tree>)>;
+
+    // Trees drawn from one RNG stream; the unit of work and of delivery
+    static constexpr size_t kChunkSize = 256;
+
+    /**
+     * @brief Build the count tables for trees with n nodes and at most m leaves
+     * @throws std::overflow_error if n times a forest count does not fit in 128 bits
+     */
+    TreeSampler(size_t n, size_t m);
+
+    /**
+     * @brief Number of trees the sampler draws from
+     */
+    TreeCount population() const { return population_; }
+
+    /**
+     * @brief Draw one tree
+     * @throws std::out_of_range if there is no tree to draw
+     */
+    Tree sample(Rng& rng) const;
+
+    /**
+     * @brief Draw `count` trees, delivered in batches on the calling thread
+     * Chunk c of kChunkSize trees is drawn from its own RNG seeded with
+     * (seed, c), so workers share no RNG state and the output depends only
+     * on the seed, never on the thread count or scheduling.
+     * @param threads Worker count; 0 uses every hardware thread
+     * @return Trees drawn
+     */
+    size_t sampleBatches(size_t count, std::uint64_t seed, const BatchCallback& consumer,
+                         size_t threads = 0) const;
+
+    /**
+     * @brief As sampleBatches, one callback per tree
+     */
+    size_t sample(size_t count, std::uint64_t seed, const TreeCallback& callback, size_t threads = 0) const;
+
+private:
+    // Forests with `nodes` nodes and `leaves` leaves, over every tree class
+    TreeCount forests(size_t nodes, size_t leaves) const;
+
+    // Append a uniform forest of (nodes, leaves) to `roots`; trees repeated j times appear j times
+    void sampleForest(size_t nodes, size_t leaves, Rng& rng, std::vector<Tree>& roots) const;
+
+    // Uniform tree with exactly n nodes and k leaves
+    Tree sampleExact(size_t n, size_t k, Rng& rng) const;
+
+    size_t n_;
+    size_t m_;
+    TreeCounter counter_;
+    TreeCount population_ = 0;
+};
+
+} // namespace vinci
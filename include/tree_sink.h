@@ -0,0 +1,119 @@
+#pragma once
+
+#include "tree.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vinci {
+
+/**
+ * @brief Record formats written by TreeSink
+ *
+ * Binary records start with the node count as a little-endian uint16.
+ * - Text:   toString() form, one tree per line
+ * - Levels: preorder level sequence, one byte per node (two, little-endian,
+ *           when the tree has more than 256 nodes)
+ * - Parens: balanced parentheses below the root, 2 bits per non-root node
+ *           (1 = descend, 0 = return), packed MSB first and padded to a byte
+ * Every tree of a run has the same node count, so binary records from one
+ * run are fixed-size.
+ */
+enum class OutputFormat {
+    Text,
+    Levels,
+    Parens
+};
+
+/**
+ * @brief Buffered, thread-safe writer of encoded trees to a file descriptor
+ *
+ * Each calling thread encodes into its own buffer; a buffer is handed to the
+ * kernel in one write() once it fills, and flush() gathers every pending
+ * buffer into a single writev(). Records never straddle two writes, so output
+ * from concurrent threads interleaves only at record boundaries.
+ */
+class TreeSink {
+public:
+    static constexpr size_t kDefaultBufferSize = 1 << 20;
+
+    /**
+     * @param fd Destination; not closed by the sink
+     * @throws std::invalid_argument if bufferSize is zero
+     */
+    TreeSink(int fd, OutputFormat format, size_t bufferSize = kDefaultBufferSize);
+    ~TreeSink();
+
+    TreeSink(const TreeSink&) = delete;
+    TreeSink& operator=(const TreeSink&) = delete;
+
+    /**
+     * @brief Encode one tree into the calling thread's buffer
+     * @throws std::system_error if a full buffer cannot be written out
+     */
+    void write(const Tree& tree);
+
+    /**
+     * @brief Write out every thread's buffer
+     * Call only while no thread is inside write().
+     * @throws std::system_error on a failed write
+     */
+    void flush();
+
+    // Trees accepted so far
+    size_t written() const { return written_.load(std::memory_order_relaxed); }
+
+    OutputFormat format() const { return format_; }
+
+    /**
+     * @brief Append the encoding of `tree` to `out`
+     * @throws std::length_error for binary formats if the tree has more than 65535 nodes
+     */
+    static void encode(const Tree& tree, OutputFormat format, std::string& out);
+
+    /**
+     * @brief Decode the record at the front of `input` and advance past it
+     * @return std::nullopt if `input` is empty or holds a truncated record
+     * @throws std::runtime_error if a complete record is not one rooted tree:
+     *         root at level 0, every other node at most one level deeper than
+     *         its predecessor, and as many nodes as its header says
+     */
+    static std::optional<Tree> decode(std::string_view& input, OutputFormat format);
+
+    /**
+     * @brief Decode every record read from `fd` until end of file
+     * @return Number of records passed to `visit`
+     * @throws std::system_error on a failed read
+     * @throws std::runtime_error if the input holds an invalid record (see decode())
+     *         or ends in a truncated one
+     */
+    static size_t read(int fd, OutputFormat format, const std::function<void(const Tree&)>& visit);
+
+    // "text", "levels" or "parens"
+    static std::optional<OutputFormat> parseFormat(std::string_view name);
+
+private:
+    struct Buffer {
+        std::string data;
+    };
+
+    Buffer& localBuffer();
+    void writeAll(const char* data, size_t size);
+
+    int fd_;
+    OutputFormat format_;
+    size_t bufferSize_;
+    std::uint64_t id_;
+    std::atomic<size_t> written_{0};
+
+    std::mutex mutex_;  // guards buffers_ registration and the descriptor
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+} // namespace vinci
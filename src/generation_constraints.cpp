@@ -0,0 +1,28 @@
+#include "generation_constraints.h"
+#include <vector>
+
+namespace vinci {
+
+bool GenerationConstraints::admits(const Tree& tree) const {
+    if (tree.getLeafCount() < minLeaves) {
+        return false;
+    }
+
+    // children[d]: children so far of the open node at depth d
+    std::span<const Tree::Level> levels = tree.getLevels();
+    std::vector<size_t> children(1, 0);
+    for (size_t i = 1; i < levels.size(); ++i) {
+        size_t depth = levels[i];
+        if (depth > maxDepth) {
+            return false;
+        }
+        children.resize(depth + 1);
+        if (++children[depth - 1] > maxChildren) {
+            return false;
+        }
+        children[depth] = 0;
+    }
+    return true;
+}
+
+} // namespace vinci
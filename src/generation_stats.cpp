@@ -0,0 +1,66 @@
+#include "generation_stats.h"
+#include <format>
+
+namespace vinci {
+
+namespace {
+    double toMs(GenerationStats::Duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+}
+
+GenerationStats& GenerationStats::operator+=(const GenerationStats& other) {
+    trees += other.trees;
+    partitionEnumeration += other.partitionEnumeration;
+    childOptions += other.childOptions;
+    combinations += other.combinations;
+    callback += other.callback;
+    rootPartitions += other.rootPartitions;
+    candidates += other.candidates;
+    leafPrunedOptions += other.leafPrunedOptions;
+    infeasiblePartitions += other.infeasiblePartitions;
+    dedupHits += other.dedupHits;
+    cacheHits += other.cacheHits;
+    cacheFiltered += other.cacheFiltered;
+    cacheFileLoads += other.cacheFileLoads;
+    cacheMisses += other.cacheMisses;
+    return *this;
+}
+
+std::string GenerationStats::toText() const {
+    std::string out;
+    out += std::format("Trees: {} on {} thread(s) in {:.3f} ms\n", trees, threads, toMs(elapsed));
+    out += "Phases (ms, exclusive, summed over threads):\n";
+    out += std::format("  prewarm (wall, inclusive)  {:>12.3f}\n", toMs(prewarm));
+    out += std::format("  partition enumeration      {:>12.3f}\n", toMs(partitionEnumeration));
+    out += std::format("  child options              {:>12.3f}\n", toMs(childOptions));
+    out += std::format("  combinations               {:>12.3f}\n", toMs(combinations));
+    out += std::format("  callback                   {:>12.3f}\n", toMs(callback));
+    out += "Counters:\n";
+    out += std::format("  root partitions            {:>12}\n", rootPartitions);
+    out += std::format("  candidates                 {:>12}\n", candidates);
+    out += std::format("  leaf-pruned options        {:>12}\n", leafPrunedOptions);
+    out += std::format("  infeasible partitions      {:>12}\n", infeasiblePartitions);
+    out += std::format("  dedup hits                 {:>12}\n", dedupHits);
+    out += std::format("  cache hits                 {:>12}\n", cacheHits);
+    out += std::format("  cache filtered             {:>12}\n", cacheFiltered);
+    out += std::format("  cache file loads           {:>12}\n", cacheFileLoads);
+    out += std::format("  cache misses               {:>12}\n", cacheMisses);
+    return out;
+}
+
+std::string GenerationStats::toJson() const {
+    return std::format(
+        "{{\"trees\":{},\"threads\":{},\"elapsed_ms\":{:.3f},"
+        "\"phases_ms\":{{\"prewarm\":{:.3f},\"partition_enumeration\":{:.3f},\"child_options\":{:.3f},"
+        "\"combinations\":{:.3f},\"callback\":{:.3f}}},"
+        "\"counters\":{{\"root_partitions\":{},\"candidates\":{},\"leaf_pruned_options\":{},"
+        "\"infeasible_partitions\":{},\"dedup_hits\":{},\"cache_hits\":{},\"cache_filtered\":{},"
+        "\"cache_file_loads\":{},\"cache_misses\":{}}}}}",
+        trees, threads, toMs(elapsed),
+        toMs(prewarm), toMs(partitionEnumeration), toMs(childOptions), toMs(combinations), toMs(callback),
+        rootPartitions, candidates, leafPrunedOptions, infeasiblePartitions, dedupHits,
+        cacheHits, cacheFiltered, cacheFileLoads, cacheMisses);
+}
+
+} // namespace vinci
@@ -1,8 +1,17 @@
 #include "tree_generator.h"
+#include "tree_sink.h"
+#include "tree_sampler.h"
 #include <iostream>
 #include <chrono>
 #include <format>
 #include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <memory>
+#include <limits>
+#include <optional>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace vinci;
 
@@ -10,15 +19,48 @@ int main(int argc, char* argv[]) {
     bool verbose = true;
 
     if (argc < 3) {
-        std::cout << "Usage: " << argv[0] << " <N> <M> [--quiet]\n\n";
+        std::cout << "Usage: " << argv[0] << " <N> <M> [--quiet] [--count] [--engine=<auto|memoized|levels|exact>] [--threads=<T>] [--pin]\n"
+                  << "       [--format=<text|levels|parens>] [--output=<file>] [--cache-file=<file>] [--shard=<i>/<k>]\n"
+                  << "       [--start=<i>] [--length=<L>] [--sample=<S>] [--seed=<s>]\n"
+                  << "       [--max-depth=<D>] [--max-children=<C>] [--min-leaves=<L>] [--memory-budget=<B>]\n"
+                  << "       [--stats[=json]] [--progress]\n\n";
         std::cout << "Generate all non-equivalent trees with N nodes and at most M leaves.\n\n";
         std::cout << "Arguments:\n";
         std::cout << "  N         Number of nodes in the tree\n";
         std::cout << "  M         Maximum number of leaf nodes allowed\n";
-        std::cout << "  --quiet   Optional: suppress tree output, show only summary\n\n";
+        std::cout << "  --quiet   Optional: suppress tree output, show only summary\n";
+        std::cout << "  --count   Optional: only count the trees (no generation, no N limit)\n";
+        std::cout << "  --engine  Optional: generation back end (default: auto)\n";
+        std::cout << "  --threads Optional: worker threads (default: all hardware threads)\n";
+        std::cout << "  --pin     Optional: pin each worker thread to its own CPU\n";
+        std::cout << "  --format  Optional: write every tree in this format instead of printing it\n";
+        std::cout << "  --output  Optional: file for --format output (default: stdout)\n";
+        std::cout << "  --cache-file Optional: reuse pre-warmed subtrees across runs via this file\n";
+        std::cout << "  --shard   Optional: generate only shard i of k (0-based; memoized engine);\n"
+                  << "            check the shard outputs with tree_merge\n";
+        std::cout << "  --start   Optional: first tree to generate, by position in rank order (0-based)\n";
+        std::cout << "  --length  Optional: number of trees to generate from --start (default: all)\n";
+        std::cout << "  --sample  Optional: draw S uniformly random trees instead (no N limit)\n";
+        std::cout << "  --seed    Optional: seed for --sample (default: 0); output depends only on it\n";
+        std::cout << "  --max-depth, --max-children, --min-leaves\n"
+                  << "            Optional: only trees within these limits, pruned during generation\n"
+                  << "            (depth in edges, children of any node, leaves of the tree)\n";
+        std::cout << "  --memory-budget Optional: bytes a run may use, with K, M or G suffix\n"
+                  << "            (default: available memory); threads and buffers are sized to fit\n";
+        std::cout << "  --stats   Optional: report phase timers and counters after the run (text or json)\n";
+        std::cout << "  --progress Optional: live trees/s and partition progress on stderr\n\n";
         std::cout << "Examples:\n";
         std::cout << "  " << argv[0] << " 8 5\n";
         std::cout << "  " << argv[0] << " 30 3 --quiet\n";
+        std::cout << "  " << argv[0] << " 20 50 --quiet --engine=levels\n";
+        std::cout << "  " << argv[0] << " 22 8 --quiet --threads=96 --pin\n";
+        std::cout << "  " << argv[0] << " 24 8 --quiet --engine=memoized --memory-budget=4G\n";
+        std::cout << "  " << argv[0] << " 60 8 --count\n";
+        std::cout << "  " << argv[0] << " 20 10 --format=parens --output=trees.bin\n";
+        std::cout << "  " << argv[0] << " 28 8 --shard=3/16 --format=parens --output=shard3.bin\n";
+        std::cout << "  " << argv[0] << " 24 8 --start=40000000 --length=1000000 --quiet\n";
+        std::cout << "  " << argv[0] << " 40 40 --max-depth=3 --max-children=3\n";
+        std::cout << "  " << argv[0] << " 200 6 --sample=100000 --seed=7 --format=levels --output=sample.bin\n";
         return 1;
     }
 
@@ -26,58 +68,311 @@ int main(int argc, char* argv[]) {
     size_t n = std::stoull(argv[1]);
     size_t m = std::stoull(argv[2]);
 
-    if (argc >= 4 && std::string(argv[3]) == "--quiet") {
-        verbose = false;
+    TreeGenerator generator;
+    bool countOnly = false;
+    std::optional<OutputFormat> format;
+    std::string outputPath;
+    bool engineChosen = false;
+    std::optional<bool> statsJson;
+    bool progress = false;
+    std::optional<TreeCount> sliceStart;
+    std::optional<TreeCount> sliceLength;
+    std::optional<size_t> sampleCount;
+    std::uint64_t seed = 0;
+    GenerationConstraints constraints;
+
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quiet") {
+            verbose = false;
+        } else if (arg == "--count") {
+            countOnly = true;
+        } else if (arg == "--engine=auto") {
+            generator.setEngine(TreeGenerator::Engine::Auto);
+        } else if (arg == "--engine=memoized") {
+            generator.setEngine(TreeGenerator::Engine::Memoized);
+        } else if (arg == "--engine=levels") {
+            generator.setEngine(TreeGenerator::Engine::LevelSequence);
+            engineChosen = true;
+        } else if (arg == "--engine=exact") {
+            generator.setEngine(TreeGenerator::Engine::ExactLeaves);
+            engineChosen = true;
+        } else if (arg.starts_with("--threads=")) {
+            try {
+                generator.setThreadCount(std::stoull(arg.substr(10)));
+            } catch (const std::exception&) {
+                std::cerr << std::format("Invalid thread count: {}\n", arg.substr(10));
+                return 1;
+            }
+        } else if (arg == "--pin") {
+            generator.setCpuAffinity(true);
+        } else if (arg.starts_with("--format=")) {
+            format = TreeSink::parseFormat(arg.substr(9));
+            if (!format) {
+                std::cerr << std::format("Unknown output format: {}\n", arg.substr(9));
+                return 1;
+            }
+        } else if (arg.starts_with("--output=")) {
+            outputPath = arg.substr(9);
+        } else if (arg.starts_with("--cache-file=")) {
+            generator.setCacheFile(arg.substr(13));
+        } else if (arg.starts_with("--shard=")) {
+            std::string spec = arg.substr(8);
+            size_t slash = spec.find('/');
+            try {
+                if (slash == std::string::npos) {
+                    throw std::invalid_argument("missing '/'");
+                }
+                generator.setShard(std::stoull(spec.substr(0, slash)), std::stoull(spec.substr(slash + 1)));
+            } catch (const std::exception&) {
+                std::cerr << std::format("Invalid shard: {} (expected i/k with i < k)\n", spec);
+                return 1;
+            }
+        } else if (arg.starts_with("--start=") || arg.starts_with("--length=")) {
+            bool isStart = arg.starts_with("--start=");
+            std::string value = arg.substr(isStart ? 8 : 9);
+            try {
+                (isStart ? sliceStart : sliceLength) = std::stoull(value);
+            } catch (const std::exception&) {
+                std::cerr << std::format("Invalid {}: {}\n", isStart ? "start" : "length", value);
+                return 1;
+            }
+        } else if (arg.starts_with("--sample=") || arg.starts_with("--seed=")) {
+            bool isSample = arg.starts_with("--sample=");
+            std::string value = arg.substr(isSample ? 9 : 7);
+            try {
+                if (isSample) {
+                    sampleCount = std::stoull(value);
+                } else {
+                    seed = std::stoull(value);
+                }
+            } catch (const std::exception&) {
+                std::cerr << std::format("Invalid {}: {}\n", isSample ? "sample count" : "seed", value);
+                return 1;
+            }
+        } else if (arg.starts_with("--max-depth=") || arg.starts_with("--max-children=") ||
+                   arg.starts_with("--min-leaves=")) {
+            size_t eq = arg.find('=');
+            std::string name = arg.substr(2, eq - 2);
+            size_t& limit = name == "max-depth" ? constraints.maxDepth
+                          : name == "max-children" ? constraints.maxChildren
+                          : constraints.minLeaves;
+            try {
+                limit = std::stoull(arg.substr(eq + 1));
+            } catch (const std::exception&) {
+                std::cerr << std::format("Invalid {}: {}\n", name, arg.substr(eq + 1));
+                return 1;
+            }
+        } else if (arg.starts_with("--memory-budget=")) {
+            std::string value = arg.substr(16);
+            try {
+                size_t digits = 0;
+                size_t bytes = std::stoull(value, &digits);
+                std::string suffix = value.substr(digits);
+                int shift = suffix.empty() ? 0 : suffix == "K" ? 10 : suffix == "M" ? 20 : suffix == "G" ? 30 : -1;
+                if (shift < 0 || bytes == 0 || bytes > (std::numeric_limits<size_t>::max() >> shift)) {
+                    throw std::invalid_argument(suffix);
+                }
+                generator.setMemoryBudget(bytes << shift);
+            } catch (const std::exception&) {
+                std::cerr << std::format("Invalid memory budget: {} (expected bytes with optional K, M or G)\n",
+                                         value);
+                return 1;
+            }
+        } else if (arg == "--stats" || arg == "--stats=text") {
+            statsJson = false;
+        } else if (arg == "--stats=json") {
+            statsJson = true;
+        } else if (arg == "--progress") {
+            progress = true;
+        } else {
+            std::cerr << std::format("Unknown option: {}\n", arg);
+            return 1;
+        }
     }
 
-    std::cout << "Generating all trees with N=" << n << " nodes and M≤" << m << " leaves\n";
-    std::cout << std::string(60, '=') << "\n\n";
+    if (engineChosen && generator.getShardCount() > 1) {
+        std::cerr << "Error: --shard splits root partitions and needs the memoized engine\n";
+        return 1;
+    }
+
+    bool sliced = sliceStart || sliceLength;
+    if (sliced && generator.getShardCount() > 1) {
+        std::cerr << "Error: --start/--length and --shard are separate ways to split a run\n";
+        return 1;
+    }
+
+    if (constraints.any() && (sliced || sampleCount || generator.getShardCount() > 1)) {
+        std::cerr << "Error: structural limits do not combine with --start/--length, --sample or --shard\n";
+        return 1;
+    }
+    generator.setConstraints(constraints);
+
+    if (sampleCount && (sliced || generator.getShardCount() > 1)) {
+        std::cerr << "Error: --sample draws random trees and cannot be sliced or sharded\n";
+        return 1;
+    }
+
+    // Flags that only shape the cache-based engines are ignored by the run
+    // the others resolve to; say so instead of silently dropping them
+    if (!countOnly && !sampleCount && !sliced) {
+        TreeGenerator::Engine resolved = generator.resolvedEngine(n, false, true);
+        auto ignored = [&](bool given, const char* flag, const char* reason) {
+            if (given) {
+                std::cerr << std::format("Warning: {} has no effect: {}\n", flag, reason);
+            }
+        };
+        if (resolved == TreeGenerator::Engine::LevelSequence) {
+            const char* reason = "the run uses the single-threaded level sequence enumerator "
+                                 "(pass --threads=<T> with T > 1 or --engine=memoized for a parallel run)";
+            ignored(generator.getThreadCount() > 1, "--threads", reason);
+            ignored(generator.getCpuAffinity(), "--pin", reason);
+            ignored(generator.getMemoryBudget() != 0, "--memory-budget", reason);
+        }
+        if (resolved != TreeGenerator::Engine::Memoized) {
+            ignored(!generator.getCacheFile().empty(), "--cache-file",
+                    "only the memoized engine loads and saves the subtree cache");
+        }
+    }
+
+    if (countOnly) {
+        std::cout << "Counting all trees with N=" << n << " nodes and M≤" << m << " leaves\n";
+        std::cout << std::string(60, '=') << "\n";
+
+        auto start = std::chrono::high_resolution_clock::now();
+        TreeCount total;
+        try {
+            total = TreeGenerator::count(n, m);
+        } catch (const std::overflow_error& e) {
+            std::cerr << std::format("Error: {}\n", e.what());
+            return 1;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+        std::cout << std::format("Total trees: {}\n", countToString(total));
+        std::cout << std::format("Time taken: {:.3f} ms\n", duration.count() / 1000.0);
+        return 0;
+    }
+
+    // With a sink, stdout may carry tree data, so status text moves to stderr
+    if (!outputPath.empty() && !format) {
+        format = OutputFormat::Text;
+    }
+    int outputFd = STDOUT_FILENO;
+    if (!outputPath.empty()) {
+        outputFd = ::open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (outputFd < 0) {
+            std::cerr << std::format("Error: cannot open {}\n", outputPath);
+            return 1;
+        }
+    }
+    std::ostream& info = (format && outputPath.empty()) ? std::cerr : std::cout;
+    std::unique_ptr<TreeSink> sink;
+    if (format) {
+        sink = std::make_unique<TreeSink>(outputFd, *format);
+    }
+
+    std::unique_ptr<TreeSampler> sampler;
+    if (sampleCount) {
+        try {
+            sampler = std::make_unique<TreeSampler>(n, m);
+        } catch (const std::overflow_error& e) {
+            std::cerr << std::format("Error: {}\n", e.what());
+            return 1;
+        }
+        info << "Sampling " << *sampleCount << " uniform trees with N=" << n << " nodes and M≤" << m
+             << " leaves (seed " << seed << ")\n";
+    } else {
+        info << "Generating all trees with N=" << n << " nodes and M≤" << m << " leaves\n";
+    }
+    if (generator.getShardCount() > 1) {
+        info << std::format("Shard {} of {} (0-based)\n", generator.getShardIndex(), generator.getShardCount());
+    }
+    if (sliced) {
+        info << std::format("Trees from position {}", countToString(sliceStart.value_or(0)));
+        if (sliceLength) {
+            info << std::format(", at most {}", countToString(*sliceLength));
+        }
+        info << " (rank order)\n";
+    }
+    info << std::string(60, '=') << "\n\n";
+
+    generator.setStatsEnabled(statsJson.has_value());
+    if (progress) {
+        generator.setProgressInterval(std::chrono::milliseconds(500));
+    }
 
-    TreeGenerator generator;
     std::atomic<size_t> count{0};
 
     auto start = std::chrono::high_resolution_clock::now();
 
     // Callback to print each tree as it's generated
-    auto callback = [&count, verbose](const Tree& tree) {
+    auto callback = [&count, &info, verbose, progress, &sink](const Tree& tree) {
         size_t current = ++count;
-        if (verbose) {
+        if (sink) {
+            sink->write(tree);
+        } else if (verbose) {
             std::cout << std::format("Tree #{}:\n", current);
             std::cout << std::format("  Representation: {}\n", tree.toString());
             std::cout << std::format("  Nodes: {}, Leaves: {}\n",
                                     tree.getNodeCount(), tree.getLeafCount());
             tree.print(std::cout, "  ");
             std::cout << "\n";
-        } else {
+        } else if (!progress) {
             // Print progress every 1000 trees (overwrite same line)
             if (current % 1000 == 0) {
-                std::cout << std::format("\rGenerated {} trees so far...", current) << std::flush;
+                info << std::format("\rGenerated {} trees so far...", current) << std::flush;
             }
         }
     };
 
-    size_t total = generator.generate(n, m, callback, true);
+    size_t total;
+    try {
+        if (sampler) {
+            total = sampler->sample(*sampleCount, seed, callback, generator.getThreadCount());
+        } else if (sliced) {
+            total = generator.generate(n, m, sliceStart.value_or(0), sliceLength.value_or(~TreeCount(0)), callback);
+        } else {
+            total = generator.generate(n, m, callback, true);
+        }
+        if (sink) {
+            sink->flush();
+        }
+    } catch (const std::system_error& e) {
+        std::cerr << std::format("Error: {}\n", e.what());
+        return 1;
+    }
+    if (outputFd != STDOUT_FILENO) {
+        ::close(outputFd);
+    }
 
     // Clear the progress line if we were in quiet mode
-    if (!verbose) {
-        std::cout << "\r" << std::string(60, ' ') << "\r" << std::flush;
+    if (!verbose && !sink && !progress) {
+        info << "\r" << std::string(60, ' ') << "\r" << std::flush;
     }
 
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
 
-    std::cout << std::string(60, '=') << "\n";
-    std::cout << std::format("Total trees generated: {}\n", total);
-    std::cout << std::format("Time taken: {} ms", duration.count());
+    info << std::string(60, '=') << "\n";
+    info << std::format("Total trees generated: {}\n", total);
+    info << std::format("Time taken: {} ms", duration.count());
 
     if (duration.count() >= 1000) {
-        std::cout << std::format(" ({:.2f} seconds)", duration.count() / 1000.0);
+        info << std::format(" ({:.2f} seconds)", duration.count() / 1000.0);
     }
-    std::cout << "\n";
+    info << "\n";
 
     if (total > 0) {
         double avgTime = static_cast<double>(duration.count()) / total;
-        std::cout << std::format("Average time per tree: {:.6f} ms\n", avgTime);
+        info << std::format("Average time per tree: {:.6f} ms\n", avgTime);
+    }
+
+    if (statsJson) {
+        const GenerationStats& stats = generator.getStats();
+        info << std::string(60, '=') << "\n";
+        info << (*statsJson ? stats.toJson() + "\n" : stats.toText());
     }
 
     return 0;
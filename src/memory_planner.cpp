@@ -0,0 +1,273 @@
+#include "memory_planner.h"
+#include "tree.h"
+#include "tree_generator.h"
+#include <algorithm>
+#include <cstddef>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#ifdef __linux__
+#include <sys/sysinfo.h>
+#elif __APPLE__
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#include <mach/mach.h>
+#include <mach/vm_statistics.h>
+#include <mach/mach_types.h>
+#include <mach/mach_init.h>
+#include <mach/mach_host.h>
+#elif _WIN32
+#include <windows.h>
+#include <sysinfoapi.h>
+#endif
+
+namespace vinci {
+
+namespace {
+    constexpr size_t kUnbounded = std::numeric_limits<size_t>::max();
+
+    // Streaming queue slots per worker
+    constexpr size_t kQueueTrees = TreeGenerator::kStreamQueueDepth;
+
+    // Pointer to a tree in a cell or child option list
+    constexpr size_t kPointerBytes = sizeof(const Tree*);
+
+    // Hash-set node and bucket of an interned tree
+    constexpr size_t kInternBytes = 4 * sizeof(void*);
+
+    size_t saturatingAdd(size_t a, size_t b) {
+        size_t sum;
+        return __builtin_add_overflow(a, b, &sum) ? kUnbounded : sum;
+    }
+
+    size_t saturatingMul(size_t a, size_t b) {
+        size_t product;
+        return __builtin_mul_overflow(a, b, &product) ? kUnbounded : product;
+    }
+
+    size_t toSize(TreeCount count) {
+        return count > kUnbounded ? kUnbounded : static_cast<size_t>(count);
+    }
+
+#ifdef __linux__
+    // First number in a file, or nullopt if it is missing or not a number ("max")
+    std::optional<size_t> readNumber(const char* path) {
+        std::ifstream in(path);
+        size_t value;
+        if (in >> value) {
+            return value;
+        }
+        return std::nullopt;
+    }
+
+    // "MemAvailable" from /proc/meminfo, in bytes
+    std::optional<size_t> memAvailable() {
+        std::ifstream in("/proc/meminfo");
+        std::string key;
+        size_t kib;
+        std::string unit;
+        while (in >> key >> kib >> unit) {
+            if (key == "MemAvailable:") {
+                return kib * 1024;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Room left under the cgroup memory limit (v2, then v1)
+    std::optional<size_t> cgroupRoom() {
+        auto limit = readNumber("/sys/fs/cgroup/memory.max");
+        auto usage = readNumber("/sys/fs/cgroup/memory.current");
+        if (!limit) {
+            limit = readNumber("/sys/fs/cgroup/memory/memory.limit_in_bytes");
+            usage = readNumber("/sys/fs/cgroup/memory/memory.usage_in_bytes");
+        }
+        if (!limit) {
+            return std::nullopt;
+        }
+        size_t used = usage.value_or(0);
+        return *limit > used ? *limit - used : 0;
+    }
+#endif
+}
+
+size_t MemoryPlan::peakBytes() const {
+    return saturatingAdd(saturatingAdd(cacheBytes, saturatingMul(threads, workerBytes)), batchBytes);
+}
+
+std::string MemoryPlan::toText() const {
+    constexpr double kMiB = 1024.0 * 1024.0;
+    return std::format("predicted peak {:.1f} MiB (cache {:.1f}, {} worker(s) x {:.1f}, batch {:.1f}){}",
+                       peakBytes() / kMiB, cacheBytes / kMiB, threads, workerBytes / kMiB, batchBytes / kMiB,
+                       fits ? "" : ", over budget");
+}
+
+MemoryPlanner::MemoryPlanner(size_t n, size_t m) : n_(n), m_(std::min(m, n)) {
+    try {
+        counter_.emplace(n_, m_);
+    } catch (const std::overflow_error&) {
+        counter_.reset();
+    }
+}
+
+size_t MemoryPlanner::treeBytes(size_t nodes) {
+    size_t bytes = sizeof(Tree);
+    if (nodes > Tree::kInlineCapacity) {
+        bytes += alignof(std::max_align_t) + nodes * sizeof(Tree::Level);
+    }
+    return bytes;
+}
+
+size_t MemoryPlanner::availableMemory() {
+#ifdef __linux__
+    std::optional<size_t> available = memAvailable();
+    if (!available) {
+        struct sysinfo memInfo;
+        if (sysinfo(&memInfo) == 0) {
+            available = static_cast<size_t>(memInfo.freeram + memInfo.bufferram) * memInfo.mem_unit;
+        }
+    }
+    if (auto room = cgroupRoom()) {
+        available = std::min(available.value_or(kUnbounded), *room);
+    }
+    return available.value_or(0);
+#elif __APPLE__
+    vm_size_t page_size;
+    mach_port_t mach_port;
+    mach_msg_type_number_t count;
+    vm_statistics64_data_t vm_stats;
+
+    mach_port = mach_host_self();
+    count = sizeof(vm_stats) / sizeof(natural_t);
+    if (host_page_size(mach_port, &page_size) == KERN_SUCCESS &&
+        host_statistics64(mach_port, HOST_VM_INFO, (host_info64_t)&vm_stats, &count) == KERN_SUCCESS) {
+        return (vm_stats.free_count + vm_stats.inactive_count) * page_size;
+    }
+    return 0;
+#elif _WIN32
+    MEMORYSTATUSEX memInfo;
+    memInfo.dwLength = sizeof(MEMORYSTATUSEX);
+    if (GlobalMemoryStatusEx(&memInfo)) {
+        return memInfo.ullAvailPhys;
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+size_t MemoryPlanner::atMost(size_t nodes, size_t leaves) const {
+    return toSize(counter_->atMost(nodes, std::min(leaves, m_)));
+}
+
+size_t MemoryPlanner::exact(size_t nodes, size_t leaves) const {
+    return toSize(counter_->exact(nodes, leaves));
+}
+
+size_t MemoryPlanner::levelBytes(size_t nodes) const {
+    if (!counter_) {
+        return kUnbounded;
+    }
+    if (nodes == 0 || nodes > n_) {
+        return 0;
+    }
+    // Every distinct subtree is interned once; each cell (nodes, limit) a run
+    // reads holds one pointer per tree within its limit
+    size_t bytes = saturatingMul(atMost(nodes, m_), treeBytes(nodes) + kInternBytes);
+    for (size_t limit = 1; limit <= std::min(m_, nodes); ++limit) {
+        bytes = saturatingAdd(bytes, saturatingMul(atMost(nodes, limit), kPointerBytes));
+    }
+    return bytes;
+}
+
+MemoryPlan MemoryPlanner::memoized(size_t threads, size_t budget) const {
+    MemoryPlan plan;
+    if (!counter_) {
+        plan.fits = false;
+        return plan;
+    }
+
+    for (size_t j = 1; j < n_; ++j) {
+        plan.cacheBytes = saturatingAdd(plan.cacheBytes, levelBytes(j));
+    }
+    // A cell is built as a vector of trees, which may have grown to twice
+    // its size, before it is interned; the largest is the one below n
+    if (n_ > 1) {
+        plan.cacheBytes = saturatingAdd(plan.cacheBytes,
+                                        saturatingMul(2 * atMost(n_ - 1, m_), treeBytes(n_ - 1)));
+    }
+
+    // A worker holds its queue, its flush buffer and the child options of its
+    // partition, which never list more than the trees of the largest part
+    size_t rootTree = treeBytes(n_);
+    size_t options = n_ > 1 ? saturatingMul(2 * kPointerBytes, atMost(n_ - 1, m_)) : 0;
+    auto workerBytes = [&](size_t flushTrees) {
+        return saturatingAdd(saturatingMul(kQueueTrees + flushTrees, rootTree), options);
+    };
+    // The calling thread drains the queues one batch at a time
+    plan.batchBytes = saturatingMul(kQueueTrees, rootTree);
+
+    threads = std::max(threads, size_t(1));
+    size_t fixed = saturatingAdd(plan.cacheBytes, plan.batchBytes);
+    size_t room = budget > fixed ? budget - fixed : 0;
+    size_t minimum = workerBytes(kMinFlushTrees);
+    plan.threads = std::min(threads, room / std::max(minimum, size_t(1)));
+    if (plan.threads == 0) {
+        plan.threads = 1;
+        plan.fits = false;
+        plan.flushTrees = kMinFlushTrees;
+        plan.workerBytes = minimum;
+    } else {
+        // Whatever room is left lets each worker buffer more before handing over
+        size_t perWorker = room / plan.threads;
+        size_t spare = perWorker - minimum;
+        plan.flushTrees = std::min(kMaxFlushTrees, kMinFlushTrees + spare / rootTree);
+        plan.workerBytes = workerBytes(plan.flushTrees);
+    }
+
+    // Pre-warming builds cells on one thread before the workers start, so it
+    // takes the smallest levels up to one worker's share of the cache, and
+    // no more than the budget leaves once the workers and batch are paid for.
+    // Levels above n/2 stay with the workers: they feed few root partitions.
+    size_t used = saturatingAdd(plan.batchBytes, saturatingMul(plan.threads, plan.workerBytes));
+    size_t prewarmRoom = std::min(plan.cacheBytes / plan.threads, budget > used ? budget - used : 0);
+    size_t cumulative = 0;
+    for (size_t j = 1; j <= n_ / 2; ++j) {
+        cumulative = saturatingAdd(cumulative, levelBytes(j));
+        if (cumulative > prewarmRoom) {
+            break;
+        }
+        plan.prewarmDepth = j;
+    }
+    return plan;
+}
+
+MemoryPlan MemoryPlanner::exactLeaves(size_t budget) const {
+    MemoryPlan plan;
+    if (!counter_) {
+        plan.fits = false;
+        return plan;
+    }
+
+    // Cells below n keep every tree once (no dedup index) and a pointer to it
+    for (size_t j = 1; j < n_; ++j) {
+        for (size_t k = 1; k <= std::min(m_, j); ++k) {
+            plan.cacheBytes = saturatingAdd(plan.cacheBytes,
+                                            saturatingMul(exact(j, k), treeBytes(j) + kPointerBytes));
+        }
+    }
+
+    // One leaf count of the n-node trees at a time, in a vector that may
+    // have grown to twice its size
+    size_t largest = 0;
+    for (size_t k = 1; k <= m_; ++k) {
+        largest = std::max(largest, exact(n_, k));
+    }
+    plan.batchBytes = saturatingMul(2 * largest, treeBytes(n_));
+    plan.fits = plan.peakBytes() <= budget;
+    return plan;
+}
+
+} // namespace vinci
@@ -0,0 +1,71 @@
+#include "partition_table.h"
+#include <algorithm>
+
+namespace vinci {
+
+PartitionIterator::PartitionIterator(size_t n, size_t maxParts) : maxParts_(maxParts) {
+    // n = 0 has exactly one partition, the empty one
+    if (n == 0) {
+        return;
+    }
+    if (maxParts == 0) {
+        valid_ = false;
+        return;
+    }
+    parts_.resize(std::min(n, maxParts));
+    fill(0, n, n);
+}
+
+void PartitionIterator::fill(size_t from, size_t rest, size_t cap) {
+    size_t i = from;
+    while (rest > 0) {
+        size_t part = std::min(cap, rest);
+        parts_[i++] = part;
+        rest -= part;
+    }
+    size_ = i;
+}
+
+void PartitionIterator::next() {
+    // rest = sum of parts_[j..size_)
+    size_t rest = 0;
+    for (size_t j = size_; j-- > 0;) {
+        rest += parts_[j];
+        if (parts_[j] == 1) {
+            continue;
+        }
+
+        // Lowering parts_[j] by one is the smallest step down; it is possible
+        // only if the remainder fits in the parts still free
+        size_t cap = parts_[j] - 1;
+        size_t remainder = rest - cap;
+        size_t needed = (remainder + cap - 1) / cap;
+        if (needed <= maxParts_ - j - 1) {
+            parts_[j] = cap;
+            fill(j + 1, remainder, cap);
+            return;
+        }
+    }
+    valid_ = false;
+}
+
+void PartitionTable::grow(size_t maxN) {
+    for (size_t n = rows_.size(); n <= maxN; ++n) {
+        rows_.push_back(std::make_unique<Slot[]>(n + 1));
+    }
+}
+
+const PartitionTable::List& PartitionTable::get(size_t n, size_t k) {
+    Slot& slot = rows_[n][std::min(k, n)];
+    std::call_once(slot.once, [&slot, n, k] {
+        List& list = slot.list;
+        for (PartitionIterator it(n, k); it.valid(); it.next()) {
+            Partition partition = it.current();
+            list.parts_.insert(list.parts_.end(), partition.begin(), partition.end());
+            list.offsets_.push_back(static_cast<std::uint32_t>(list.parts_.size()));
+        }
+    });
+    return slot.list;
+}
+
+} // namespace vinci
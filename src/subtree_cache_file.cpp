@@ -0,0 +1,195 @@
+#include "subtree_cache_file.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vinci {
+
+namespace {
+    constexpr char kMagic[8] = {'V', 'I', 'N', 'C', 'I', 'S', 'T', 'C'};
+    constexpr std::uint32_t kVersion = 1;
+    constexpr std::uint32_t kByteOrderMark = 0x01020304;
+
+    // Largest table open() accepts; pre-warm ranges stay far below it, and
+    // it keeps the index size of a corrupt header from overflowing
+    constexpr size_t kMaxTableNodes = 1024;
+
+    [[noreturn]] void throwErrno(const std::string& what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    void writeAll(int fd, const void* data, size_t size, const std::string& path) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::write(fd, bytes, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throwErrno("SubtreeCacheFile: cannot write " + path);
+            }
+            bytes += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+    // Highest leaf count an n-node tree can have
+    size_t maxLeavesFor(size_t n) {
+        return n <= 1 ? n : n - 1;
+    }
+}
+
+SubtreeCacheFile::~SubtreeCacheFile() {
+    if (mapping_) {
+        ::munmap(mapping_, mappedSize_);
+    }
+}
+
+std::unique_ptr<SubtreeCacheFile> SubtreeCacheFile::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    std::unique_ptr<SubtreeCacheFile> file(new SubtreeCacheFile());
+    file->mapping_ = mapping;
+    file->mappedSize_ = size;
+
+    Header header;
+    std::memcpy(&header, mapping, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion || header.byteOrder != kByteOrderMark) {
+        return nullptr;
+    }
+
+    if (header.maxNodes > kMaxTableNodes || header.maxLeaves > kMaxTableNodes) {
+        return nullptr;
+    }
+    file->maxN_ = header.maxNodes;
+    file->maxLeaves_ = header.maxLeaves;
+    size_t cells = (file->maxN_ + 1) * (file->maxLeaves_ + 1);
+    if ((size - sizeof(Header)) / sizeof(Entry) < cells) {
+        return nullptr;
+    }
+    file->entries_ = reinterpret_cast<const Entry*>(static_cast<const char*>(mapping) + sizeof(Header));
+
+    // Every cell must lie inside the mapping, level-aligned
+    for (size_t n = 0; n <= file->maxN_; ++n) {
+        for (size_t leaves = 0; leaves <= file->maxLeaves_; ++leaves) {
+            const Entry& e = file->entry(n, leaves);
+            std::uint64_t bytes;
+            if (__builtin_mul_overflow(e.count, n * sizeof(Tree::Level), &bytes) ||
+                e.offset % alignof(Tree::Level) != 0 || e.offset > size || bytes > size - e.offset) {
+                return nullptr;
+            }
+        }
+    }
+
+    // Level data is read sequentially cell by cell
+    ::madvise(mapping, size, MADV_WILLNEED);
+    return file;
+}
+
+void SubtreeCacheFile::write(const std::string& path, size_t maxNodes, size_t maxLeaves,
+                             const CellSource& cells) {
+    // Gather the cells first so the index can be written ahead of the data
+    size_t cellCount = (maxNodes + 1) * (maxLeaves + 1);
+    std::vector<std::vector<const Tree*>> contents(cellCount);
+    std::vector<Entry> entries(cellCount, Entry{0, 0});
+    std::uint64_t offset = sizeof(Header) + cellCount * sizeof(Entry);
+    for (size_t n = 1; n <= maxNodes; ++n) {
+        for (size_t leaves = 1; leaves <= std::min(maxLeaves, maxLeavesFor(n)); ++leaves) {
+            size_t index = n * (maxLeaves + 1) + leaves;
+            contents[index] = cells(n, leaves);
+            entries[index] = Entry{offset, contents[index].size()};
+            offset += contents[index].size() * n * sizeof(Tree::Level);
+        }
+    }
+
+    // A unique temporary per writer, so concurrent writers of one path each
+    // rename a complete file into place
+    std::string temporary = path + ".XXXXXX";
+    int fd = ::mkstemp(temporary.data());
+    if (fd < 0) {
+        throwErrno("SubtreeCacheFile: cannot create " + temporary);
+    }
+    ::fchmod(fd, 0644);
+    try {
+        Header header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.byteOrder = kByteOrderMark;
+        header.maxNodes = static_cast<std::uint32_t>(maxNodes);
+        header.maxLeaves = static_cast<std::uint32_t>(maxLeaves);
+        writeAll(fd, &header, sizeof(header), temporary);
+        writeAll(fd, entries.data(), entries.size() * sizeof(Entry), temporary);
+
+        std::vector<Tree::Level> levels;
+        for (const auto& cell : contents) {
+            levels.clear();
+            for (const Tree* tree : cell) {
+                auto seq = tree->getLevels();
+                levels.insert(levels.end(), seq.begin(), seq.end());
+            }
+            writeAll(fd, levels.data(), levels.size() * sizeof(Tree::Level), temporary);
+        }
+    } catch (...) {
+        ::close(fd);
+        std::remove(temporary.c_str());
+        throw;
+    }
+
+    if (::close(fd) != 0 || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        int error = errno;
+        std::remove(temporary.c_str());
+        throw std::system_error(error, std::generic_category(), "SubtreeCacheFile: cannot write " + path);
+    }
+}
+
+bool SubtreeCacheFile::covers(size_t n, size_t m) const {
+    return n >= 1 && n <= maxN_ && std::min(m, maxLeavesFor(n)) <= maxLeaves_;
+}
+
+size_t SubtreeCacheFile::cellSize(size_t n, size_t leaves) const {
+    if (n > maxN_ || leaves > maxLeaves_) {
+        return 0;
+    }
+    return static_cast<size_t>(entry(n, leaves).count);
+}
+
+std::span<const Tree::Level> SubtreeCacheFile::cellLevels(size_t n, size_t leaves) const {
+    size_t count = cellSize(n, leaves);
+    if (count == 0) {
+        return {};
+    }
+    const char* base = static_cast<const char*>(mapping_) + entry(n, leaves).offset;
+    return {reinterpret_cast<const Tree::Level*>(base), count * n};
+}
+
+void SubtreeCacheFile::appendCell(size_t n, size_t leaves, std::vector<Tree>& out) const {
+    auto levels = cellLevels(n, leaves);
+    out.reserve(out.size() + levels.size() / std::max(n, size_t(1)));
+    for (size_t start = 0; start < levels.size(); start += n) {
+        out.push_back(Tree::fromLevelSequence(levels.subspan(start, n)));
+    }
+}
+
+} // namespace vinci
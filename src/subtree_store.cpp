@@ -0,0 +1,72 @@
+#include "subtree_store.h"
+#include <algorithm>
+
+namespace vinci {
+
+void SubtreeStore::reset(size_t maxN, size_t maxLeaves) {
+    maxN_ = maxN;
+    maxLeaves_ = maxLeaves;
+    slots_ = std::make_unique<Slot[]>((maxN + 1) * (maxLeaves + 1));
+    shards_ = std::make_unique<std::array<Shard, kShards>>();
+}
+
+void SubtreeStore::grow(size_t maxN, size_t maxLeaves) {
+    if (maxN <= maxN_ && maxLeaves <= maxLeaves_) {
+        return;
+    }
+    size_t newN = std::max(maxN, maxN_);
+    size_t newLeaves = std::max(maxLeaves, maxLeaves_);
+    auto slots = std::make_unique<Slot[]>((newN + 1) * (newLeaves + 1));
+    for (size_t n = 0; n <= maxN_; ++n) {
+        for (size_t m = 0; m <= maxLeaves_; ++m) {
+            Slot& from = slotAt(n, m);
+            if (from.state.load(std::memory_order_relaxed) == kReady) {
+                Slot& to = slots[n * (newLeaves + 1) + m];
+                to.cell = std::move(from.cell);
+                to.state.store(kReady, std::memory_order_relaxed);
+            }
+        }
+    }
+    slots_ = std::move(slots);
+    maxN_ = newN;
+    maxLeaves_ = newLeaves;
+}
+
+const Tree* SubtreeStore::intern(Tree&& tree) {
+    // High fingerprint bits pick the shard; the shard's hash table uses the low bits
+    Shard& shard = (*shards_)[(tree.getHash() >> 58) % kShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if (interning_ == Interning::Append) {
+        return &shard.trees.emplace_back(std::move(tree));
+    }
+
+    auto it = shard.index.find(&tree);
+    if (it != shard.index.end()) {
+        ++shard.hits;
+        return *it;
+    }
+    const Tree* stored = &shard.trees.emplace_back(std::move(tree));
+    shard.index.insert(stored);
+    return stored;
+}
+
+size_t SubtreeStore::internedCount() const {
+    size_t total = 0;
+    for (auto& shard : *shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.trees.size();
+    }
+    return total;
+}
+
+size_t SubtreeStore::internHits() const {
+    size_t total = 0;
+    for (auto& shard : *shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.hits;
+    }
+    return total;
+}
+
+} // namespace vinci
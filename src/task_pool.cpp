@@ -0,0 +1,194 @@
+#include "task_pool.h"
+#include <algorithm>
+#include <utility>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace vinci {
+
+namespace {
+    // Index of the pool worker running on this thread (SIZE_MAX elsewhere)
+    thread_local size_t currentWorker = SIZE_MAX;
+    thread_local const TaskPool* currentPool = nullptr;
+
+    /**
+     * @brief Pin the calling thread to the index-th CPU of the process's allowed set
+     * Wraps around when there are more workers than CPUs. Best effort: a failure
+     * (or a platform without affinity support) leaves the thread unpinned.
+     */
+    void pinToCpu(size_t index) {
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+            return;
+        }
+        size_t target = index % static_cast<size_t>(CPU_COUNT(&allowed));
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+                cpu_set_t one;
+                CPU_ZERO(&one);
+                CPU_SET(cpu, &one);
+                pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+                return;
+            }
+        }
+#else
+        (void)index;
+#endif
+    }
+}
+
+TaskPool::TaskPool(size_t numThreads, bool pinThreads, WorkerInit init) {
+    numThreads = std::max(numThreads, size_t(1));
+    for (size_t i = 0; i < numThreads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    std::latch started(static_cast<std::ptrdiff_t>(numThreads));
+    threads_.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i) {
+        threads_.emplace_back([this, i, pinThreads, &init, &started](std::stop_token stoken) {
+            run(i, stoken, pinThreads, init, started);
+        });
+    }
+    started.wait();
+}
+
+TaskPool::~TaskPool() {
+    // Never rethrows: a failure nobody waited for dies with the pool
+    if (done_) {
+        done_->wait();
+    }
+    for (auto& thread : threads_) {
+        thread.request_stop();
+    }
+    epoch_.fetch_add(1, std::memory_order_release);
+    epoch_.notify_all();
+    threads_.clear();
+}
+
+void TaskPool::start(std::vector<Task> tasks, std::function<void()> onDone) {
+    onDone_ = std::move(onDone);
+    done_ = std::make_unique<std::latch>(1);
+    failure_ = nullptr;
+    failed_.store(false, std::memory_order_relaxed);
+
+    if (tasks.empty()) {
+        if (onDone_) {
+            onDone_();
+        }
+        done_->count_down();
+        return;
+    }
+
+    // Count the whole batch up front so it cannot look finished part-way through
+    pending_.fetch_add(tasks.size(), std::memory_order_acq_rel);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        push(i % workers_.size(), std::move(tasks[i]));
+    }
+}
+
+void TaskPool::submit(Task task) {
+    pending_.fetch_add(1, std::memory_order_acq_rel);
+    size_t worker = (currentPool == this)
+        ? currentWorker
+        : nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    push(worker, std::move(task));
+}
+
+void TaskPool::wait() {
+    if (done_) {
+        done_->wait();
+    }
+    // The latch orders every task's writes before this read
+    if (std::exception_ptr error = std::exchange(failure_, nullptr)) {
+        std::rethrow_exception(error);
+    }
+}
+
+void TaskPool::push(size_t worker, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(workers_[worker]->mutex);
+        workers_[worker]->tasks.push_back(std::move(task));
+    }
+    epoch_.fetch_add(1, std::memory_order_release);
+    epoch_.notify_all();
+}
+
+bool TaskPool::popOrSteal(size_t worker, Task& task) {
+    {
+        Worker& own = *workers_[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < workers_.size(); ++offset) {
+        Worker& victim = *workers_[(worker + offset) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::finishTask() {
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (onDone_) {
+            onDone_();
+        }
+        done_->count_down();
+    }
+}
+
+void TaskPool::fail(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(failureMutex_);
+    if (!failure_) {
+        failure_ = error;
+        failed_.store(true, std::memory_order_release);
+    }
+}
+
+void TaskPool::run(size_t worker, std::stop_token stoken, bool pin, const WorkerInit& init,
+                   std::latch& started) {
+    currentWorker = worker;
+    currentPool = this;
+    if (pin) {
+        pinToCpu(worker);
+    }
+    if (init) {
+        init(worker);
+    }
+    // `init` and `started` live in the constructor's frame; done with both here
+    started.count_down();
+
+    Task task;
+    while (!stoken.stop_requested()) {
+        std::uint64_t observed = epoch_.load(std::memory_order_acquire);
+        if (popOrSteal(worker, task)) {
+            // Once the batch has failed its remaining tasks are dropped unrun
+            if (!failed_.load(std::memory_order_acquire)) {
+                try {
+                    task(worker);
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+            }
+            task = nullptr;
+            finishTask();
+            continue;
+        }
+        // Nothing to run: sleep until a push (or shutdown) bumps the epoch
+        epoch_.wait(observed, std::memory_order_acquire);
+    }
+}
+
+} // namespace vinci
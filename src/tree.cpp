@@ -1,74 +1,354 @@
 #include "tree.h"
 #include <algorithm>
-#include <sstream>
-#include <ranges>
+#include <cstddef>
+#include <utility>
 
 namespace vinci {
 
-Tree::Tree() : children_() {}
+namespace {
+    using Level = Tree::Level;
 
-Tree::Tree(const std::vector<Tree>& children) : children_(children) {
+    // FNV-1a over 16-bit levels; appending children only extends the hash
+    constexpr std::uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+    constexpr std::uint64_t kHashPrime = 0x100000001b3ULL;
+
+    constexpr std::uint64_t foldLevel(std::uint64_t h, Level level) {
+        return (h ^ level) * kHashPrime;
+    }
+
+    constexpr std::uint64_t kLeafHash = foldLevel(kHashSeed, 0);
+
+    thread_local std::pmr::memory_resource* currentResource = nullptr;
+
+    // Heap blocks start with the owning resource, padded to keep levels aligned
+    constexpr size_t kBlockHeader = alignof(std::max_align_t);
+    static_assert(kBlockHeader >= sizeof(std::pmr::memory_resource*));
+
+    /**
+     * @brief Length of the subtree starting at seq[start]
+     */
+    size_t subtreeLength(const Level* seq, size_t size, size_t start) {
+        size_t end = start + 1;
+        while (end < size && seq[end] > seq[start]) {
+            ++end;
+        }
+        return end - start;
+    }
+
+    /**
+     * @brief Number of leaves in a preorder level sequence
+     */
+    std::uint32_t countLeaves(const Level* seq, size_t size) {
+        std::uint32_t count = 1; // The last node in preorder is always a leaf
+        for (size_t i = 0; i + 1 < size; ++i) {
+            if (seq[i + 1] <= seq[i]) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * @brief Collect (offset, length) of every child of the node at seq[0]
+     */
+    std::vector<std::pair<size_t, size_t>> childRanges(const Level* seq, size_t size) {
+        std::vector<std::pair<size_t, size_t>> ranges;
+        for (size_t i = 1; i < size;) {
+            size_t len = subtreeLength(seq, size, i);
+            ranges.emplace_back(i, len);
+            i += len;
+        }
+        return ranges;
+    }
+
+    using Range = std::pair<std::uint32_t, std::uint32_t>;
+
+    /**
+     * @brief Canonicalize the subtree seq[0..size) in place
+     * Children are ordered by non-increasing level sequence, which makes the
+     * whole sequence the lexicographically largest encoding of its shape.
+     * Child ranges of every level share one stack, so a call allocates nothing
+     * once the thread-local buffers have grown.
+     */
+    void canonicalizeRange(Level* seq, size_t size, std::vector<Range>& stack,
+                           std::vector<Level>& scratch) {
+        if (size <= 2) {
+            return;
+        }
+
+        const size_t base = stack.size();
+        for (size_t i = 1; i < size;) {
+            size_t len = subtreeLength(seq, size, i);
+            stack.emplace_back(static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(len));
+            i += len;
+        }
+        const size_t end = stack.size();
+
+        for (size_t c = base; c < end; ++c) {
+            canonicalizeRange(seq + stack[c].first, stack[c].second, stack, scratch);
+        }
+
+        auto greater = [seq](const Range& a, const Range& b) {
+            return std::lexicographical_compare(seq + b.first, seq + b.first + b.second,
+                                                seq + a.first, seq + a.first + a.second);
+        };
+        auto first = stack.begin() + base;
+        auto last = stack.begin() + end;
+        if (!std::is_sorted(first, last, greater)) {
+            std::stable_sort(first, last, greater);
+
+            scratch.assign(seq, seq + size);
+            size_t pos = 1;
+            for (auto it = first; it != last; ++it) {
+                std::copy_n(scratch.begin() + it->first, it->second, seq + pos);
+                pos += it->second;
+            }
+        }
+        stack.resize(base);
+    }
+
+    void printRange(std::ostream& os, const Level* seq, size_t size,
+                    const std::string& prefix, bool isLast) {
+        os << prefix;
+        os << (isLast ? "└── " : "├── ");
+        os << (size == 1 ? "Leaf" : "Node") << "\n";
+
+        auto ranges = childRanges(seq, size);
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            bool last = (i == ranges.size() - 1);
+            printRange(os, seq + ranges[i].first, ranges[i].second,
+                       prefix + (isLast ? "    " : "│   "), last);
+        }
+    }
+}
+
+Tree::ArenaScope::ArenaScope(std::pmr::memory_resource* resource) : previous_(currentResource) {
+    currentResource = resource;
+}
+
+Tree::ArenaScope::~ArenaScope() {
+    currentResource = previous_;
+}
+
+std::pmr::memory_resource* Tree::heapResource() {
+    return currentResource ? currentResource : std::pmr::new_delete_resource();
+}
+
+Tree::Level* Tree::allocateLevels(size_t capacity) {
+    std::pmr::memory_resource* resource = heapResource();
+    void* block = resource->allocate(kBlockHeader + capacity * sizeof(Level), kBlockHeader);
+    *static_cast<std::pmr::memory_resource**>(block) = resource;
+    return reinterpret_cast<Level*>(static_cast<char*>(block) + kBlockHeader);
+}
+
+void Tree::freeLevels(Level* levels, size_t capacity) {
+    void* block = reinterpret_cast<char*>(levels) - kBlockHeader;
+    std::pmr::memory_resource* resource = *static_cast<std::pmr::memory_resource**>(block);
+    resource->deallocate(block, kBlockHeader + capacity * sizeof(Level), kBlockHeader);
+}
+
+Tree::Tree() : size_(1), capacity_(kInlineCapacity), leaves_(1), hash_(kLeafHash) {
+    inline_[0] = 0;
+}
+
+Tree::Tree(const std::vector<Tree>& children) : Tree(std::span<const Tree>(children)) {}
+
+Tree::Tree(std::span<const Tree> children) : Tree() {
+    size_t total = 1;
+    for (const auto& child : children) {
+        total += child.size_;
+    }
+    reserve(total);
+    for (const auto& child : children) {
+        addChild(child);
+    }
     sortToCanonical();
 }
 
-void Tree::addChild(const Tree& child) {
-    children_.push_back(child);
+Tree::Tree(const Tree& other)
+    : size_(other.size_), capacity_(kInlineCapacity), leaves_(other.leaves_), hash_(other.hash_) {
+    if (other.size_ > kInlineCapacity) {
+        heap_ = allocateLevels(other.size_);
+        capacity_ = other.size_;
+    }
+    std::copy_n(other.data(), size_, data());
 }
 
-size_t Tree::getNodeCount() const {
-    size_t count = 1; // Count this node
-    for (const auto& child : children_) {
-        count += child.getNodeCount();
+Tree::Tree(Tree&& other) noexcept
+    : size_(other.size_), capacity_(other.capacity_), leaves_(other.leaves_), hash_(other.hash_) {
+    if (other.isInline()) {
+        std::copy_n(other.inline_, size_, inline_);
+    } else {
+        heap_ = other.heap_;
+        other.capacity_ = kInlineCapacity;
     }
-    return count;
+    other.size_ = 1;
+    other.leaves_ = 1;
+    other.hash_ = kLeafHash;
+    other.inline_[0] = 0;
 }
 
-size_t Tree::getLeafCount() const {
-    if (children_.empty()) {
-        return 1; // This is a leaf
+Tree& Tree::operator=(const Tree& other) {
+    if (this != &other) {
+        Tree copy(other);
+        *this = std::move(copy);
     }
+    return *this;
+}
 
-    size_t count = 0;
-    for (const auto& child : children_) {
-        count += child.getLeafCount();
+Tree& Tree::operator=(Tree&& other) noexcept {
+    if (this != &other) {
+        if (!isInline()) {
+            freeLevels(heap_, capacity_);
+        }
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        leaves_ = other.leaves_;
+        hash_ = other.hash_;
+        if (other.isInline()) {
+            std::copy_n(other.inline_, size_, inline_);
+        } else {
+            heap_ = other.heap_;
+            other.capacity_ = kInlineCapacity;
+        }
+        other.size_ = 1;
+        other.leaves_ = 1;
+        other.hash_ = kLeafHash;
+        other.inline_[0] = 0;
     }
-    return count;
+    return *this;
 }
 
-void Tree::sortToCanonical() {
-    // Recursively sort all children
-    for (auto& child : children_) {
-        child.sortToCanonical();
+Tree::~Tree() {
+    if (!isInline()) {
+        freeLevels(heap_, capacity_);
     }
+}
 
-    // Sort children by their canonical string representation
-    std::sort(children_.begin(), children_.end());
+Tree Tree::fromLevelSequence(std::span<const Level> levels) {
+    Tree tree;
+    if (levels.empty()) {
+        return tree;
+    }
+    tree.reserve(levels.size());
+    std::copy(levels.begin(), levels.end(), tree.data());
+    tree.size_ = static_cast<std::uint32_t>(levels.size());
+    tree.leaves_ = countLeaves(tree.data(), tree.size_);
+    tree.hash_ = kHashSeed;
+    tree.extendHash(0);
+    return tree;
 }
 
-std::string Tree::toString() const {
-    if (children_.empty()) {
-        return "()";
+Tree Tree::fromCanonicalChildren(std::span<const Tree* const> children) {
+    // Generated child lists are usually in order already; sort a copy only if not
+    thread_local std::vector<const Tree*> ordered;
+    auto greater = [](const Tree* a, const Tree* b) { return *b < *a; };
+    if (!std::is_sorted(children.begin(), children.end(), greater)) {
+        ordered.assign(children.begin(), children.end());
+        std::stable_sort(ordered.begin(), ordered.end(), greater);
+        children = ordered;
     }
 
-    std::ostringstream oss;
-    oss << "(";
-    for (size_t i = 0; i < children_.size(); ++i) {
-        if (i > 0) oss << ",";
-        oss << children_[i].toString();
+    Tree tree;
+    size_t total = 1;
+    for (const Tree* child : children) {
+        total += child->size_;
     }
-    oss << ")";
-    return oss.str();
+    tree.reserve(total);
+    for (const Tree* child : children) {
+        tree.addChild(*child);
+    }
+    return tree;
 }
 
-void Tree::print(std::ostream& os, const std::string& prefix, bool isLast) const {
-    os << prefix;
-    os << (isLast ? "└── " : "├── ");
-    os << (children_.empty() ? "Leaf" : "Node") << "\n";
+void Tree::reserve(size_t capacity) {
+    if (capacity <= capacity_) {
+        return;
+    }
+    size_t newCapacity = std::max(capacity, size_t(capacity_) * 2);
+    Level* buffer = allocateLevels(newCapacity);
+    std::copy_n(data(), size_, buffer);
+    if (!isInline()) {
+        freeLevels(heap_, capacity_);
+    }
+    heap_ = buffer;
+    capacity_ = static_cast<std::uint32_t>(newCapacity);
+}
+
+void Tree::extendHash(size_t from) {
+    const Level* seq = data();
+    std::uint64_t h = hash_;
+    for (size_t i = from; i < size_; ++i) {
+        h = foldLevel(h, seq[i]);
+    }
+    hash_ = h;
+}
+
+void Tree::addChild(const Tree& child) {
+    reserve(size_ + child.size_);
+    Level* out = data() + size_;
+    const Level* in = child.data();
+    for (size_t i = 0; i < child.size_; ++i) {
+        out[i] = static_cast<Level>(in[i] + 1);
+    }
+    // A childless root stops being a leaf once it has a child
+    leaves_ = (size_ == 1 ? 0 : leaves_) + child.leaves_;
+    size_t from = size_;
+    size_ += child.size_;
+    extendHash(from);
+}
+
+std::vector<Tree> Tree::getChildren() const {
+    std::vector<Tree> children;
+    const Level* seq = data();
+    std::vector<Level> shifted;
+    for (const auto& [offset, len] : childRanges(seq, size_)) {
+        shifted.resize(len);
+        for (size_t i = 0; i < len; ++i) {
+            shifted[i] = static_cast<Level>(seq[offset + i] - 1);
+        }
+        children.push_back(fromLevelSequence(shifted));
+    }
+    return children;
+}
+
+void Tree::sortToCanonical() {
+    thread_local std::vector<Range> stack;
+    thread_local std::vector<Level> scratch;
+    canonicalizeRange(data(), size_, stack, scratch);
+    hash_ = kHashSeed;
+    extendHash(0);
+}
 
-    for (size_t i = 0; i < children_.size(); ++i) {
-        bool last = (i == children_.size() - 1);
-        children_[i].print(os, prefix + (isLast ? "    " : "│   "), last);
+std::string Tree::toString() const {
+    const Level* seq = data();
+    std::string out;
+    out.reserve(size_ * 3);
+
+    for (size_t i = 0; i < size_; ++i) {
+        if (i > 0 && seq[i] <= seq[i - 1]) {
+            // Close the previous sibling (and any finished descendants)
+            out.append(seq[i - 1] - seq[i] + 1, ')');
+            out += ',';
+        }
+        out += '(';
     }
+    out.append(seq[size_ - 1] + 1, ')');
+    return out;
+}
+
+std::strong_ordering Tree::operator<=>(const Tree& other) const {
+    return std::lexicographical_compare_three_way(data(), data() + size_,
+                                                  other.data(), other.data() + other.size_);
+}
+
+bool Tree::operator==(const Tree& other) const {
+    return hash_ == other.hash_ && size_ == other.size_ &&
+           std::equal(data(), data() + size_, other.data());
+}
+
+void Tree::print(std::ostream& os, const std::string& prefix, bool isLast) const {
+    printRange(os, data(), size_, prefix, isLast);
 }
 
 } // namespace vinci
@@ -0,0 +1,429 @@
+#include "tree_counter.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <format>
+#include <span>
+#include <tuple>
+
+namespace vinci {
+
+namespace {
+    TreeCount checkedMul(TreeCount a, TreeCount b) {
+        TreeCount result;
+        if (__builtin_mul_overflow(a, b, &result)) {
+            throw std::overflow_error("tree count exceeds 128 bits");
+        }
+        return result;
+    }
+
+    TreeCount checkedAdd(TreeCount a, TreeCount b) {
+        TreeCount result;
+        if (__builtin_add_overflow(a, b, &result)) {
+            throw std::overflow_error("tree count exceeds 128 bits");
+        }
+        return result;
+    }
+
+    TreeCount gcd(TreeCount a, TreeCount b) {
+        while (b != 0) {
+            TreeCount t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    /**
+     * @brief Advance a multiset coefficient: C(t+j-2, j-1) -> C(t+j-1, j)
+     * Divides before multiplying so intermediates never exceed the result.
+     * @return false if the coefficient no longer fits in 128 bits
+     */
+    bool nextMultichoose(TreeCount& ways, TreeCount t, size_t j) {
+        TreeCount g = gcd(ways, j);
+        TreeCount factor = (t + j - 1) / (j / g);
+        return !__builtin_mul_overflow(ways / g, factor, &ways);
+    }
+
+    // C(t + j - 1, j): ways to choose j of t items with repetition
+    TreeCount multichoose(TreeCount t, size_t j) {
+        TreeCount ways = 1;
+        for (size_t i = 1; i <= j; ++i) {
+            if (!nextMultichoose(ways, t, i)) {
+                throw std::overflow_error("tree count exceeds 128 bits");
+            }
+        }
+        return ways;
+    }
+
+    /**
+     * @brief Position of a non-increasing tuple among all such tuples, lexicographically
+     * With i elements still to come after a value x, the tuples of smaller
+     * value at that position number multichoose(x, i + 1) (hockey stick).
+     */
+    TreeCount rankTuple(std::span<const TreeCount> tuple) {
+        TreeCount rank = 0;
+        for (size_t i = 0; i < tuple.size(); ++i) {
+            rank = checkedAdd(rank, multichoose(tuple[i], tuple.size() - i));
+        }
+        return rank;
+    }
+
+    // Inverse of rankTuple for j values below t
+    std::vector<TreeCount> unrankTuple(TreeCount t, size_t j, TreeCount rank) {
+        std::vector<TreeCount> tuple;
+        TreeCount bound = t - 1;
+        for (size_t i = 0; i < j; ++i) {
+            // Largest value <= bound whose preceding tuples still fit in rank
+            TreeCount lo = 0;
+            TreeCount hi = bound;
+            while (lo < hi) {
+                TreeCount mid = lo + (hi - lo + 1) / 2;
+                if (multichoose(mid, j - i) <= rank) {
+                    lo = mid;
+                } else {
+                    hi = mid - 1;
+                }
+            }
+            rank -= multichoose(lo, j - i);
+            tuple.push_back(lo);
+            bound = lo;
+        }
+        return tuple;
+    }
+}
+
+std::string countToString(TreeCount value) {
+    if (value == 0) {
+        return "0";
+    }
+    std::string digits;
+    while (value > 0) {
+        digits += static_cast<char>('0' + static_cast<int>(value % 10));
+        value /= 10;
+    }
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+TreeCounter::TreeCounter(size_t maxN, size_t maxLeaves, Tables tables)
+    : maxN_(maxN), maxK_(std::min(maxLeaves, std::max(maxN, size_t(1)))),
+      trees_((maxN_ + 1) * (maxK_ + 1), 0), ranking_(tables == Tables::Ranking) {
+
+    if (maxN_ == 0 || maxK_ == 0) {
+        return;
+    }
+
+    // forests[n * (maxK_ + 1) + k] = F(n, k), forests over classes added so far
+    const size_t stride = maxK_ + 1;
+    std::vector<TreeCount> forests(maxN_ * stride, 0);
+    forests[0] = 1;
+
+    // Ranking keeps the table as it stands once classes <= (a, b) are in
+    const size_t table = forests.size();
+    if (ranking_) {
+        upTo_.resize(maxN_ * stride * table);
+    }
+    auto snapshot = [&](size_t a, size_t b) {
+        if (ranking_) {
+            std::copy(forests.begin(), forests.end(), upTo_.begin() + (a * stride + b) * table);
+        }
+    };
+    for (size_t b = 0; b <= maxK_; ++b) {
+        snapshot(0, b);
+    }
+
+    trees(1, 1) = 1;
+    for (size_t a = 1; a < maxN_; ++a) {
+        // Every forest on a-1 nodes uses only classes smaller than a, all added by now
+        if (a > 1) {
+            for (size_t k = 1; k <= maxK_; ++k) {
+                trees(a, k) = forests[(a - 1) * stride + k];
+            }
+        }
+
+        snapshot(a, 0);
+
+        // Fold class (a, b) into the forest table; descending n keeps
+        // F(n - ja, .) at its value from before this class
+        for (size_t b = 1; b <= maxK_; ++b) {
+            TreeCount t = (b <= a) ? trees(a, b) : 0;
+            if (t == 0) {
+                snapshot(a, b);
+                continue;
+            }
+
+            for (size_t n = maxN_ - 1; n >= a; --n) {
+                for (size_t k = maxK_; k >= b; --k) {
+                    TreeCount sum = 0;
+                    TreeCount ways = 1;
+                    bool waysFit = true;
+                    for (size_t j = 1; j * a <= n && j * b <= k; ++j) {
+                        waysFit = waysFit && nextMultichoose(ways, t, j);
+                        TreeCount base = forests[(n - j * a) * stride + (k - j * b)];
+                        if (base == 0) {
+                            continue;
+                        }
+                        // An oversized coefficient only matters once it is actually used
+                        if (!waysFit) {
+                            throw std::overflow_error("tree count exceeds 128 bits");
+                        }
+                        sum = checkedAdd(sum, checkedMul(ways, base));
+                    }
+                    forests[n * stride + k] = checkedAdd(forests[n * stride + k], sum);
+                }
+            }
+            snapshot(a, b);
+        }
+    }
+
+    if (maxN_ > 1) {
+        for (size_t k = 1; k <= maxK_; ++k) {
+            trees(maxN_, k) = forests[(maxN_ - 1) * stride + k];
+        }
+    }
+}
+
+TreeCount TreeCounter::exact(size_t n, size_t k) const {
+    if (n > maxN_ || k > maxK_) {
+        throw std::out_of_range(std::format(
+            "count ({}, {}) outside table ({}, {})", n, k, maxN_, maxK_));
+    }
+    return trees_[n * (maxK_ + 1) + k];
+}
+
+TreeCount TreeCounter::atMost(size_t n, size_t m) const {
+    TreeCount total = 0;
+    for (size_t k = 1; k <= std::min(m, maxK_); ++k) {
+        total = checkedAdd(total, exact(n, k));
+    }
+    return total;
+}
+
+void TreeCounter::requireRanking() const {
+    if (!ranking_) {
+        throw std::logic_error("TreeCounter built without Tables::Ranking");
+    }
+}
+
+TreeCount TreeCounter::forests(size_t a, size_t b, size_t nodes, size_t leaves) const {
+    requireRanking();
+    if (nodes == 0) {
+        return leaves == 0 ? 1 : 0;
+    }
+    if (nodes >= maxN_ || leaves > maxK_ || a == 0) {
+        return 0;
+    }
+    // Classes with maxN_ or more nodes never fit in a smaller forest
+    if (a >= maxN_) {
+        a = maxN_ - 1;
+        b = maxK_;
+    }
+    const size_t stride = maxK_ + 1;
+    size_t table = maxN_ * stride;
+    return upTo_[(a * stride + std::min(b, maxK_)) * table + nodes * stride + leaves];
+}
+
+TreeCount TreeCounter::rankChildren(size_t n, size_t k, std::vector<Child> children) const {
+    requireRanking();
+    if (n == 0 || n > maxN_ || k > maxK_) {
+        throw std::out_of_range(std::format("cell ({}, {}) outside table ({}, {})", n, k, maxN_, maxK_));
+    }
+    if (n == 1) {
+        return 0;
+    }
+
+    // Generation order: classes descending, positions descending within a class
+    std::sort(children.begin(), children.end(), [](const Child& x, const Child& y) {
+        return std::tie(x.nodes, x.leaves, x.index) > std::tie(y.nodes, y.leaves, y.index);
+    });
+
+    // Walk the groups of equal class. Trees whose next group has a larger
+    // class, or the same class more often, come first; each such forest of
+    // the remaining nodes stands for `scale` trees (the option choices of
+    // the groups already fixed, which are less significant than the rest's
+    // classes).
+    size_t nodes = n - 1;
+    size_t leaves = k;
+    size_t boundNodes = n - 1;
+    size_t boundLeaves = k;
+    TreeCount before = 0;
+    TreeCount scale = 1;
+    std::vector<std::pair<TreeCount, TreeCount>> digits;  // (options of the group, chosen option)
+    for (size_t g = 0; g < children.size();) {
+        size_t a = children[g].nodes;
+        size_t b = children[g].leaves;
+        size_t end = g;
+        std::vector<TreeCount> tuple;
+        while (end < children.size() && children[end].nodes == a && children[end].leaves == b) {
+            tuple.push_back(children[end++].index);
+        }
+        size_t j = end - g;
+        if (a == 0 || b == 0 || j * a > nodes || j * b > leaves ||
+            std::tie(a, b) > std::tie(boundNodes, boundLeaves)) {
+            throw std::invalid_argument(std::format("children do not form a tree of cell ({}, {})", n, k));
+        }
+        TreeCount t = exact(a, b);
+        if (tuple.front() >= t) {
+            throw std::out_of_range(std::format("child index outside cell ({}, {})", a, b));
+        }
+
+        TreeCount larger = forests(boundNodes, boundLeaves, nodes, leaves) - forests(a, b, nodes, leaves);
+        for (size_t more = j + 1; more * a <= nodes && more * b <= leaves; ++more) {
+            TreeCount rest = forests(a, b - 1, nodes - more * a, leaves - more * b);
+            if (rest != 0) {
+                larger = checkedAdd(larger, checkedMul(multichoose(t, more), rest));
+            }
+        }
+        before = checkedAdd(before, checkedMul(scale, larger));
+
+        TreeCount options = multichoose(t, j);
+        digits.emplace_back(options, rankTuple(tuple));
+        scale = checkedMul(scale, options);
+        nodes -= j * a;
+        leaves -= j * b;
+        boundNodes = a;
+        boundLeaves = b - 1;
+        g = end;
+    }
+    if (nodes != 0 || leaves != 0) {
+        throw std::invalid_argument(std::format("children do not form a tree of cell ({}, {})", n, k));
+    }
+
+    // Within one class sequence, options are mixed-radix with the first group most significant
+    TreeCount option = 0;
+    for (auto [options, chosen] : digits) {
+        option = option * options + chosen;
+    }
+    return before + option;
+}
+
+std::vector<TreeCounter::Child> TreeCounter::unrankChildren(size_t n, size_t k, TreeCount index) const {
+    requireRanking();
+    if (index >= exact(n, k)) {
+        throw std::out_of_range(std::format("index {} outside cell ({}, {})", countToString(index), n, k));
+    }
+
+    struct Group {
+        size_t nodes;
+        size_t leaves;
+        size_t count;
+        TreeCount trees;
+        TreeCount options;
+    };
+    std::vector<Group> groups;
+
+    // Pick each group's class and multiplicity from the block sizes
+    // (see rankChildren); what is left of the index selects the options
+    size_t nodes = n - 1;
+    size_t leaves = k;
+    size_t boundNodes = n - 1;
+    size_t boundLeaves = k;
+    TreeCount scale = 1;
+    while (nodes > 0) {
+        bool chosen = false;
+        for (size_t a = std::min(nodes, boundNodes); a >= 1 && !chosen; --a) {
+            size_t top = (a == boundNodes) ? boundLeaves : maxK_;
+            for (size_t b = std::min(leaves, top); b >= 1 && !chosen; --b) {
+                TreeCount t = exact(a, b);
+                if (t == 0) {
+                    continue;
+                }
+                for (size_t j = std::min(nodes / a, leaves / b); j >= 1; --j) {
+                    TreeCount rest = forests(a, b - 1, nodes - j * a, leaves - j * b);
+                    if (rest == 0) {
+                        continue;
+                    }
+                    TreeCount options = multichoose(t, j);
+                    TreeCount block = checkedMul(checkedMul(scale, options), rest);
+                    if (index < block) {
+                        groups.push_back({a, b, j, t, options});
+                        chosen = true;
+                        break;
+                    }
+                    index -= block;
+                }
+            }
+        }
+        if (!chosen) {
+            throw std::logic_error("inconsistent ranking tables");
+        }
+        const Group& group = groups.back();
+        scale *= group.options;
+        nodes -= group.count * group.nodes;
+        leaves -= group.count * group.leaves;
+        boundNodes = group.nodes;
+        boundLeaves = group.leaves - 1;
+    }
+
+    std::vector<TreeCount> chosen(groups.size());
+    for (size_t g = groups.size(); g-- > 0;) {
+        chosen[g] = index % groups[g].options;
+        index /= groups[g].options;
+    }
+
+    std::vector<Child> children;
+    for (size_t g = 0; g < groups.size(); ++g) {
+        for (TreeCount position : unrankTuple(groups[g].trees, groups[g].count, chosen[g])) {
+            children.push_back({groups[g].nodes, groups[g].leaves, position});
+        }
+    }
+    return children;
+}
+
+TreeCount TreeCounter::rankExact(const Tree& tree) const {
+    if (tree.getNodeCount() == 1) {
+        return 0;
+    }
+    std::vector<Child> children;
+    for (const Tree& child : tree.getChildren()) {
+        children.push_back({child.getNodeCount(), child.getLeafCount(), rankExact(child)});
+    }
+    return rankChildren(tree.getNodeCount(), tree.getLeafCount(), std::move(children));
+}
+
+Tree TreeCounter::unrankExact(size_t n, size_t k, TreeCount index) const {
+    std::vector<Child> children = unrankChildren(n, k, index);
+    std::vector<Tree> subtrees;
+    subtrees.reserve(children.size());
+    for (const Child& child : children) {
+        subtrees.push_back(unrankExact(child.nodes, child.leaves, child.index));
+    }
+    std::vector<const Tree*> pointers;
+    for (const Tree& subtree : subtrees) {
+        pointers.push_back(&subtree);
+    }
+    return Tree::fromCanonicalChildren(pointers);
+}
+
+TreeCount TreeCounter::rank(const Tree& tree) const {
+    requireRanking();
+    Tree canonical = tree;
+    canonical.sortToCanonical();
+    if (canonical != tree) {
+        throw std::invalid_argument("rank() needs a canonical tree");
+    }
+    size_t n = tree.getNodeCount();
+    size_t k = tree.getLeafCount();
+    TreeCount offset = 0;
+    for (size_t fewer = 1; fewer < k; ++fewer) {
+        offset += exact(n, fewer);
+    }
+    return offset + rankExact(tree);
+}
+
+Tree TreeCounter::unrank(size_t n, size_t m, TreeCount index) const {
+    requireRanking();
+    TreeCount remaining = index;
+    for (size_t k = 1; k <= std::min(m, maxK_) && n <= maxN_; ++k) {
+        TreeCount cell = exact(n, k);
+        if (remaining < cell) {
+            return unrankExact(n, k, remaining);
+        }
+        remaining -= cell;
+    }
+    throw std::out_of_range(std::format("index {} outside the trees with {} nodes and at most {} leaves",
+                                        countToString(index), n, m));
+}
+
+} // namespace vinci
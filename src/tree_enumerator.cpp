@@ -0,0 +1,85 @@
+#include "tree_enumerator.h"
+#include <algorithm>
+
+namespace vinci {
+
+TreeEnumerator::TreeEnumerator(size_t n, size_t maxLeaves)
+    : n_(n), maxLeaves_(maxLeaves), valid_(n > 0 && maxLeaves > 0),
+      levels_(n), leavesBefore_(n + 1, 0) {
+    if (!valid_) {
+        return;
+    }
+
+    // The path has a single leaf, so it always satisfies the limit
+    for (size_t i = 0; i < n_; ++i) {
+        levels_[i] = static_cast<Level>(i);
+    }
+    updateLeaves(0);
+}
+
+void TreeEnumerator::updateLeaves(size_t from) {
+    for (size_t i = std::max(from, size_t(1)); i < n_; ++i) {
+        // Position i-1 is a leaf iff its successor is not deeper
+        bool leaf = levels_[i] <= levels_[i - 1];
+        leavesBefore_[i + 1] = leavesBefore_[i] + (leaf ? 1 : 0);
+    }
+}
+
+bool TreeEnumerator::successor() {
+    // p: last node deeper than a child of the root
+    size_t p = n_;
+    for (size_t i = n_; i-- > 1;) {
+        if (levels_[i] > 1) {
+            p = i;
+            break;
+        }
+    }
+    if (p == n_) {
+        return false;
+    }
+
+    // q: parent of p (last earlier node one level up)
+    size_t q = p;
+    while (levels_[--q] != levels_[p] - 1) {
+    }
+
+    // Replace the suffix by repeated copies of the segment [q, p)
+    size_t period = p - q;
+    for (size_t i = p; i < n_; ++i) {
+        levels_[i] = levels_[i - period];
+    }
+    updateLeaves(p);
+    return true;
+}
+
+bool TreeEnumerator::settle() {
+    while (leafCount() > maxLeaves_) {
+        // Shortest prefix that already fixes more than maxLeaves leaves
+        // (the final node is always one more leaf)
+        size_t k = 1;
+        while (leavesBefore_[k] < maxLeaves_) {
+            ++k;
+        }
+
+        if (k < n_) {
+            // Jump to the last tree with this prefix: everything after it hangs off the root
+            std::fill(levels_.begin() + static_cast<std::ptrdiff_t>(k), levels_.end(), Level(1));
+            updateLeaves(k);
+        }
+
+        if (!successor()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TreeEnumerator::next() {
+    if (!valid_) {
+        return false;
+    }
+    valid_ = successor() && settle();
+    return valid_;
+}
+
+} // namespace vinci
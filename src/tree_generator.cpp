@@ -1,5 +1,8 @@
 #include "tree_generator.h"
+#include "tree_enumerator.h"
 #include "tree_optimizer.h"
+#include "bounded_queue.h"
+#include "task_pool.h"
 #include <algorithm>
 #include <thread>
 #include <future>
@@ -8,472 +11,1006 @@
 #include <iostream>
 #include <format>
 #include <chrono>
-#include <set>
-#ifdef __linux__
-#include <sys/sysinfo.h>
-#elif __APPLE__
-#include <sys/types.h>
-#include <sys/sysctl.h>
-#include <mach/mach.h>
-#include <mach/vm_statistics.h>
-#include <mach/mach_types.h>
-#include <mach/mach_init.h>
-#include <mach/mach_host.h>
-#elif _WIN32
-#include <windows.h>
-#include <sysinfoapi.h>
-#endif
-#include <unistd.h>
+#include <condition_variable>
+#include <exception>
+#include <stop_token>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <memory>
+#include <system_error>
+#include <tuple>
 
 namespace vinci {
 
 namespace {
+    // a * b, clamped to the largest TreeCount
+    TreeCount saturatingMultiply(TreeCount a, TreeCount b) {
+        constexpr TreeCount kMax = ~TreeCount(0);
+        return (b != 0 && a > kMax / b) ? kMax : a * b;
+    }
+
     /**
-     * @brief Get available memory in bytes (cross-platform)
-     * @return Available memory in bytes, or 0 if unable to determine
+     * @brief Upper bound on the trees whose root children have the given sizes
+     * j equal parts of size a choose a multiset of j trees from the
+     * atMost(a, limit) candidates, where limit leaves every other part one leaf.
      */
-    size_t getAvailableMemory() {
-#ifdef __linux__
-        struct sysinfo memInfo;
-        if (sysinfo(&memInfo) == 0) {
-            return memInfo.freeram;
-        }
-#elif __APPLE__
-        vm_size_t page_size;
-        mach_port_t mach_port;
-        mach_msg_type_number_t count;
-        vm_statistics64_data_t vm_stats;
-
-        mach_port = mach_host_self();
-        count = sizeof(vm_stats) / sizeof(natural_t);
-        if (host_page_size(mach_port, &page_size) == KERN_SUCCESS &&
-            host_statistics64(mach_port, HOST_VM_INFO, (host_info64_t)&vm_stats, &count) == KERN_SUCCESS) {
-            return (vm_stats.free_count + vm_stats.inactive_count) * page_size;
-        }
-#elif _WIN32
-        MEMORYSTATUSEX memInfo;
-        memInfo.dwLength = sizeof(MEMORYSTATUSEX);
-        if (GlobalMemoryStatusEx(&memInfo)) {
-            return memInfo.ullAvailPhys;
-        }
-#endif
-        return 0;
+    TreeCount partitionCost(Partition partition, size_t m, const TreeCounter& counter) {
+        if (partition.size() > m) {
+            return 0;
+        }
+        size_t limit = m - (partition.size() > 0 ? partition.size() - 1 : 0);
+        TreeCount cost = 1;
+        for (size_t i = 0; i < partition.size();) {
+            size_t j = 1;
+            while (i + j < partition.size() && partition[i + j] == partition[i]) {
+                ++j;
+            }
+            // C(T + j - 1, j), each step exact: c_r = c_{r-1} * (T + r - 1) / r
+            TreeCount candidates = counter.atMost(partition[i], std::min(limit, counter.maxLeaves()));
+            TreeCount multisets = 1;
+            for (size_t r = 1; r <= j; ++r) {
+                TreeCount next = saturatingMultiply(multisets, candidates + r - 1);
+                multisets = (next == ~TreeCount(0)) ? next : next / r;
+            }
+            cost = saturatingMultiply(cost, multisets);
+            i += j;
+        }
+        return cost;
+    }
+}
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    enum class Phase { None, Partitions, ChildOptions, Combinations, Callback };
+
+    // The calling thread's accumulator and the phase its time is charged to
+    struct PhaseClock {
+        GenerationStats* stats = nullptr;
+        Phase phase = Phase::None;
+        Clock::time_point mark;
+    };
+    thread_local PhaseClock phaseClock;
+
+    // Stats of the calling thread, or nullptr when collection is off
+    GenerationStats* threadStats() { return phaseClock.stats; }
+
+    // Charge the time since the last switch to the current phase
+    void chargePhase(Clock::time_point now) {
+        GenerationStats::Duration spent = now - phaseClock.mark;
+        switch (phaseClock.phase) {
+            case Phase::Partitions: phaseClock.stats->partitionEnumeration += spent; break;
+            case Phase::ChildOptions: phaseClock.stats->childOptions += spent; break;
+            case Phase::Combinations: phaseClock.stats->combinations += spent; break;
+            case Phase::Callback: phaseClock.stats->callback += spent; break;
+            case Phase::None: break;
+        }
+        phaseClock.mark = now;
     }
 
     /**
-     * @brief Check if system has sufficient memory for requested tree generation
-     * @param n Number of nodes
-     * @param m Maximum leaf nodes
-     * @return true if memory is sufficient, false otherwise
+     * @brief Charge the calling thread's time to `phase` while in scope
+     * Scopes nest, and each phase gets only its exclusive time. Two clock
+     * reads when stats are on; one branch when they are off.
      */
-    bool checkMemoryAvailability(size_t n, size_t m) {
-        size_t availableMemory = getAvailableMemory();
-        if (availableMemory == 0) {
-            // If we can't get memory info, assume it's fine
-            return true;
-        }
-
-        // Available memory in GB
-        size_t availableMemoryGB = availableMemory / (1024ULL * 1024 * 1024);
-
-        // Conservative memory estimation:
-        // - Each tree: ~100 bytes average (string representation + overhead)
-        // - Number of trees grows exponentially with N
-        // - For N > 20, memory usage can become significant
-
-        // Empirical limits based on OEIS A000081 and testing:
-        // N=14: 32,973 trees (~3 MB)
-        // N=15: 85,000 trees (~8 MB)
-        // N=20: ~1.5M trees (~150 MB)
-        // N=25: ~37M trees (~3.7 GB)
-        // N=30: ~900M trees (~90 GB) - already problematic
-
-        if (n > 30) {
-            std::cerr << std::format(
-                "Error: N={} is too large. Maximum supported is N=30.\n"
-                "Estimated memory requirement would exceed available memory.\n",
-                n
-            );
-            return false;
+    class PhaseScope {
+    public:
+        explicit PhaseScope(Phase phase) : active_(phaseClock.stats != nullptr) {
+            if (active_) {
+                chargePhase(Clock::now());
+                previous_ = phaseClock.phase;
+                phaseClock.phase = phase;
+            }
         }
-
-        // For N between 25-30, check if we have enough RAM
-        if (n >= 25) {
-            // Rough exponential estimate: memory ~ 2^(n/3) MB
-            size_t estimatedMemoryMB = 1ULL << (n / 3);
-            size_t estimatedMemoryGB = estimatedMemoryMB / 1024;
-
-            if (estimatedMemoryGB > availableMemoryGB) {
-                std::cerr << std::format(
-                    "Error: Insufficient memory for N={}, M={}.\n"
-                    "Estimated requirement: ~{} GB\n"
-                    "Available memory: ~{} GB\n"
-                    "Hint: Try a smaller N value (N <= 20 is safe).\n",
-                    n, m, estimatedMemoryGB, availableMemoryGB
-                );
-                return false;
+        ~PhaseScope() {
+            if (active_) {
+                chargePhase(Clock::now());
+                phaseClock.phase = previous_;
             }
+        }
 
-            // Warn if we're using more than 50% of available memory
-            if (estimatedMemoryGB * 2 > availableMemoryGB) {
-                std::cerr << std::format(
-                    "Warning: N={} may use significant memory (~{} GB).\n"
-                    "Available: {} GB. Proceeding, but monitor memory usage...\n",
-                    n, estimatedMemoryGB, availableMemoryGB
-                );
+        PhaseScope(const PhaseScope&) = delete;
+        PhaseScope& operator=(const PhaseScope&) = delete;
+
+    private:
+        bool active_;
+        Phase previous_ = Phase::None;
+    };
+
+    /**
+     * @brief Draws a progress line on stderr from its own thread
+     * Reads only atomics; the destructor stops the thread, joins it and
+     * clears the line.
+     */
+    class ProgressReporter {
+    public:
+        ProgressReporter(std::chrono::milliseconds interval, const std::atomic<size_t>& trees,
+                         const std::atomic<size_t>& partitionsDone, const std::atomic<size_t>& partitionsTotal) {
+            if (interval.count() <= 0) {
+                return;
             }
+            thread_ = std::jthread([interval, &trees, &partitionsDone, &partitionsTotal](std::stop_token stop) {
+                auto start = Clock::now();
+                std::mutex mutex;
+                std::condition_variable_any wake;
+                std::unique_lock<std::mutex> lock(mutex);
+                bool drawn = false;
+                while (!wake.wait_for(lock, stop, interval, [&stop] { return stop.stop_requested(); })) {
+                    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+                    size_t count = trees.load(std::memory_order_relaxed);
+                    std::string line = std::format("\rProgress: {} trees | {:.1f}s elapsed | {:.0f} trees/s",
+                                                   count, elapsed, elapsed > 0 ? count / elapsed : 0.0);
+                    if (size_t total = partitionsTotal.load(std::memory_order_relaxed)) {
+                        line += std::format(" | Partitions: {}/{}",
+                                            partitionsDone.load(std::memory_order_relaxed), total);
+                    }
+                    std::cerr << line << std::flush;
+                    drawn = true;
+                }
+                if (drawn) {
+                    std::cerr << "\r" << std::string(100, ' ') << "\r" << std::flush;
+                }
+            });
         }
 
-        return true;
-    }
+    private:
+        std::jthread thread_;
+    };
 }
 
-size_t TreeGenerator::generate(size_t n, size_t m, TreeCallback callback, bool useMultithreading) {
-    count_ = 0;
-
-    // Check memory availability before starting
-    if (!checkMemoryAvailability(n, m)) {
-        return 0;
+void TreeGenerator::attachThreadStats() {
+    if (!statsEnabled_) {
+        return;
     }
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    phaseClock = PhaseClock{&threadStats_.emplace_back(), Phase::None, Clock::now()};
+}
 
-    // Initialize cache
-    cache_.clear();
-    cache_.resize(n + 1);
-    for (auto& level : cache_) {
-        level.resize(m + 1);
+void TreeGenerator::setShard(size_t index, size_t count) {
+    if (index >= count) {
+        throw std::invalid_argument(std::format("shard {} is not below shard count {}", index, count));
     }
+    shardIndex_ = index;
+    shardCount_ = count;
+}
 
+std::vector<size_t> TreeGenerator::shardPartitions(size_t n, size_t m, size_t index, size_t count) {
+    if (index >= count) {
+        throw std::invalid_argument(std::format("shard {} is not below shard count {}", index, count));
+    }
     if (n == 0) {
-        return 0;
+        return {};
     }
 
-    // For small cases or when multithreading is disabled, use single-threaded path
-    if (!useMultithreading || n < 10) {
-        // For small cases, single-threaded is fine
-        std::vector<Tree> results;
-        generateTreesRecursive(n, m, results, cache_);
+    PartitionTable table(n - 1);
+    const PartitionTable::List& partitions = table.get(n - 1, n - 1);
+    TreeCounter counter(n, std::min(m, n));
 
-        for (const auto& tree : results) {
-            callback(tree);
-            ++count_;
+    std::vector<TreeCount> costs(partitions.size());
+    std::vector<size_t> order(partitions.size());
+    for (size_t i = 0; i < partitions.size(); ++i) {
+        costs[i] = partitionCost(partitions[i], m, counter);
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+
+    // Longest-processing-time first: heaviest partition to the lightest shard
+    std::vector<TreeCount> loads(count, 0);
+    std::vector<size_t> assigned;
+    for (size_t idx : order) {
+        size_t shard = std::min_element(loads.begin(), loads.end()) - loads.begin();
+        loads[shard] += std::min(costs[idx], ~TreeCount(0) - loads[shard]);
+        if (shard == index) {
+            assigned.push_back(idx);
         }
-        return count_;
     }
+    std::sort(assigned.begin(), assigned.end());
+    return assigned;
+}
 
-    // Use parallel optimized algorithm for constrained problems
-    if (TreeOptimizer::shouldUseOptimized(n, m)) {
-        count_ = TreeOptimizer::generateAllWithCallback(n, m, callback, useMultithreading);
-        return count_;
+size_t TreeGenerator::generate(size_t n, size_t m, TreeCallback callback, bool useMultithreading) {
+    BatchCallback perTree;
+    if (callback) {
+        perTree = [&callback](std::span<const Tree> batch) {
+            for (const Tree& tree : batch) {
+                callback(tree);
+            }
+        };
     }
+    return run(n, m, [&perTree](size_t) { return perTree; }, false, useMultithreading);
+}
 
-    // Detect system resources
-    size_t numCores = std::thread::hardware_concurrency();
-    if (numCores == 0) numCores = 4;
+size_t TreeGenerator::generate(size_t n, size_t m, TreeCount start, TreeCount length,
+                               TreeCallback callback) {
+    BatchCallback perTree;
+    if (callback) {
+        perTree = [&callback](std::span<const Tree> batch) {
+            for (const Tree& tree : batch) {
+                callback(tree);
+            }
+        };
+    }
+    slice_ = Slice{start, length};
+    size_t total;
+    try {
+        total = run(n, m, [&perTree](size_t) { return perTree; }, false, false);
+    } catch (...) {
+        slice_.reset();
+        throw;
+    }
+    slice_.reset();
+    return total;
+}
 
-    // Use all available cores now that threading synchronization is fixed
-    size_t maxThreads = std::min(numCores, size_t(16));
+size_t TreeGenerator::generateBatches(size_t n, size_t m, BatchCallback consumer, bool useMultithreading) {
+    return run(n, m, [&consumer](size_t) { return consumer; }, false, useMultithreading);
+}
 
-    // Pre-warm cache for small subtrees (single-threaded, shared)
-    size_t prewarmSize = std::min(n / 2, size_t(15));
-    prewarmCache(prewarmSize, m);
+size_t TreeGenerator::generatePerThread(size_t n, size_t m, const ConsumerFactory& makeConsumer,
+                                        bool useMultithreading) {
+    return run(n, m, makeConsumer, true, useMultithreading);
+}
 
-    // Parallel generation strategy:
-    // Each thread gets its own cache copy and works on independent partitions
-    size_t remainingNodes = n - 1;
+size_t TreeGenerator::run(size_t n, size_t m, const ConsumerFactory& makeConsumer, bool perWorker,
+                          bool useMultithreading) {
+    auto start = Clock::now();
+    count_ = 0;
+    partitionsDone_ = 0;
+    partitionsTotal_ = 0;
+    runThreads_ = 1;
+    prewarmTime_ = {};
+    threadStats_.clear();
+    size_t hitsBefore = statsEnabled_ ? store_.internHits() : 0;
+
+    size_t total;
+    {
+        ProgressReporter progress(progressInterval_, count_, partitionsDone_, partitionsTotal_);
+
+        // The calling thread accumulates like a worker; its previous clock
+        // (from an enclosing generate() on this thread) comes back afterwards
+        PhaseClock saved = phaseClock;
+        phaseClock = PhaseClock{};
+        attachThreadStats();
+        // Consumers run with the caller's resource, never the run's arena
+        callerResource_ = Tree::heapResource();
+        try {
+            total = generateRun(n, m, makeConsumer, perWorker, useMultithreading);
+        } catch (...) {
+            phaseClock = saved;
+            throw;
+        }
+        phaseClock = saved;
+    }
 
-    // Generate all partitions first (must process ALL possible numChildren values)
-    std::vector<std::pair<size_t, std::vector<size_t>>> allPartitions;
+    stats_ = GenerationStats{};
+    for (const auto& local : threadStats_) {
+        stats_ += local;
+    }
+    threadStats_.clear();
+    stats_.trees = total;
+    stats_.threads = runThreads_;
+    stats_.prewarm = prewarmTime_;
+    stats_.elapsed = Clock::now() - start;
+    if (statsEnabled_) {
+        stats_.dedupHits = store_.internHits() - hitsBefore;
+    }
+    return total;
+}
 
-    for (size_t numChildren = 1; numChildren <= remainingNodes; ++numChildren) {
-        std::vector<std::vector<size_t>> partitions;
-        std::vector<size_t> current;
-        generatePartitions(remainingNodes, numChildren, current, partitions);
+size_t TreeGenerator::resolvedThreads(size_t n, bool useMultithreading) const {
+    // One worker per hardware thread unless the caller chose a count
+    size_t threads = threadCount_;
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 4;
+    }
+    return (!useMultithreading || n < 10) ? 1 : threads;
+}
 
-        for (auto& partition : partitions) {
-            std::sort(partition.begin(), partition.end(), std::greater<size_t>());
-            allPartitions.emplace_back(numChildren, partition);
-        }
+TreeGenerator::Engine TreeGenerator::resolvedEngine(size_t n, bool perWorker, bool useMultithreading) const {
+    if (shardCount_ > 1) {
+        return Engine::Memoized;
+    }
+    if (constraints_.any()) {
+        return Engine::ExactLeaves;
+    }
+    if (engine_ != Engine::Auto) {
+        return engine_;
     }
+    // The successor walk visits each valid tree exactly once and skips blocks
+    // of over-budget trees; on one core it ran 15-28x faster than the memoized
+    // engine at every (N, M) in BM_GenerateAuto, but it cannot be split across
+    // workers. Auto keeps it unless the caller asked for parallel work: an
+    // explicit thread count above one, or per-worker consumers.
+    bool parallel = resolvedThreads(n, useMultithreading) > 1 && (threadCount_ != 0 || perWorker);
+    return (n >= 10 && !parallel) ? Engine::LevelSequence : Engine::Memoized;
+}
+
+size_t TreeGenerator::generateRun(size_t n, size_t m, const ConsumerFactory& makeConsumer, bool perWorker,
+                                  bool useMultithreading) {
 
-    // Process partitions in parallel with per-thread caches
-    std::vector<std::jthread> threads;
-    threads.reserve(maxThreads);  // Reserve to prevent reallocation during emplace_back
-    std::vector<std::vector<Tree>> threadResults(maxThreads);
-    std::vector<std::mutex> threadMutexes(maxThreads);  // One mutex per thread
-    // Pre-reserve generous space to avoid reallocations during parallel execution
-    for (auto& vec : threadResults) {
-        vec.reserve(100000);  // Large reservation to prevent any reallocation
+    if (constraints_.any() && (slice_ || shardCount_ > 1)) {
+        throw std::invalid_argument("generation constraints do not combine with slices or shards");
     }
-    std::atomic<size_t> partitionsCompleted{0};
-    size_t totalPartitions = allPartitions.size();
 
-    // Pre-create thread caches with proper synchronization
-    std::vector<std::vector<std::vector<std::vector<Tree>>>> threadCaches(maxThreads);
-    for (size_t t = 0; t < maxThreads; ++t) {
-        threadCaches[t] = cache_;
+    // A slice holds one tree at a time besides the ranking tables
+    if (slice_) {
+        BatchCallback consumer = makeConsumer(0);
+        return generateSlice(n, m, *slice_, consumer);
     }
 
-    // Memory barrier to ensure cache copies are visible to all threads
-    std::atomic_thread_fence(std::memory_order_seq_cst);
+    size_t maxThreads = resolvedThreads(n, useMultithreading);
+    Engine engine = resolvedEngine(n, perWorker, useMultithreading);
+
+    // Every path except the parallel memoized one delivers from this thread
+    // to a single consumer
+    BatchCallback consumer;
 
-    // Launch worker threads with static work assignment
-    for (size_t t = 0; t < maxThreads; ++t) {
-        threads.emplace_back(
-            [this, &allPartitions, &partitionsCompleted, &threadResults, &threadCaches, &threadMutexes, t, m, maxThreads](std::stop_token stoken) {
-                // Use the pre-allocated cache for this thread
-                auto& threadCache = threadCaches[t];
+    // Size the cache-based engines from the exact counts. The planner sizes
+    // the unconstrained space, so shape-limited runs, whose cells only hold
+    // trees meeting the limits, are not held to it.
+    if (engine != Engine::LevelSequence && !constraints_.limitsShape()) {
+        size_t budget = memoryBudget_ != 0 ? memoryBudget_ : MemoryPlanner::availableMemory();
+        if (budget == 0) {
+            budget = std::numeric_limits<size_t>::max();
+        }
+        MemoryPlanner planner(n, m);
+        plan_ = (engine == Engine::ExactLeaves) ? planner.exactLeaves(budget) : planner.memoized(maxThreads, budget);
+        if (!plan_.fits) {
+            constexpr double kMiB = 1024.0 * 1024.0;
+            // The level sequence walk knows no constraints, so constrained
+            // runs are refused rather than handed unfiltered trees
+            if (engine_ != Engine::Auto || shardCount_ > 1 || constraints_.any()) {
+                std::cerr << std::format("Error: N={}, M={} does not fit in {:.1f} MiB: {}\n",
+                                         n, m, budget / kMiB, plan_.toText());
+                return 0;
+            }
+            // The level sequence walk holds one tree at a time
+            std::cerr << std::format("Note: N={}, M={} does not fit in {:.1f} MiB ({}); "
+                                     "using the level sequence enumerator on one thread\n",
+                                     n, m, budget / kMiB, plan_.toText());
+            engine = Engine::LevelSequence;
+        }
+    }
 
-                // Static partitioning: each thread processes every maxThreads-th partition
-                for (size_t idx = t; idx < allPartitions.size(); idx += maxThreads) {
-                    if (stoken.stop_requested()) break;
+    // The enumerator holds a single level sequence, so no memory plan is needed
+    if (engine == Engine::LevelSequence) {
+        consumer = makeConsumer(0);
+        return generateLevelSequences(n, m, consumer);
+    }
 
-                    // Make a local copy to avoid any potential sharing issues
-                    std::vector<size_t> partition = allPartitions[idx].second;
+    if (engine == Engine::ExactLeaves) {
+        consumer = makeConsumer(0);
+        // An explicit thread count or pinning builds the cell table on workers
+        // of its own; otherwise the optimizer's persistent pool is reused
+        std::optional<TaskPool> pool;
+        if (threadCount_ != 0 || pinThreads_) {
+            pool.emplace(maxThreads, pinThreads_);
+            runThreads_ = maxThreads;
+        }
+        TreeOptimizer::generateAllInBatches(n, m, constraints_, [this, &consumer](std::span<const Tree> batch) {
+            deliver(consumer, batch);
+        }, false, pool ? &*pool : nullptr);
+        return count_;
+    }
 
-                    // Generate child tree options for this partition
-                    std::vector<std::vector<Tree>> childTreeOptions(partition.size());
+    // Extend the shared subtree store; cells from earlier runs stay valid
+    store_.grow(n, m);
+    partitions_.grow(n);
+    Tree::ArenaScope arenaScope(&arena_);
 
-                    bool validPartition = true;
-                    for (size_t i = 0; i < partition.size(); ++i) {
-                        std::vector<Tree> tempResults;
-                        generateTreesRecursive(partition[i], m, tempResults, threadCache);
-                        if (tempResults.empty()) {
-                            validPartition = false;
-                            break;
-                        }
-                        childTreeOptions[i] = std::move(tempResults);
-                    }
+    if (n == 0) {
+        return 0;
+    }
 
-                    if (validPartition) {
-                        std::vector<Tree> currentChildren;
-                        std::vector<Tree> localResults;
-                        // Generate into local results first
-                        generateCombinations(partition, m, childTreeOptions, 0, currentChildren, localResults);
-
-                        // Add to thread's results with its dedicated mutex
-                        {
-                            std::lock_guard<std::mutex> lock(threadMutexes[t]);
-                            threadResults[t].insert(threadResults[t].end(), localResults.begin(), localResults.end());
-                        }
-                    }
+    // Root partitions: every way to split the n-1 non-root nodes among children.
+    // Trees from different partitions always differ (the multiset of child
+    // sizes is an invariant), so each partition can be deduplicated on its own
+    // and emitted as soon as it is finished.
+    size_t remainingNodes = n - 1;
+    const PartitionTable::List& allPartitions = [&]() -> const PartitionTable::List& {
+        PhaseScope phase(Phase::Partitions);
+        return partitions_.get(remainingNodes, remainingNodes);
+    }();
+
+    // A sharded run only generates the partitions dealt to its shard
+    std::vector<size_t> selected;
+    if (shardCount_ > 1) {
+        selected = shardPartitions(n, m, shardIndex_, shardCount_);
+    } else {
+        selected.resize(allPartitions.size());
+        std::iota(selected.begin(), selected.end(), size_t(0));
+    }
+    partitionsTotal_ = selected.size();
+    if (auto* stats = threadStats()) {
+        stats->rootPartitions = selected.size();
+    }
 
-                    // Update progress
-                    partitionsCompleted.fetch_add(1);
-                }
+    // For small cases or when multithreading is disabled, use single-threaded path
+    if (!useMultithreading || n < 10) {
+        consumer = makeConsumer(0);
+        if (n == 1) {
+            if (m >= 1 && !selected.empty()) {
+                Tree single;
+                deliver(consumer, std::span<const Tree>(&single, 1));
             }
-        );
-    }
+            return count_;
+        }
+
+        // A cache file is loaded and saved on this path too
+        if (!cacheFilePath_.empty()) {
+            auto prewarmStart = Clock::now();
+            prewarmCache(plan_.prewarmDepth, m);
+            prewarmTime_ = Clock::now() - prewarmStart;
+        }
 
-    // Wait for all worker threads to complete their work naturally
-    while (partitionsCompleted.load() < totalPartitions) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        // Every partition's trees go out in batches of at most the plan's flushTrees
+        flushTrees_ = plan_.flushTrees;
+        Flush flush = [this, &consumer](TreeBuffer& trees) { deliver(consumer, trees); };
+        TreeBuffer partitionTrees(&arena_);
+        for (size_t idx : selected) {
+            generatePartitionTrees(allPartitions[idx], m, partitionTrees, &flush);
+            deliver(consumer, partitionTrees);
+            partitionsDone_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return count_;
     }
 
-    // Now join all threads - they should be finishing naturally
-    threads.clear();
+    // The plan may run fewer workers, each buffering less, to fit the budget
+    maxThreads = plan_.threads;
+    flushTrees_ = plan_.flushTrees;
 
-    // Progress reporting thread (DISABLED for debugging)
-    if (false) {
-        std::jthread progressThread([&](std::stop_token stoken) {
-            auto startTime = std::chrono::steady_clock::now();
+    // Pre-warm cache for small subtrees (single-threaded, shared)
+    runThreads_ = maxThreads;
+    size_t prewarmSize = plan_.prewarmDepth;
+    auto prewarmStart = Clock::now();
+    prewarmCache(prewarmSize, m);
+    prewarmTime_ = Clock::now() - prewarmStart;
 
-            while (!stoken.stop_requested()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    // Parallel generation strategy:
+    // Every root partition is a task on a work-stealing pool. A task whose
+    // Cartesian product is large splits itself by first-child option, so one
+    // heavy partition no longer pins a single thread while the others idle.
+    // All tasks share one subtree store. With per-worker consumers each task
+    // hands its trees straight to its worker's consumer; otherwise finished
+    // trees stream to the calling thread through the worker's bounded queue.
+    // Each worker allocates its own queue, so with pinning the ring's pages are
+    // first touched (and placed) on the worker's NUMA node
+    std::vector<BatchCallback> consumers;
+    if (perWorker) {
+        consumers.reserve(maxThreads);
+        for (size_t worker = 0; worker < maxThreads; ++worker) {
+            consumers.push_back(makeConsumer(worker));
+        }
+    } else {
+        consumer = makeConsumer(0);
+    }
 
-                auto now = std::chrono::steady_clock::now();
-                auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - startTime).count();
-                size_t currentCount = count_.load();
-                size_t completed = partitionsCompleted.load();
+    // A consumer that throws stops the run: remaining work is skipped and
+    // its trees discarded, and the first exception is rethrown once every
+    // task has finished
+    std::atomic<bool> stopping{false};
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    auto fail = [&stopping, &failure, &failureMutex](std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(failureMutex);
+        if (!failure) {
+            failure = error;
+        }
+        stopping.store(true, std::memory_order_release);
+    };
+
+    std::atomic<std::uint64_t> readySignal{0};
+    std::vector<std::unique_ptr<BoundedQueue<Tree>>> queues(maxThreads);
+    TaskPool pool(maxThreads, pinThreads_, [this, perWorker, &queues, &readySignal](size_t worker) {
+        if (!perWorker) {
+            queues[worker] = std::make_unique<BoundedQueue<Tree>>(kStreamQueueDepth, readySignal);
+        }
+        attachThreadStats();
+    });
+
+    // Generate the combinations whose first child is in [begin, end) for the worker
+    auto emitRange = [this, perWorker, &consumers, &queues, &stopping, &fail, m](
+                         Partition partition, const std::vector<ChildOptions>& options,
+                         size_t begin, size_t end, size_t worker) {
+        if (stopping.load(std::memory_order_acquire)) {
+            return;
+        }
+        Tree::ArenaScope scope(&arena_);
+        TreeRefs current(&arena_);
+        TreeBuffer trees(&arena_);
+        Flush flush = [this, perWorker, &consumers, &queues, &stopping, worker](TreeBuffer& full) {
+            if (stopping.load(std::memory_order_acquire)) {
+                return;
+            }
+            if (perWorker) {
+                deliver(consumers[worker], full);
+                return;
+            }
+            for (auto& tree : full) {
+                queues[worker]->push(std::move(tree));
+            }
+        };
+        try {
+            {
+                PhaseScope phase(Phase::Combinations);
+                generateCombinations(partition, options, 0, begin, end, m, current, trees, &flush);
+            }
+            if (auto* stats = threadStats()) {
+                stats->candidates += trees.size();
+            }
+            flush(trees);
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    };
+
+    std::vector<TaskPool::Task> tasks;
+    tasks.reserve(selected.size());
+    for (size_t idx : selected) {
+        tasks.emplace_back([&, idx, maxThreads](size_t worker) {
+            Partition partition = allPartitions[idx];
+            Tree::ArenaScope scope(&arena_);
+            auto options = std::make_shared<std::vector<ChildOptions>>();
+            bool feasible = false;
+            if (!stopping.load(std::memory_order_acquire)) {
+                try {
+                    feasible = collectChildOptions(partition, m, *options);
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+            }
+            if (feasible) {
+                // Upper bound on the combinations this partition enumerates
+                size_t work = 1;
+                for (const auto& option : *options) {
+                    work = (work > kSplitThreshold) ? work : work * option.trees.size();
+                }
 
-                // Always show progress, even if tree count is 0 (still computing)
-                if (currentCount > 0) {
-                    // Calculate overall rate
-                    double overallRate = elapsed > 0 ? static_cast<double>(currentCount) / elapsed : 0.0;
+                size_t firstCount = options->front().trees.size();
+                size_t chunks = (work > kSplitThreshold) ? std::min(firstCount, maxThreads * 4) : 1;
+                size_t chunkSize = (firstCount + chunks - 1) / chunks;
 
-                    std::cout << std::format("\rProgress: {} trees | {}s elapsed | {:.0f} trees/s | Partitions: {}/{}",
-                                            currentCount, elapsed, overallRate, completed, totalPartitions)
-                              << std::flush;
-                } else if (completed > 0 || elapsed > 0) {
-                    // Show partition progress even when no trees counted yet
-                    std::cout << std::format("\rComputing... {}s elapsed | Partitions: {}/{}",
-                                            elapsed, completed, totalPartitions)
-                              << std::flush;
+                // The partition is done when its last chunk is, on whichever
+                // worker that chunk runs
+                auto outstanding = std::make_shared<std::atomic<size_t>>((firstCount + chunkSize - 1) / chunkSize);
+                auto chunkDone = [this, outstanding] {
+                    if (outstanding->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        partitionsDone_.fetch_add(1, std::memory_order_relaxed);
+                    }
+                };
+
+                // Hand all but the first chunk to the pool; thieves take them FIFO
+                for (size_t begin = chunkSize; begin < firstCount; begin += chunkSize) {
+                    size_t end = std::min(begin + chunkSize, firstCount);
+                    pool.submit([&, idx, options, chunkDone, begin, end](size_t w) {
+                        emitRange(allPartitions[idx], *options, begin, end, w);
+                        chunkDone();
+                    });
                 }
+                emitRange(partition, *options, 0, std::min(chunkSize, firstCount), worker);
+                chunkDone();
+            } else {
+                partitionsDone_.fetch_add(1, std::memory_order_relaxed);
             }
         });
+    }
 
-        // progressThread stops and joins here when scope exits
+    if (perWorker) {
+        pool.start(std::move(tasks));
+        pool.wait();
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+        return count_;
     }
 
-    // Collect results with global deduplication
-    std::set<std::string> seenGlobal;
-    for (auto& trees : threadResults) {
-            for (auto& tree : trees) {
-                tree.sortToCanonical();
-                std::string repr = tree.toString();
-            if (seenGlobal.find(repr) == seenGlobal.end()) {
-                seenGlobal.insert(repr);
-                invokeCallback(tree, callback);
+    // The last task to finish closes every queue, ending the drain loop below
+    pool.start(std::move(tasks), [&queues] {
+        for (auto& queue : queues) {
+            queue->close();
+        }
+    });
+
+    // Drain the worker queues on the calling thread until every task is done,
+    // handing over what each queue holds as one batch
+    TreeBuffer batch(&arena_);
+    batch.reserve(kStreamQueueDepth);
+    Tree tree;
+    try {
+        while (true) {
+            std::uint64_t observed = readySignal.load(std::memory_order_acquire);
+            bool progressed = false;
+            bool allDrained = true;
+            for (auto& queue : queues) {
+                while (batch.size() < kStreamQueueDepth && queue->tryPop(tree)) {
+                    batch.push_back(std::move(tree));
+                }
+                if (!batch.empty()) {
+                    deliver(consumer, batch);
+                    batch.clear();
+                    progressed = true;
+                }
+                allDrained = allDrained && queue->drained();
+            }
+            if (allDrained) {
+                break;
             }
+            if (!progressed) {
+                readySignal.wait(observed, std::memory_order_acquire);
+            }
+        }
+    } catch (...) {
+        // Producers blocked on a full queue would otherwise wait forever
+        fail(std::current_exception());
+        for (auto& queue : queues) {
+            queue->cancel();
         }
     }
 
-    // Clear the progress line
-    std::cout << "\r" << std::string(100, ' ') << "\r" << std::flush;
+    pool.wait();
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
 
     return count_;
 }
 
-void TreeGenerator::generatePartitions(
-    size_t n,
-    size_t k,
-    std::vector<size_t>& current,
-    std::vector<std::vector<size_t>>& result) {
+void TreeGenerator::clearCache() {
+    // Interned trees may live in the arena, so drop them first
+    store_.reset(0, 0);
+    arena_.release();
+}
 
-    if (n == 0) {
-        result.push_back(current);
-        return;
+TreeCount TreeGenerator::count(size_t n, size_t m) {
+    return TreeCounter(n, m).atMost(n, m);
+}
+
+size_t TreeGenerator::generateLevelSequences(size_t n, size_t m, BatchCallback& consumer) {
+    // Trees are buffered so the consumer is called once per batch, not per tree
+    TreeBuffer batch(&arena_);
+    batch.reserve(kStreamQueueDepth);
+    for (TreeEnumerator it(n, m); it.valid(); it.next()) {
+        batch.push_back(it.tree());
+        if (batch.size() == kStreamQueueDepth) {
+            deliver(consumer, batch);
+            batch.clear();
+        }
     }
+    deliver(consumer, batch);
+    return count_;
+}
 
-    if (k == 0) {
-        return;
+size_t TreeGenerator::generateSlice(size_t n, size_t m, const Slice& slice, BatchCallback& consumer) {
+    if (n == 0 || m == 0) {
+        return 0;
     }
+    TreeCounter counter(n, std::min(m, n), TreeCounter::Tables::Ranking);
+    TreeCount total = counter.atMost(n, m);
+    if (slice.start >= total) {
+        return 0;
+    }
+    TreeCount end = slice.start + std::min(slice.length, total - slice.start);
+
+    // Neighbouring trees mostly share root children, so each child subtree is
+    // unranked once and reused until the memo is flushed
+    std::map<std::tuple<size_t, size_t, TreeCount>, Tree> subtrees;
+    std::vector<const Tree*> current;
+    TreeBuffer batch(&arena_);
+    batch.reserve(kStreamQueueDepth);
+
+    // Trees are ordered by leaf count first; find the cell holding `start`
+    size_t k = 1;
+    TreeCount cellStart = 0;
+    for (TreeCount index = slice.start; index < end; ++index) {
+        while (index - cellStart >= counter.exact(n, k)) {
+            cellStart += counter.exact(n, k);
+            ++k;
+        }
 
-    // Determine minimum value to maintain non-increasing order
-    size_t minVal = current.empty() ? 1 : 1;
-    size_t maxVal = current.empty() ? n : std::min(n, current.back());
+        current.clear();
+        for (const TreeCounter::Child& child : counter.unrankChildren(n, k, index - cellStart)) {
+            auto key = std::make_tuple(child.nodes, child.leaves, child.index);
+            auto it = subtrees.find(key);
+            if (it == subtrees.end()) {
+                it = subtrees.emplace(key, counter.unrankExact(child.nodes, child.leaves, child.index)).first;
+            }
+            current.push_back(&it->second);
+        }
+        batch.push_back(Tree::fromCanonicalChildren(current));
 
-    for (size_t i = minVal; i <= maxVal; ++i) {
-        current.push_back(i);
-        generatePartitions(n - i, k - 1, current, result);
-        current.pop_back();
+        if (batch.size() == kStreamQueueDepth) {
+            deliver(consumer, batch);
+            batch.clear();
+            if (subtrees.size() > kStreamQueueDepth * 16) {
+                subtrees.clear();
+            }
+        }
     }
+    deliver(consumer, batch);
+    return count_;
 }
 
 void TreeGenerator::prewarmCache(size_t maxN, size_t maxM) {
-    // Pre-generate all small subtrees to populate shared cache
+    if (!cacheFilePath_.empty() && (!cacheFile_ || !cacheFile_->covers(maxN, maxM))) {
+        cacheFile_ = SubtreeCacheFile::open(cacheFilePath_);
+    }
+
+    // Pre-generate small subtrees at the run's leaf limit (the only cells the
+    // workers read) so they start on a populated shared store
     for (size_t n = 1; n <= maxN; ++n) {
-        for (size_t m = 1; m <= maxM; ++m) {
-            std::vector<Tree> dummy;
-            generateTreesRecursive(n, m, dummy, cache_);
-        }
+        generateTreesRecursive(n, maxM);
     }
-}
 
-void TreeGenerator::generateTreesRecursive(size_t n, size_t maxLeaves, std::vector<Tree>& results,
-                                           std::vector<std::vector<std::vector<Tree>>>& localCache) {
-    // Check cache first (lock-free with per-thread cache)
-    if (!localCache[n][maxLeaves].empty()) {
-        results = localCache[n][maxLeaves];
+    if (cacheFilePath_.empty() || maxN == 0 || (cacheFile_ && cacheFile_->covers(maxN, maxM))) {
         return;
     }
 
-    results.clear();
+    // Save the cells for the next run, split by exact leaf count so the file
+    // also serves any smaller leaf limit. An existing file's range is kept:
+    // its cells are read back from the mapping, so a shallower run never
+    // shrinks a deeper file.
+    size_t fileNodes = maxN;
+    size_t fileLeaves = std::min(maxM, std::max(maxN - 1, size_t(1)));
+    if (cacheFile_) {
+        fileNodes = std::max(fileNodes, cacheFile_->maxNodes());
+        fileLeaves = std::max(fileLeaves, cacheFile_->maxLeaves());
+        store_.grow(fileNodes, fileLeaves);
+    }
+    try {
+        SubtreeCacheFile::write(cacheFilePath_, fileNodes, fileLeaves, [this, fileLeaves](size_t n, size_t leaves) {
+            std::vector<const Tree*> trees;
+            for (const Tree* tree : generateTreesRecursive(n, fileLeaves)) {
+                if (tree->getLeafCount() == leaves) {
+                    trees.push_back(tree);
+                }
+            }
+            return trees;
+        });
+        cacheFile_ = SubtreeCacheFile::open(cacheFilePath_);
+    } catch (const std::system_error& e) {
+        std::cerr << std::format("Warning: subtree cache not saved: {}\n", e.what());
+    }
+}
+
+const SubtreeStore::Cell& TreeGenerator::generateTreesRecursive(size_t n, size_t maxLeaves) {
+    // An n-node tree has at most n-1 leaves, so larger limits share one cell
+    size_t leaves = std::min(maxLeaves, n <= 1 ? n : n - 1);
 
-    // Base case: single node (leaf)
-    if (n == 1) {
-        if (maxLeaves >= 1) {
-            results.push_back(Tree());
+    // Published cells are read lock-free
+    GenerationStats* stats = threadStats();
+    if (const auto* cell = store_.find(n, leaves)) {
+        if (stats) {
+            ++stats->cacheHits;
         }
-        localCache[n][maxLeaves] = results;
-        return;
+        return *cell;
     }
 
-    // Try all possible ways to partition n-1 nodes among children
-    // (n-1 because root takes 1 node)
-    size_t remainingNodes = n - 1;
-
-    // Sequential processing - no nested parallelization to avoid race conditions
-    for (size_t numChildren = 1; numChildren <= remainingNodes; ++numChildren) {
-        // Generate all partitions of remainingNodes into numChildren parts
-        std::vector<std::vector<size_t>> partitions;
-        std::vector<size_t> current;
-        generatePartitions(remainingNodes, numChildren, current, partitions);
-
-        for (auto& partition : partitions) {
-            // Sort partition in descending order for canonical form
-            std::sort(partition.begin(), partition.end(), std::greater<size_t>());
-
-            // For each partition, generate all possible tree combinations
-            std::vector<std::vector<Tree>> childTreeOptions(partition.size());
-
-            bool validPartition = true;
-            for (size_t i = 0; i < partition.size(); ++i) {
-                // Each child subtree can have at most maxLeaves leaves
-                generateTreesRecursive(partition[i], maxLeaves, childTreeOptions[i], localCache);
-                if (childTreeOptions[i].empty()) {
-                    validPartition = false;
-                    break;
+    // A cell with a higher leaf limit (from this or an earlier run) already
+    // holds every tree we need: filter it instead of regenerating
+    if (const auto* wider = store_.findSuperset(n, leaves)) {
+        return store_.getOrBuild(n, leaves, [stats, wider, leaves] {
+            if (stats) {
+                ++stats->cacheFiltered;
+            }
+            SubtreeStore::Cell cell;
+            for (const Tree* tree : *wider) {
+                if (tree->getLeafCount() <= leaves) {
+                    cell.push_back(tree);
                 }
             }
+            return cell;
+        });
+    }
 
-            if (!validPartition) {
-                continue;
+    // Cells in the cache file are copied out of the mapping
+    if (cacheFile_ && cacheFile_->covers(n, leaves)) {
+        return store_.getOrBuild(n, leaves, [this, stats, n, leaves] {
+            if (stats) {
+                ++stats->cacheFileLoads;
+            }
+            std::vector<Tree> trees;
+            for (size_t exact = 1; exact <= leaves; ++exact) {
+                cacheFile_->appendCell(n, exact, trees);
             }
+            return trees;
+        });
+    }
 
-            // Generate all combinations of children
-            std::vector<Tree> currentChildren;
-            generateCombinations(partition, maxLeaves, childTreeOptions, 0, currentChildren, results);
+    // A missing cell is built exactly once
+    maxLeaves = leaves;
+    return store_.getOrBuild(n, maxLeaves, [this, stats, n, maxLeaves] {
+        if (stats) {
+            ++stats->cacheMisses;
         }
+        std::vector<Tree> results;
+
+        // Base case: single node (leaf)
+        if (n == 1) {
+            if (maxLeaves >= 1) {
+                results.push_back(Tree());
+            }
+            return results;
+        }
+
+        // Try all possible ways to partition n-1 nodes among children
+        // (n-1 because root takes 1 node); parts come in non-increasing order
+        size_t remainingNodes = n - 1;
+        const PartitionTable::List& partitions = [&]() -> const PartitionTable::List& {
+            PhaseScope phase(Phase::Partitions);
+            return partitions_.get(remainingNodes, remainingNodes);
+        }();
+
+        TreeBuffer partitionTrees(&arena_);
+        for (size_t idx = 0; idx < partitions.size(); ++idx) {
+            generatePartitionTrees(partitions[idx], maxLeaves, partitionTrees);
+            results.insert(results.end(), std::make_move_iterator(partitionTrees.begin()),
+                           std::make_move_iterator(partitionTrees.end()));
+        }
+        return results;
+    });
+}
+
+bool TreeGenerator::collectChildOptions(
+    Partition partition,
+    size_t maxLeaves,
+    std::vector<ChildOptions>& options) {
+
+    PhaseScope phase(Phase::ChildOptions);
+    GenerationStats* stats = threadStats();
+
+    // Every child contributes at least one leaf
+    options.clear();
+    if (partition.size() > maxLeaves) {
+        if (stats) {
+            ++stats->infeasiblePartitions;
+        }
+        return false;
     }
+    size_t childLimit = maxLeaves - (partition.size() - 1);
+
+    options.reserve(partition.size());
+    for (size_t i = 0; i < partition.size(); ++i) {
+        const auto& cell = generateTreesRecursive(partition[i], childLimit);
+        if (cell.empty()) {
+            if (stats) {
+                ++stats->infeasiblePartitions;
+            }
+            return false;
+        }
 
-    // Remove duplicates and ensure canonical form
-    std::vector<std::string> seen;
-    std::vector<Tree> uniqueResults;
+        // Counting sort by leaf count; order within a bucket is irrelevant
+        // because equal-sized positions all share the same order
+        ChildOptions& option = options.emplace_back(&arena_);
+        option.bucketEnd.assign(childLimit + 1, 0);
+        for (const Tree* tree : cell) {
+            ++option.bucketEnd[tree->getLeafCount()];
+        }
+        for (size_t l = 1; l <= childLimit; ++l) {
+            option.bucketEnd[l] += option.bucketEnd[l - 1];
+        }
 
-    for (auto& tree : results) {
-        tree.sortToCanonical();
-        std::string repr = tree.toString();
-        if (std::find(seen.begin(), seen.end(), repr) == seen.end()) {
-            seen.push_back(repr);
-            uniqueResults.push_back(tree);
+        std::pmr::vector<size_t> next(option.bucketEnd.begin(), option.bucketEnd.end() - 1, &arena_);
+        option.trees.resize(cell.size());
+        for (const Tree* tree : cell) {
+            option.trees[next[tree->getLeafCount() - 1]++] = tree;
         }
+        option.minLeaves = option.trees.front()->getLeafCount();
     }
 
-    results = uniqueResults;
-    localCache[n][maxLeaves] = results;
+    // Each position must leave its successors their minimum
+    size_t reserved = 0;
+    for (size_t i = options.size(); i-- > 0;) {
+        options[i].reservedLeaves = reserved;
+        reserved += options[i].minLeaves;
+    }
+    if (reserved > maxLeaves) {
+        if (stats) {
+            ++stats->infeasiblePartitions;
+        }
+        return false;
+    }
+    return true;
 }
 
-void TreeGenerator::generateCombinations(
-    const std::vector<size_t>& partition,
+void TreeGenerator::generatePartitionTrees(
+    Partition partition,
     size_t maxLeaves,
-    const std::vector<std::vector<Tree>>& childTrees,
+    TreeBuffer& results,
+    const Flush* flush) {
+
+    results.clear();
+
+    std::vector<ChildOptions> childTreeOptions;
+    if (!collectChildOptions(partition, maxLeaves, childTreeOptions)) {
+        return;
+    }
+
+    // Each child multiset is produced exactly once, so no deduplication pass is needed
+    TreeRefs currentChildren(&arena_);
+    {
+        PhaseScope phase(Phase::Combinations);
+        generateCombinations(partition, childTreeOptions, 0, 0, childTreeOptions.front().trees.size(),
+                             maxLeaves, currentChildren, results, flush);
+    }
+    if (auto* stats = threadStats()) {
+        stats->candidates += results.size();
+    }
+}
+
+void TreeGenerator::generateCombinations(
+    Partition partition,
+    const std::vector<ChildOptions>& childTrees,
     size_t index,
-    std::vector<Tree>& current,
-    std::vector<Tree>& results) {
+    size_t optionBegin,
+    size_t optionEnd,
+    size_t leafBudget,
+    TreeRefs& current,
+    TreeBuffer& results,
+    const Flush* flush) {
 
     if (index == partition.size()) {
-        // Check if total leaf count is within limit
-        Tree candidate(current);
-        if (candidate.getLeafCount() <= maxLeaves) {
-            results.push_back(candidate);
+        // The budget kept every combination within the leaf limit, and the
+        // children are interned canonical trees
+        results.push_back(Tree::fromCanonicalChildren(current));
+        if (flush && results.size() >= flushTrees_) {
+            if (auto* stats = threadStats()) {
+                stats->candidates += results.size();
+            }
+            (*flush)(results);
+            results.clear();
         }
         return;
     }
 
-    // Try all possible trees for the current child position
-    for (const auto& tree : childTrees[index]) {
-        current.push_back(tree);
-
-        // Early pruning: check if current combination already exceeds leaf limit
-        size_t currentLeaves = 0;
-        for (const auto& child : current) {
-            currentLeaves += child.getLeafCount();
+    // Only leaf counts that leave the later positions their minimum are tried;
+    // the options past that bucket are skipped as one range
+    const ChildOptions& options = childTrees[index];
+    size_t maxOwn = leafBudget - options.reservedLeaves;
+    size_t budgetEnd = std::min(optionEnd, options.upTo(maxOwn));
+    if (budgetEnd < optionEnd) {
+        if (auto* stats = threadStats()) {
+            stats->leafPrunedOptions += optionEnd - budgetEnd;
         }
+    }
+    optionEnd = budgetEnd;
+
+    for (size_t leaves = options.minLeaves; leaves <= maxOwn; ++leaves) {
+        size_t begin = std::max(optionBegin, options.bucketEnd[leaves - 1]);
+        size_t end = std::min(optionEnd, options.bucketEnd[leaves]);
+        for (size_t option = begin; option < end; ++option) {
+            current.push_back(options.trees[option]);
+
+            // Equal-sized neighbours draw from the same cell; keeping their
+            // option indices non-increasing visits each multiset only once
+            size_t next = index + 1;
+            size_t nextEnd = 0;
+            if (next < partition.size()) {
+                nextEnd = (partition[next] == partition[index]) ? option + 1 : childTrees[next].trees.size();
+            }
+            generateCombinations(partition, childTrees, next, 0, nextEnd, leafBudget - leaves,
+                                 current, results, flush);
 
-        if (currentLeaves <= maxLeaves) {
-            generateCombinations(partition, maxLeaves, childTrees, index + 1, current, results);
+            current.pop_back();
+        }
+        if (end == optionEnd) {
+            break;
         }
-
-        current.pop_back();
     }
 }
 
-void TreeGenerator::invokeCallback(const Tree& tree, TreeCallback& callback) {
-    if (callback) {
-        std::lock_guard<std::mutex> lock(callback_mutex_);
-        callback(tree);
-        ++count_;
+void TreeGenerator::deliver(BatchCallback& consumer, std::span<const Tree> batch) {
+    if (consumer && !batch.empty()) {
+        PhaseScope phase(Phase::Callback);
+        // Copies the consumer keeps must outlive the arena, which the next
+        // run, clearCache() and the destructor release
+        Tree::ArenaScope callerScope(callerResource_);
+        consumer(batch);
+        count_.fetch_add(batch.size(), std::memory_order_relaxed);
     }
 }
 
@@ -0,0 +1,100 @@
+#include "tree_hash_set.h"
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace vinci {
+
+namespace {
+    // Keep the table at most half full so probe chains stay short
+    size_t slotCountFor(size_t expectedSize) {
+        return std::bit_ceil(std::max(expectedSize * 2, size_t(16)));
+    }
+}
+
+TreeHashSet::TreeHashSet(size_t expectedSize)
+    : slots_(slotCountFor(expectedSize), Slot{0, kEmpty}),
+      mask_(slots_.size() - 1) {
+    trees_.reserve(expectedSize);
+}
+
+size_t TreeHashSet::findSlot(const Tree& tree, std::uint64_t hash) const {
+    size_t pos = hash & mask_;
+    while (true) {
+        const Slot& slot = slots_[pos];
+        if (slot.index == kEmpty) {
+            return pos;
+        }
+        // Fingerprints can collide; confirm with a structural comparison
+        if (slot.hash == hash && trees_[slot.index] == tree) {
+            return pos;
+        }
+        pos = (pos + 1) & mask_;
+    }
+}
+
+bool TreeHashSet::insert(const Tree& tree) {
+    std::uint64_t hash = tree.getHash();
+    size_t pos = findSlot(tree, hash);
+    if (slots_[pos].index != kEmpty) {
+        return false;
+    }
+
+    slots_[pos] = Slot{hash, static_cast<std::uint32_t>(trees_.size())};
+    trees_.push_back(tree);
+
+    if (trees_.size() * 2 > slots_.size()) {
+        grow();
+    }
+    return true;
+}
+
+bool TreeHashSet::insert(Tree&& tree) {
+    std::uint64_t hash = tree.getHash();
+    size_t pos = findSlot(tree, hash);
+    if (slots_[pos].index != kEmpty) {
+        return false;
+    }
+
+    slots_[pos] = Slot{hash, static_cast<std::uint32_t>(trees_.size())};
+    trees_.push_back(std::move(tree));
+
+    if (trees_.size() * 2 > slots_.size()) {
+        grow();
+    }
+    return true;
+}
+
+bool TreeHashSet::contains(const Tree& tree) const {
+    return slots_[findSlot(tree, tree.getHash())].index != kEmpty;
+}
+
+void TreeHashSet::grow() {
+    std::vector<Slot> old(slots_.size() * 2, Slot{0, kEmpty});
+    old.swap(slots_);
+    mask_ = slots_.size() - 1;
+
+    for (const Slot& slot : old) {
+        if (slot.index == kEmpty) {
+            continue;
+        }
+        size_t pos = slot.hash & mask_;
+        while (slots_[pos].index != kEmpty) {
+            pos = (pos + 1) & mask_;
+        }
+        slots_[pos] = slot;
+    }
+}
+
+std::vector<Tree> TreeHashSet::release() {
+    std::vector<Tree> result = std::move(trees_);
+    clear();
+    return result;
+}
+
+void TreeHashSet::clear() {
+    trees_.clear();
+    std::fill(slots_.begin(), slots_.end(), Slot{0, kEmpty});
+}
+
+} // namespace vinci
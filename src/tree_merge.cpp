@@ -0,0 +1,157 @@
+#include "tree_generator.h"
+#include "tree_hash_set.h"
+#include "tree_sink.h"
+#include <iostream>
+#include <format>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace vinci;
+
+// Merge and verify the outputs of a sharded run (tree_generation --shard=i/k)
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cout << "Usage: " << argv[0] << " <N> <M> [--format=<text|levels|parens>] [--output=<file>] [--unique]\n"
+                  << "       <shard file>...\n\n";
+        std::cout << "Check that the shard files of an (N, M) run hold exactly the full set of trees.\n\n";
+        std::cout << "Arguments:\n";
+        std::cout << "  N         Number of nodes the shards were generated for\n";
+        std::cout << "  M         Maximum number of leaf nodes the shards were generated for\n";
+        std::cout << "  --format  Optional: record format of every shard file (default: levels)\n";
+        std::cout << "  --output  Optional: also concatenate the shards into this file\n";
+        std::cout << "  --unique  Optional: also check no tree appears twice (keeps every tree in memory)\n\n";
+        std::cout << "Every tree must have N nodes, at most M leaves and be canonical, and the\n"
+                  << "shard counts must add up to the exact count for (N, M). A record that is\n"
+                  << "not a well-formed tree stops its file with an error.\n\n";
+        std::cout << "Example:\n";
+        std::cout << "  " << argv[0] << " 22 8 --format=parens shard0.bin shard1.bin shard2.bin\n";
+        return 1;
+    }
+
+    size_t n = std::stoull(argv[1]);
+    size_t m = std::stoull(argv[2]);
+    OutputFormat format = OutputFormat::Levels;
+    std::string outputPath;
+    bool checkUnique = false;
+    std::vector<std::string> shardFiles;
+
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.starts_with("--format=")) {
+            auto parsed = TreeSink::parseFormat(arg.substr(9));
+            if (!parsed) {
+                std::cerr << std::format("Unknown output format: {}\n", arg.substr(9));
+                return 1;
+            }
+            format = *parsed;
+        } else if (arg.starts_with("--output=")) {
+            outputPath = arg.substr(9);
+        } else if (arg == "--unique") {
+            checkUnique = true;
+        } else if (arg.starts_with("--")) {
+            std::cerr << std::format("Unknown option: {}\n", arg);
+            return 1;
+        } else {
+            shardFiles.push_back(arg);
+        }
+    }
+    if (shardFiles.empty()) {
+        std::cerr << "Error: no shard files given\n";
+        return 1;
+    }
+
+    TreeCount expected;
+    try {
+        expected = TreeGenerator::count(n, m);
+    } catch (const std::overflow_error& e) {
+        std::cerr << std::format("Error: {}\n", e.what());
+        return 1;
+    }
+
+    int outputFd = -1;
+    std::unique_ptr<TreeSink> sink;
+    if (!outputPath.empty()) {
+        outputFd = ::open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (outputFd < 0) {
+            std::cerr << std::format("Error: cannot open {}\n", outputPath);
+            return 1;
+        }
+        sink = std::make_unique<TreeSink>(outputFd, format);
+    }
+
+    TreeHashSet seen;
+    size_t invalid = 0;
+    size_t duplicates = 0;
+    TreeCount total = 0;
+    bool failed = false;
+
+    for (const auto& path : shardFiles) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << std::format("Error: cannot open {}\n", path);
+            failed = true;
+            continue;
+        }
+
+        // Counted as they arrive, so a file cut off by a malformed record
+        // still reports the trees before it
+        size_t records = 0;
+        try {
+            TreeSink::read(fd, format, [&](const Tree& tree) {
+                ++records;
+                Tree canonical = tree;
+                canonical.sortToCanonical();
+                if (tree.getNodeCount() != n || tree.getLeafCount() > m || canonical != tree) {
+                    ++invalid;
+                } else if (checkUnique && !seen.insert(tree)) {
+                    ++duplicates;
+                }
+                if (sink) {
+                    sink->write(tree);
+                }
+            });
+        } catch (const std::exception& e) {
+            std::cerr << std::format("Error: {}: {}\n", path, e.what());
+            failed = true;
+        }
+        ::close(fd);
+
+        std::cout << std::format("{}: {} trees\n", path, records);
+        total += records;
+    }
+
+    if (sink) {
+        try {
+            sink->flush();
+        } catch (const std::system_error& e) {
+            std::cerr << std::format("Error: {}\n", e.what());
+            failed = true;
+        }
+        ::close(outputFd);
+    }
+
+    std::cout << std::string(60, '=') << "\n";
+    std::cout << std::format("Shard total: {}\n", countToString(total));
+    std::cout << std::format("Expected for N={}, M={}: {}\n", n, m, countToString(expected));
+    if (invalid > 0) {
+        std::cout << std::format("Invalid trees: {}\n", invalid);
+    }
+    if (duplicates > 0) {
+        std::cout << std::format("Duplicate trees: {}\n", duplicates);
+    }
+
+    bool ok = !failed && invalid == 0 && duplicates == 0 && total == expected;
+    if (!ok) {
+        std::cout << "MISMATCH\n";
+    } else {
+        std::cout << (checkUnique ? "OK: shards cover every tree exactly once\n"
+                                  : "OK: shard counts add up to the total\n");
+    }
+    return ok ? 0 : 1;
+}
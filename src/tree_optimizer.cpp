@@ -1,6 +1,7 @@
 #include "tree_optimizer.h"
+#include "partition_table.h"
 #include <algorithm>
-#include <set>
+#include <iterator>
 #include <map>
 #include <thread>
 #include <future>
@@ -9,36 +10,100 @@
 #include <iostream>
 #include <format>
 #include <chrono>
+#include <exception>
+#include <memory>
+#include <memory_resource>
 
 namespace vinci {
 
+namespace {
+    // Highest leaf count an n-node tree can have
+    size_t maxLeavesFor(size_t n) {
+        return n <= 1 ? n : n - 1;
+    }
+
+    // Persistent workers for buildCacheParallel calls that bring no pool
+    std::mutex sharedPoolMutex;
+
+    TaskPool& sharedPool() {
+        static TaskPool pool([] {
+            size_t cores = std::thread::hardware_concurrency();
+            return cores == 0 ? size_t(4) : cores;
+        }());
+        return pool;
+    }
+}
+
 size_t TreeOptimizer::generateAllWithCallback(
     size_t n,
     size_t maxM,
     const TreeCallback& callback,
     bool showProgress) {
 
-    // Build cache in parallel up to (n, maxM)
-    std::vector<std::vector<std::vector<Tree>>> cache(n + 1,
-        std::vector<std::vector<Tree>>(maxM + 1));
+    return generateAllInBatches(n, maxM, [&callback](std::span<const Tree> batch) {
+        for (const Tree& tree : batch) {
+            callback(tree);
+        }
+    }, showProgress);
+}
+
+size_t TreeOptimizer::generateAllInBatches(
+    size_t n,
+    size_t maxM,
+    const BatchCallback& consumer,
+    bool showProgress) {
+
+    return generateAllInBatches(n, maxM, GenerationConstraints{}, consumer, showProgress);
+}
+
+size_t TreeOptimizer::generateAllInBatches(
+    size_t n,
+    size_t maxM,
+    const GenerationConstraints& constraints,
+    const BatchCallback& consumer,
+    bool showProgress,
+    TaskPool* pool) {
+
+    if (constraints.limitsShape()) {
+        return generateConstrained(n, maxM, constraints, consumer);
+    }
+
+    // Every tree built for this call dies with the cache, so heap spills come
+    // from one pooled arena that is released in bulk on return (declared
+    // first so it outlives the cache)
+    std::pmr::synchronized_pool_resource arena;
+    std::pmr::memory_resource* callerResource = Tree::heapResource();
+    Tree::ArenaScope arenaScope(&arena);
+
+    // Build cache in parallel for every (nodes, leaves) cell below n; the
+    // n-node cells are generated one leaf count at a time, streamed to the
+    // callback and dropped, so they are never all held at once. Exact-leaf
+    // cells never share a tree, so the store skips the duplicate lookup.
+    size_t cacheLeaves = std::min(maxM, maxLeavesFor(n));
+    SubtreeStore cells(n > 0 ? n - 1 : 0, cacheLeaves, SubtreeStore::Interning::Append);
 
     if (showProgress) {
         std::cout << "Building cache for N=" << n << ", M=" << maxM << "...\n" << std::flush;
     }
 
-    buildCacheParallel(n, maxM, cache);
+    if (n > 1) {
+        buildCacheParallel(n - 1, cacheLeaves, cells, pool);
+    }
 
     if (showProgress) {
         std::cout << "\r" << std::string(100, ' ') << "\rCache built. Generating trees...\n" << std::flush;
     }
 
-    // Now iterate through all cached results and call callback
     size_t totalCount = 0;
-    for (size_t leafCount = 1; leafCount <= maxM; ++leafCount) {
-        const auto& trees = cache[n][leafCount];
-        for (const auto& tree : trees) {
-            callback(tree);
-            ++totalCount;
+    for (size_t leafCount = std::max(constraints.minLeaves, size_t(1)); leafCount <= cacheLeaves; ++leafCount) {
+        std::vector<Tree> trees;
+        generateWithExactLeavesGeneric(n, leafCount, trees, cells);
+
+        if (!trees.empty()) {
+            // Copies the consumer keeps must not spill into the arena
+            Tree::ArenaScope callerScope(callerResource);
+            consumer(trees);
+            totalCount += trees.size();
         }
     }
 
@@ -48,356 +113,288 @@ size_t TreeOptimizer::generateAllWithCallback(
 void TreeOptimizer::buildCacheParallel(
     size_t maxN,
     size_t maxK,
-    std::vector<std::vector<std::vector<Tree>>>& cache) {
-
-    size_t numCores = std::thread::hardware_concurrency();
-    if (numCores == 0) numCores = 4;
-
-    // Build cache level by level (k=1, then k=2, etc.)
-    for (size_t leafCount = 1; leafCount <= maxK; ++leafCount) {
-        if (leafCount <= 4) {
-            // Use specialized algorithms (fast enough single-threaded)
-            for (size_t nodeCount = leafCount; nodeCount <= maxN; ++nodeCount) {
-                if (leafCount == 1) {
-                    generateSingleLeaf(nodeCount, cache[nodeCount][leafCount]);
-                } else if (leafCount == 2) {
-                    generateTwoLeaves(nodeCount, cache[nodeCount][leafCount]);
-                } else if (leafCount == 3) {
-                    generateThreeLeaves(nodeCount, cache[nodeCount][leafCount]);
-                } else if (leafCount == 4) {
-                    generateFourLeaves(nodeCount, cache[nodeCount][leafCount]);
-                }
-            }
-        } else {
-            // Parallel processing with larger batch sizes for better efficiency
-            std::vector<std::jthread> threads;
-            std::vector<std::vector<std::pair<size_t, std::vector<Tree>>>> threadResults(numCores);
-
-            size_t totalWork = maxN - leafCount + 1;
-            // Larger batches = less synchronization, better CPU utilization
-            size_t batchSize = std::max(size_t(2), totalWork / numCores);
-            std::atomic<size_t> workIndex{leafCount};
-
-            for (size_t t = 0; t < numCores; ++t) {
-                threads.emplace_back(
-                    [&cache, &threadResults, t, leafCount, maxN, batchSize, &workIndex](std::stop_token stoken) {
-                        while (!stoken.stop_requested()) {
-                            size_t startN = workIndex.fetch_add(batchSize, std::memory_order_relaxed);
-                            if (startN > maxN) break;
-
-                            size_t endN = std::min(startN + batchSize - 1, maxN);
-
-                            for (size_t nodeCount = startN; nodeCount <= endN; ++nodeCount) {
-                                std::vector<Tree> results;
-                                generateWithExactLeavesGeneric(
-                                    nodeCount, leafCount, results, cache);
-                                threadResults[t].emplace_back(nodeCount, std::move(results));
-                            }
-                        }
-                    });
-            }
+    SubtreeStore& cells,
+    TaskPool* pool) {
 
-            // Wait for all threads (RAII auto-joins)
-            threads.clear();
-
-            // Collect results from all threads
-            for (auto& results : threadResults) {
-                for (auto& [nodeCount, trees] : results) {
-                    cache[nodeCount][leafCount] = std::move(trees);
-                }
-            }
-        }
+    if (maxN == 0 || maxK == 0) {
+        return;
     }
-}
+    cells.grow(maxN, maxK);
 
-void TreeOptimizer::generateWithExactLeaves(size_t n, size_t k, std::vector<Tree>& results) {
-    results.clear();
-
-    if (k == 0 || k > n) {
-        return;
+    // Calls without a pool share one persistent pool, one batch at a time
+    std::unique_lock<std::mutex> sharedLock;
+    if (!pool) {
+        sharedLock = std::unique_lock<std::mutex>(sharedPoolMutex);
+        pool = &sharedPool();
     }
 
-    // Use specialized algorithms for small k (faster)
-    if (k == 1) {
-        generateSingleLeaf(n, results);
-        return;
-    } else if (k == 2) {
-        generateTwoLeaves(n, results);
-        return;
-    } else if (k == 3) {
-        generateThreeLeaves(n, results);
-        return;
-    } else if (k == 4) {
-        generateFourLeaves(n, results);
-        return;
+    // Workers allocate from the caller's heap resource, which owns the cache
+    std::pmr::memory_resource* resource = Tree::heapResource();
+    auto limit = [maxK](size_t n) { return std::min(maxK, maxLeavesFor(n)); };
+
+    // Cell (n, k) reads cells (n-1, j <= k) and, through them, every smaller
+    // cell it can use. Each cell counts its unfinished (n-1, j) predecessors
+    // and is submitted by whichever predecessor finishes last, so a cell runs
+    // as soon as its inputs exist instead of waiting for a whole level. The
+    // counters only schedule: correctness rests on the store's publish-once
+    // cells, which would build a missing input rather than read it half-done.
+    std::vector<std::unique_ptr<std::atomic<size_t>[]>> pending(maxN + 1);
+    for (size_t n = 1; n <= maxN; ++n) {
+        pending[n] = std::make_unique<std::atomic<size_t>[]>(limit(n) + 1);
+        for (size_t k = 1; k <= limit(n); ++k) {
+            pending[n][k].store(n == 1 ? 0 : std::min(k, limit(n - 1)), std::memory_order_relaxed);
+        }
     }
 
-    // For k >= 5, use generic memoized approach
-    // Cache: cache[nodes][leaves] = vector of trees
-    std::vector<std::vector<std::vector<Tree>>> cache(n + 1,
-        std::vector<std::vector<Tree>>(k + 1));
-
-    // Build up from k=1 to k
-    for (size_t leafCount = 1; leafCount <= k; ++leafCount) {
-        for (size_t nodeCount = leafCount; nodeCount <= n; ++nodeCount) {
-            if (leafCount <= 4) {
-                // Use specialized algorithms for small leaf counts
-                if (leafCount == 1) {
-                    generateSingleLeaf(nodeCount, cache[nodeCount][leafCount]);
-                } else if (leafCount == 2) {
-                    generateTwoLeaves(nodeCount, cache[nodeCount][leafCount]);
-                } else if (leafCount == 3) {
-                    generateThreeLeaves(nodeCount, cache[nodeCount][leafCount]);
-                } else if (leafCount == 4) {
-                    generateFourLeaves(nodeCount, cache[nodeCount][leafCount]);
-                }
-            } else {
-                generateWithExactLeavesGeneric(nodeCount, leafCount,
-                    cache[nodeCount][leafCount], cache);
+    // The first failing cell is kept and rethrown here; its successors are
+    // never submitted, so the batch drains and wait() returns
+    std::mutex failureMutex;
+    std::exception_ptr failure;
+
+    std::function<void(size_t, size_t)> buildCell = [&](size_t n, size_t k) {
+        Tree::ArenaScope scope(resource);
+        try {
+            exactCell(n, k, cells);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            if (!failure) {
+                failure = std::current_exception();
             }
+            return;
         }
+        if (n == maxN) {
+            return;
+        }
+        for (size_t next = k; next <= limit(n + 1); ++next) {
+            if (pending[n + 1][next].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                pool->submit([&buildCell, n, next](size_t) { buildCell(n + 1, next); });
+            }
+        }
+    };
+
+    std::vector<TaskPool::Task> roots;
+    roots.emplace_back([&buildCell](size_t) { buildCell(1, 1); });
+    pool->start(std::move(roots));
+    pool->wait();
+    if (failure) {
+        std::rethrow_exception(failure);
     }
-
-    results = cache[n][k];
 }
 
-void TreeOptimizer::generateWithExactLeavesGeneric(
-    size_t n,
-    size_t k,
-    std::vector<Tree>& results,
-    std::vector<std::vector<std::vector<Tree>>>& cache) {
-
+void TreeOptimizer::generateWithExactLeaves(size_t n, size_t k, std::vector<Tree>& results) {
     results.clear();
-    std::set<std::string> seen;
 
-    if (k == 0 || k > n || n < k) {
+    if (k == 0 || k > maxLeavesFor(n)) {
         return;
     }
 
-    size_t remaining = n - 1; // Root accounts for 1 node
-
-    // Try all ways to partition k leaves among children
-    // Each child must have at least 1 leaf
-    for (size_t numChildren = 1; numChildren <= std::min(k, remaining); ++numChildren) {
-        // Partition k leaves into numChildren parts
-        std::vector<std::vector<size_t>> leafPartitions;
-        std::vector<size_t> currentLeafPart;
-        generateIntegerPartitions(k, numChildren, 1, currentLeafPart, leafPartitions);
-
-        for (const auto& leafPart : leafPartitions) {
-            // For each leaf partition, try all ways to distribute remaining nodes
-            // Each child needs at least as many nodes as leaves
-            std::vector<size_t> minNodes = leafPart; // Each child needs at least k_i nodes
-
-            size_t minRequired = 0;
-            for (size_t mn : minNodes) minRequired += mn;
-
-            if (remaining < minRequired) continue;
-
-            size_t extraNodes = remaining - minRequired;
-
-            // Distribute extraNodes among numChildren children
-            std::vector<std::vector<size_t>> nodeDistributions;
-            std::vector<size_t> currentNodeDist;
-            generateIntegerPartitions(extraNodes + numChildren, numChildren, 1,
-                currentNodeDist, nodeDistributions);
-
-            for (const auto& nodeDist : nodeDistributions) {
-                std::vector<size_t> childNodeCounts(numChildren);
-                bool valid = true;
-                for (size_t i = 0; i < numChildren; ++i) {
-                    childNodeCounts[i] = minNodes[i] + nodeDist[i] - 1;
-                    if (childNodeCounts[i] < leafPart[i]) {
-                        valid = false;
-                        break;
-                    }
-                }
+    // Cell table for every (nodes, leaves <= k) below n
+    SubtreeStore cells(n - 1, k, SubtreeStore::Interning::Append);
+    if (n > 1) {
+        buildCacheParallel(n - 1, k, cells);
+    }
+    generateWithExactLeavesGeneric(n, k, results, cells);
+}
 
-                if (!valid) continue;
+const SubtreeStore::Cell& TreeOptimizer::exactCell(size_t n, size_t k, SubtreeStore& cells) {
+    return cells.getOrBuild(n, k, [n, k, &cells] {
+        std::vector<Tree> trees;
+        generateWithExactLeavesGeneric(n, k, trees, cells);
+        return trees;
+    });
+}
 
-                // Generate all combinations of children
-                std::vector<std::vector<Tree>> childOptions(numChildren);
-                bool allValid = true;
+namespace {
+    // Child kind: (nodes, exact leaves)
+    using ChildType = std::pair<size_t, size_t>;
+
+    /**
+     * @brief Emit every tree whose root children have the given types
+     * Types are non-increasing, and positions of equal type take option
+     * indices in non-increasing order, so each multiset of children (and
+     * therefore each tree) is produced once.
+     */
+    void combineChildren(const std::vector<ChildType>& types,
+                         const std::vector<const SubtreeStore::Cell*>& cells, size_t index,
+                         size_t optionEnd, std::vector<const Tree*>& current, std::vector<Tree>& results) {
+        if (index == types.size()) {
+            results.push_back(Tree::fromCanonicalChildren(current));
+            return;
+        }
 
-                for (size_t i = 0; i < numChildren; ++i) {
-                    size_t childNodes = childNodeCounts[i];
-                    size_t childLeaves = leafPart[i];
+        const auto& options = *cells[index];
+        for (size_t option = 0; option < optionEnd; ++option) {
+            current.push_back(options[option]);
+            size_t next = index + 1;
+            size_t nextEnd = 0;
+            if (next < types.size()) {
+                nextEnd = (types[next] == types[index]) ? option + 1 : cells[next]->size();
+            }
+            combineChildren(types, cells, next, nextEnd, current, results);
+            current.pop_back();
+        }
+    }
 
-                    if (childNodes < childLeaves || childNodes >= cache.size() ||
-                        childLeaves >= cache[childNodes].size()) {
-                        allValid = false;
-                        break;
-                    }
+    /**
+     * @brief Choose child types summing to (nodes, leaves), each at most `bound`
+     * Only types with a non-empty cell are taken, and a choice is kept only if
+     * the rest can still be completed (every child needs a leaf, and at least
+     * as many nodes as leaves, and at most maxChildren children in all).
+     * @param cellFor Returns the cell of child trees for a (nodes, leaves) type
+     */
+    template<typename CellFor>
+    void chooseChildTypes(size_t nodes, size_t leaves, ChildType bound, size_t maxChildren,
+                          CellFor& cellFor, std::vector<ChildType>& types,
+                          std::vector<const SubtreeStore::Cell*>& cells,
+                          std::vector<Tree>& results) {
+        if (nodes == 0) {
+            std::vector<const Tree*> current;
+            combineChildren(types, cells, 0, cells[0]->size(), current, results);
+            return;
+        }
+        if (types.size() == maxChildren) {
+            return;
+        }
 
-                    childOptions[i] = cache[childNodes][childLeaves];
-                    if (childOptions[i].empty()) {
-                        allValid = false;
-                        break;
-                    }
+        for (size_t childNodes = std::min(nodes, bound.first); childNodes >= 1; --childNodes) {
+            size_t maxChildLeaves = std::min(leaves, childNodes == 1 ? size_t(1) : childNodes - 1);
+            if (childNodes == bound.first) {
+                maxChildLeaves = std::min(maxChildLeaves, bound.second);
+            }
+            for (size_t childLeaves = maxChildLeaves; childLeaves >= 1; --childLeaves) {
+                size_t restNodes = nodes - childNodes;
+                size_t restLeaves = leaves - childLeaves;
+                if ((restNodes == 0) != (restLeaves == 0) || restNodes < restLeaves) {
+                    continue;
                 }
-
-                if (!allValid) continue;
-
-                // Generate all combinations
-                std::function<void(size_t, std::vector<Tree>&)> buildCombinations =
-                    [&](size_t idx, std::vector<Tree>& current) {
-                        if (idx == numChildren) {
-                            Tree root;
-                            for (const auto& child : current) {
-                                root.addChild(child);
-                            }
-                            root.sortToCanonical();
-
-                            std::string repr = root.toString();
-                            if (seen.find(repr) == seen.end()) {
-                                seen.insert(repr);
-                                results.push_back(root);
-                            }
-                            return;
-                        }
-
-                        for (const auto& childTree : childOptions[idx]) {
-                            current.push_back(childTree);
-                            buildCombinations(idx + 1, current);
-                            current.pop_back();
-                        }
-                    };
-
-                std::vector<Tree> current;
-                buildCombinations(0, current);
+                // Later children are no larger than this one and fill the slots left
+                size_t slots = maxChildren - types.size() - 1;
+                if (restNodes > 0 && (slots == 0 || (restNodes - 1) / slots >= childNodes)) {
+                    continue;
+                }
+                const SubtreeStore::Cell& cell = cellFor(childNodes, childLeaves);
+                if (cell.empty()) {
+                    continue;
+                }
+                types.emplace_back(childNodes, childLeaves);
+                cells.push_back(&cell);
+                chooseChildTypes(restNodes, restLeaves, types.back(), maxChildren, cellFor, types, cells, results);
+                cells.pop_back();
+                types.pop_back();
             }
         }
     }
-}
 
-void TreeOptimizer::generateSingleLeaf(size_t n, std::vector<Tree>& results) {
-    if (n == 1) {
-        // Single leaf node
-        results.push_back(Tree());
-        return;
-    }
+    /**
+     * @brief Exact-leaf cells under depth and out-degree limits
+     * Level h holds cells (n, k) of trees no deeper than h; a level-h tree's
+     * children come from level h-1, so each level is built from the one
+     * below and only the trees meeting the limits are ever made. Depth
+     * beyond n-1 changes nothing, so cells share the level min(h, n-1).
+     */
+    class ConstrainedCells {
+    public:
+        ConstrainedCells(size_t maxN, size_t maxK, const GenerationConstraints& limits)
+            : limits_(limits) {
+            size_t levels = std::min(limits.maxDepth, maxN > 0 ? maxN - 1 : 0) + 1;
+            for (size_t h = 0; h < levels; ++h) {
+                levels_.push_back(std::make_unique<SubtreeStore>(maxN, maxK, SubtreeStore::Interning::Append));
+            }
+        }
 
-    // Single chain: root -> child -> ... -> leaf
-    Tree tree;
-    Tree* current = &tree;
+        const SubtreeStore::Cell& cell(size_t n, size_t k, size_t depth) {
+            depth = std::min({depth, n - 1, levels_.size() - 1});
+            return levels_[depth]->getOrBuild(n, k, [this, n, k, depth] {
+                std::vector<Tree> trees;
+                build(n, k, depth, trees);
+                return trees;
+            });
+        }
 
-    for (size_t i = 1; i < n; ++i) {
-        Tree child;
-        current->addChild(child);
-        if (i < n - 1) {
-            // Get reference to the child we just added
-            current = const_cast<Tree*>(&current->getChildren()[0]);
+        // Trees of cell (n, k) no deeper than `depth`, built from the level below
+        void build(size_t n, size_t k, size_t depth, std::vector<Tree>& results) {
+            if (k == 0 || k > maxLeavesFor(n)) {
+                return;
+            }
+            if (n == 1) {
+                results.push_back(Tree());
+                return;
+            }
+            if (depth == 0 || limits_.maxChildren == 0) {
+                return;
+            }
+            auto cellFor = [this, depth](size_t childNodes, size_t childLeaves) -> const SubtreeStore::Cell& {
+                return cell(childNodes, childLeaves, depth - 1);
+            };
+            std::vector<ChildType> types;
+            std::vector<const SubtreeStore::Cell*> typeCells;
+            chooseChildTypes(n - 1, k, ChildType{n - 1, k}, limits_.maxChildren, cellFor, types, typeCells, results);
         }
-    }
 
-    results.push_back(tree);
+    private:
+        GenerationConstraints limits_;
+        std::vector<std::unique_ptr<SubtreeStore>> levels_;
+    };
 }
 
-void TreeOptimizer::generateTwoLeaves(size_t n, std::vector<Tree>& results) {
-    if (n < 3) {
-        return; // Need at least 3 nodes for 2 leaves
-    }
-
-    // Strategy: Root has 2 children, each is a chain ending in a leaf
-    // Distribute n-1 nodes among the two chains
-
-    size_t remaining = n - 1;
-
-    for (size_t leftChainSize = 1; leftChainSize <= remaining - 1; ++leftChainSize) {
-        size_t rightChainSize = remaining - leftChainSize;
-
-        if (rightChainSize < 1) continue;
-
-        // Only generate if leftChainSize >= rightChainSize (canonical form)
-        if (leftChainSize < rightChainSize) continue;
-
-        Tree root;
-
-        // Build left chain
-        std::vector<Tree> leftChain;
-        generateSingleLeaf(leftChainSize, leftChain);
+void TreeOptimizer::generateWithExactLeavesGeneric(
+    size_t n,
+    size_t k,
+    std::vector<Tree>& results,
+    SubtreeStore& cells) {
 
-        // Build right chain
-        std::vector<Tree> rightChain;
-        generateSingleLeaf(rightChainSize, rightChain);
+    results.clear();
 
-        if (!leftChain.empty() && !rightChain.empty()) {
-            root.addChild(rightChain[0]); // Add smaller first for canonical order
-            root.addChild(leftChain[0]);
-            root.sortToCanonical();
-            results.push_back(root);
-        }
+    if (k == 0 || k > maxLeavesFor(n)) {
+        return;
     }
-}
 
-void TreeOptimizer::generateThreeLeaves(size_t n, std::vector<Tree>& results) {
-    if (n < 4) {
-        return; // Need at least 4 nodes for 3 leaves
+    // Base case: a single node is the only tree with one node
+    if (n == 1) {
+        results.push_back(Tree());
+        return;
     }
 
-    std::set<std::string> seen; // To avoid duplicates
-    size_t remaining = n - 1;
-
-    // Case 1: Root has 3 children (each a chain to a leaf)
-    for (size_t a = 1; a <= remaining - 2; ++a) {
-        for (size_t b = 1; b <= remaining - a - 1; ++b) {
-            size_t c = remaining - a - b;
-            if (c < 1) continue;
-
-            // Canonical order: a >= b >= c
-            std::vector<size_t> sizes = {a, b, c};
-            std::sort(sizes.begin(), sizes.end(), std::greater<size_t>());
+    // Split the n-1 non-root nodes and k leaves among the root's children
+    auto cellFor = [&cells](size_t childNodes, size_t childLeaves) -> const SubtreeStore::Cell& {
+        return exactCell(childNodes, childLeaves, cells);
+    };
+    std::vector<ChildType> types;
+    std::vector<const SubtreeStore::Cell*> typeCells;
+    chooseChildTypes(n - 1, k, ChildType{n - 1, k}, GenerationConstraints::kUnlimited, cellFor,
+                     types, typeCells, results);
+}
 
-            if (sizes[0] != a || sizes[1] != b || sizes[2] != c) {
-                continue; // Skip non-canonical orderings
-            }
+size_t TreeOptimizer::generateConstrained(
+    size_t n,
+    size_t maxM,
+    const GenerationConstraints& constraints,
+    const BatchCallback& consumer) {
 
-            Tree root;
-            std::vector<Tree> chain1, chain2, chain3;
-            generateSingleLeaf(sizes[0], chain1);
-            generateSingleLeaf(sizes[1], chain2);
-            generateSingleLeaf(sizes[2], chain3);
-
-            if (!chain1.empty() && !chain2.empty() && !chain3.empty()) {
-                root.addChild(chain3[0]); // Smallest first
-                root.addChild(chain2[0]);
-                root.addChild(chain1[0]); // Largest last
-                root.sortToCanonical();
-
-                std::string repr = root.toString();
-                if (seen.find(repr) == seen.end()) {
-                    seen.insert(repr);
-                    results.push_back(root);
-                }
-            }
-        }
+    if (n == 0) {
+        return 0;
     }
+    std::pmr::synchronized_pool_resource arena;
+    std::pmr::memory_resource* callerResource = Tree::heapResource();
+    Tree::ArenaScope arenaScope(&arena);
 
-    // Case 2: Root has 2 children, one of which has 2 leaves
-    for (size_t singleChainSize = 1; singleChainSize <= remaining - 2; ++singleChainSize) {
-        size_t twoLeafTreeSize = remaining - singleChainSize;
-
-        if (twoLeafTreeSize < 2) continue;
-
-        std::vector<Tree> singleChain, twoLeafTrees;
-        generateSingleLeaf(singleChainSize, singleChain);
-        generateTwoLeaves(twoLeafTreeSize, twoLeafTrees);
+    // Cells are built on demand, so only the (nodes, leaves, depth) cells the
+    // n-node trees can actually use are ever made
+    size_t cacheLeaves = std::min(maxM, maxLeavesFor(n));
+    ConstrainedCells cells(n, cacheLeaves, constraints);
 
-        for (const auto& twoLeafTree : twoLeafTrees) {
-            if (!singleChain.empty()) {
-                Tree root;
-                root.addChild(singleChain[0]);
-                root.addChild(twoLeafTree);
-                root.sortToCanonical();
-
-                std::string repr = root.toString();
-                if (seen.find(repr) == seen.end()) {
-                    seen.insert(repr);
-                    results.push_back(root);
-                }
-            }
+    size_t totalCount = 0;
+    for (size_t leafCount = std::max(constraints.minLeaves, size_t(1)); leafCount <= cacheLeaves; ++leafCount) {
+        std::vector<Tree> trees;
+        cells.build(n, leafCount, constraints.maxDepth, trees);
+        if (!trees.empty()) {
+            // Copies the consumer keeps must not spill into the arena
+            Tree::ArenaScope callerScope(callerResource);
+            consumer(trees);
+            totalCount += trees.size();
         }
     }
+    return totalCount;
 }
 
 void TreeOptimizer::generateIntegerPartitions(
@@ -414,154 +411,23 @@ void TreeOptimizer::generateIntegerPartitions(
         return;
     }
 
-    if (n == 0) {
+    // Taking minPart - 1 off every part leaves a partition of the rest into
+    // exactly k positive parts, which the shared iterator enumerates
+    minPart = std::max(minPart, size_t(1));
+    if (n < k * minPart) {
         return;
     }
+    size_t shift = minPart - 1;
+    size_t maxPart = current.empty() ? n : current.back();
 
-    // Each part must be at least minPart and at most n/k
-    size_t maxPart = n - (k - 1) * minPart;
-    if (maxPart < minPart) return;
-
-    // Also respect non-increasing order
-    if (!current.empty()) {
-        maxPart = std::min(maxPart, current.back());
-    }
-
-    for (size_t part = minPart; part <= maxPart; ++part) {
-        current.push_back(part);
-        generateIntegerPartitions(n - part, k - 1, minPart, current, result);
-        current.pop_back();
-    }
-}
-
-void TreeOptimizer::generateFourLeaves(size_t n, std::vector<Tree>& results) {
-    if (n < 4) {
-        return; // Need at least 4 nodes for 4 leaves
-    }
-
-    results.clear();
-    std::set<std::string> seen;
-    size_t remaining = n - 1; // Root accounts for 1 node
-
-    // Case 1: Root has 4 children (each a single leaf chain)
-    // Partition remaining nodes into 4 chains
-    for (size_t a = 1; a <= remaining - 3; ++a) {
-        for (size_t b = 1; b <= remaining - a - 2; ++b) {
-            for (size_t c = 1; c <= remaining - a - b - 1; ++c) {
-                size_t d = remaining - a - b - c;
-                if (d < 1) continue;
-
-                // Ensure canonical ordering (non-increasing)
-                std::vector<size_t> sizes = {a, b, c, d};
-                std::sort(sizes.begin(), sizes.end(), std::greater<size_t>());
-
-                if (sizes[0] != a || sizes[1] != b || sizes[2] != c || sizes[3] != d) {
-                    continue; // Skip non-canonical orderings
-                }
-
-                Tree root;
-                std::vector<Tree> chain1, chain2, chain3, chain4;
-                generateSingleLeaf(sizes[0], chain1);
-                generateSingleLeaf(sizes[1], chain2);
-                generateSingleLeaf(sizes[2], chain3);
-                generateSingleLeaf(sizes[3], chain4);
-
-                if (!chain1.empty() && !chain2.empty() && !chain3.empty() && !chain4.empty()) {
-                    root.addChild(chain4[0]); // Smallest first
-                    root.addChild(chain3[0]);
-                    root.addChild(chain2[0]);
-                    root.addChild(chain1[0]); // Largest last
-                    root.sortToCanonical();
-
-                    std::string repr = root.toString();
-                    if (seen.find(repr) == seen.end()) {
-                        seen.insert(repr);
-                        results.push_back(root);
-                    }
-                }
-            }
+    for (PartitionIterator it(n - k * shift, k); it.valid(); it.next()) {
+        Partition partition = it.current();
+        if (partition.size() != k || partition.front() + shift > maxPart) {
+            continue;
         }
-    }
-
-    // Case 2: Root has 3 children: two chains and one 2-leaf tree
-    for (size_t chain1Size = 1; chain1Size <= remaining - 3; ++chain1Size) {
-        for (size_t chain2Size = 1; chain2Size <= remaining - chain1Size - 2; ++chain2Size) {
-            size_t twoLeafTreeSize = remaining - chain1Size - chain2Size;
-
-            if (twoLeafTreeSize < 2) continue;
-
-            std::vector<Tree> singleChain1, singleChain2, twoLeafTrees;
-            generateSingleLeaf(chain1Size, singleChain1);
-            generateSingleLeaf(chain2Size, singleChain2);
-            generateTwoLeaves(twoLeafTreeSize, twoLeafTrees);
-
-            for (const auto& twoLeafTree : twoLeafTrees) {
-                if (!singleChain1.empty() && !singleChain2.empty()) {
-                    Tree root;
-                    root.addChild(singleChain1[0]);
-                    root.addChild(singleChain2[0]);
-                    root.addChild(twoLeafTree);
-                    root.sortToCanonical();
-
-                    std::string repr = root.toString();
-                    if (seen.find(repr) == seen.end()) {
-                        seen.insert(repr);
-                        results.push_back(root);
-                    }
-                }
-            }
-        }
-    }
-
-    // Case 3: Root has 2 children: one chain and one 3-leaf tree
-    for (size_t singleChainSize = 1; singleChainSize <= remaining - 3; ++singleChainSize) {
-        size_t threeLeafTreeSize = remaining - singleChainSize;
-
-        if (threeLeafTreeSize < 3) continue;
-
-        std::vector<Tree> singleChain, threeLeafTrees;
-        generateSingleLeaf(singleChainSize, singleChain);
-        generateThreeLeaves(threeLeafTreeSize, threeLeafTrees);
-
-        for (const auto& threeLeafTree : threeLeafTrees) {
-            if (!singleChain.empty()) {
-                Tree root;
-                root.addChild(singleChain[0]);
-                root.addChild(threeLeafTree);
-                root.sortToCanonical();
-
-                std::string repr = root.toString();
-                if (seen.find(repr) == seen.end()) {
-                    seen.insert(repr);
-                    results.push_back(root);
-                }
-            }
-        }
-    }
-
-    // Case 4: Root has 2 children: two 2-leaf trees
-    for (size_t tree1Size = 2; tree1Size <= remaining - 2; ++tree1Size) {
-        size_t tree2Size = remaining - tree1Size;
-
-        if (tree2Size < 2) continue;
-
-        std::vector<Tree> twoLeafTrees1, twoLeafTrees2;
-        generateTwoLeaves(tree1Size, twoLeafTrees1);
-        generateTwoLeaves(tree2Size, twoLeafTrees2);
-
-        for (const auto& tree1 : twoLeafTrees1) {
-            for (const auto& tree2 : twoLeafTrees2) {
-                Tree root;
-                root.addChild(tree1);
-                root.addChild(tree2);
-                root.sortToCanonical();
-
-                std::string repr = root.toString();
-                if (seen.find(repr) == seen.end()) {
-                    seen.insert(repr);
-                    results.push_back(root);
-                }
-            }
+        std::vector<size_t>& parts = result.emplace_back(current);
+        for (size_t part : partition) {
+            parts.push_back(part + shift);
         }
     }
 }
@@ -0,0 +1,191 @@
+#include "tree_sampler.h"
+#include "task_pool.h"
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <stdexcept>
+#include <thread>
+
+namespace vinci {
+
+namespace {
+    // Uniform value in [0, bound): masked draws, rejecting those past bound
+    TreeCount uniformBelow(TreeCount bound, TreeSampler::Rng& rng) {
+        TreeCount top = bound - 1;
+        std::uint64_t high = static_cast<std::uint64_t>(top >> 64);
+        int bits = high != 0 ? 128 - std::countl_zero(high) : 64 - std::countl_zero(static_cast<std::uint64_t>(top));
+        TreeCount mask = bits >= 128 ? ~TreeCount(0) : (TreeCount(1) << bits) - 1;
+        while (true) {
+            // Two statements, so the draw order (and the sample) is the same on every compiler
+            std::uint64_t hi = rng();
+            std::uint64_t lo = rng();
+            TreeCount value = (TreeCount(hi) << 64 | lo) & mask;
+            if (value < bound) {
+                return value;
+            }
+        }
+    }
+
+    // RNG of chunk `chunk`, independent of every other chunk's
+    TreeSampler::Rng chunkRng(std::uint64_t seed, size_t chunk) {
+        std::seed_seq seq{static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32),
+                          static_cast<std::uint32_t>(chunk), static_cast<std::uint32_t>(uint64_t(chunk) >> 32)};
+        return TreeSampler::Rng(seq);
+    }
+}
+
+TreeSampler::TreeSampler(size_t n, size_t m)
+    : n_(n), m_(std::min(m, n)), counter_(n, m_) {
+
+    population_ = counter_.atMost(n_, m_);
+
+    // The largest forest draw weighs (n-1) F(n-1, k) = (n-1) T(n, k)
+    for (size_t k = 1; k <= m_; ++k) {
+        TreeCount weight;
+        if (__builtin_mul_overflow(TreeCount(n_), counter_.exact(n_, k), &weight)) {
+            throw std::overflow_error("tree count exceeds 128 bits");
+        }
+    }
+}
+
+TreeCount TreeSampler::forests(size_t nodes, size_t leaves) const {
+    if (nodes == 0) {
+        return leaves == 0 ? 1 : 0;
+    }
+    // A forest of `nodes` nodes is the children of a tree with one more
+    return counter_.exact(nodes + 1, leaves);
+}
+
+void TreeSampler::sampleForest(size_t nodes, size_t leaves, Rng& rng, std::vector<Tree>& roots) const {
+    while (nodes > 0) {
+        TreeCount target = uniformBelow(TreeCount(nodes) * forests(nodes, leaves), rng);
+
+        // Leaf-limited forests are mostly one large tree, so the largest
+        // classes come first and the scan usually stops at once
+        bool chosen = false;
+        for (size_t d = nodes; d >= 1 && !chosen; --d) {
+            for (size_t l = std::min(leaves, d == 1 ? size_t(1) : d - 1); l >= 1 && !chosen; --l) {
+                TreeCount t = counter_.exact(d, l);
+                if (t == 0) {
+                    continue;
+                }
+                for (size_t j = 1; j * d <= nodes && j * l <= leaves; ++j) {
+                    TreeCount rest = forests(nodes - j * d, leaves - j * l);
+                    if (rest == 0) {
+                        continue;
+                    }
+                    TreeCount weight = TreeCount(d) * t * rest;
+                    if (target >= weight) {
+                        target -= weight;
+                        continue;
+                    }
+                    Tree child = sampleExact(d, l, rng);
+                    for (size_t copy = 1; copy < j; ++copy) {
+                        roots.push_back(child);
+                    }
+                    roots.push_back(std::move(child));
+                    nodes -= j * d;
+                    leaves -= j * l;
+                    chosen = true;
+                    break;
+                }
+            }
+        }
+        if (!chosen) {
+            throw std::logic_error("inconsistent sampling tables");
+        }
+    }
+}
+
+Tree TreeSampler::sampleExact(size_t n, size_t k, Rng& rng) const {
+    if (n == 1) {
+        return Tree();
+    }
+    std::vector<Tree> roots;
+    sampleForest(n - 1, k, rng, roots);
+    std::vector<const Tree*> children;
+    children.reserve(roots.size());
+    for (const Tree& root : roots) {
+        children.push_back(&root);
+    }
+    return Tree::fromCanonicalChildren(children);
+}
+
+Tree TreeSampler::sample(Rng& rng) const {
+    if (population_ == 0) {
+        throw std::out_of_range(std::format("no tree has {} nodes and at most {} leaves", n_, m_));
+    }
+    // Leaf count first, in proportion to its cell
+    TreeCount target = uniformBelow(population_, rng);
+    size_t k = 1;
+    while (target >= counter_.exact(n_, k)) {
+        target -= counter_.exact(n_, k);
+        ++k;
+    }
+    return sampleExact(n_, k, rng);
+}
+
+size_t TreeSampler::sampleBatches(size_t count, std::uint64_t seed, const BatchCallback& consumer,
+                                  size_t threads) const {
+    if (count == 0 || population_ == 0) {
+        return 0;
+    }
+    size_t chunks = (count + kChunkSize - 1) / kChunkSize;
+    auto drawChunk = [&](size_t chunk, std::vector<Tree>& trees) {
+        Rng rng = chunkRng(seed, chunk);
+        size_t size = std::min(kChunkSize, count - chunk * kChunkSize);
+        trees.clear();
+        trees.reserve(size);
+        for (size_t i = 0; i < size; ++i) {
+            trees.push_back(sample(rng));
+        }
+    };
+
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threads = std::min(threads, chunks);
+
+    std::vector<Tree> trees;
+    if (threads == 1) {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            drawChunk(chunk, trees);
+            if (consumer) {
+                consumer(trees);
+            }
+        }
+        return count;
+    }
+
+    // Workers draw a wave of chunks; the calling thread then hands them over
+    // in chunk order, so the consumer sees the same sequence at any thread count
+    TaskPool pool(threads);
+    std::vector<std::vector<Tree>> wave(std::min(chunks, threads * 4));
+    for (size_t first = 0; first < chunks; first += wave.size()) {
+        size_t last = std::min(chunks, first + wave.size());
+        std::vector<TaskPool::Task> tasks;
+        for (size_t chunk = first; chunk < last; ++chunk) {
+            tasks.emplace_back([&, chunk](size_t) { drawChunk(chunk, wave[chunk - first]); });
+        }
+        pool.start(std::move(tasks));
+        pool.wait();
+        for (size_t chunk = first; chunk < last; ++chunk) {
+            if (consumer) {
+                consumer(wave[chunk - first]);
+            }
+        }
+    }
+    return count;
+}
+
+size_t TreeSampler::sample(size_t count, std::uint64_t seed, const TreeCallback& callback, size_t threads) const {
+    return sampleBatches(count, seed, [&callback](std::span<const Tree> batch) {
+        if (callback) {
+            for (const Tree& tree : batch) {
+                callback(tree);
+            }
+        }
+    }, threads);
+}
+
+} // namespace vinci
@@ -0,0 +1,354 @@
+#include "tree_sink.h"
+#include <algorithm>
+#include <cerrno>
+#include <format>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace vinci {
+
+namespace {
+    using Level = Tree::Level;
+
+    // Largest node count a binary record header can hold
+    constexpr size_t kMaxRecordNodes = 0xffff;
+
+    // Sinks get distinct ids, so a thread's buffer cache survives address reuse
+    std::atomic<std::uint64_t> nextSinkId{1};
+    constexpr size_t kThreadCacheEntries = 8;
+
+    void appendCount(std::string& out, size_t nodes) {
+        if (nodes > kMaxRecordNodes) {
+            throw std::length_error("TreeSink: tree too large for a binary record");
+        }
+        out += static_cast<char>(nodes & 0xff);
+        out += static_cast<char>(nodes >> 8);
+    }
+
+    size_t parensBytes(size_t nodes) {
+        return (2 * (nodes - 1) + 7) / 8;
+    }
+
+    void encodeText(std::span<const Level> seq, std::string& out) {
+        for (size_t i = 0; i < seq.size(); ++i) {
+            if (i > 0 && seq[i] <= seq[i - 1]) {
+                out.append(seq[i - 1] - seq[i] + 1, ')');
+                out += ',';
+            }
+            out += '(';
+        }
+        out.append(seq.back() + 1, ')');
+        out += '\n';
+    }
+
+    void encodeParens(std::span<const Level> seq, std::string& out) {
+        size_t start = out.size();
+        out.append(parensBytes(seq.size()), '\0');
+        size_t bit = 0;
+        auto emit = [&out, start, &bit](bool one) {
+            if (one) {
+                out[start + bit / 8] = static_cast<char>(out[start + bit / 8] | (0x80 >> (bit % 8)));
+            }
+            ++bit;
+        };
+
+        for (size_t i = 1; i < seq.size(); ++i) {
+            // Return from the previous node up to the new node's parent, then descend
+            for (size_t up = seq[i - 1] + 1 - seq[i]; up > 0; --up) {
+                emit(false);
+            }
+            emit(true);
+        }
+        for (size_t up = seq.back(); up > 0; --up) {
+            emit(false);
+        }
+    }
+
+    [[noreturn]] void invalidRecord(std::string_view format, const std::string& reason) {
+        throw std::runtime_error(std::format("TreeSink: invalid {} record: {}", format, reason));
+    }
+
+    // A record must hold one rooted tree: the root at level 0 and every other
+    // node below it, at most one level deeper than its predecessor
+    void checkLevels(std::span<const Level> levels, std::string_view format) {
+        if (levels[0] != 0) {
+            invalidRecord(format, std::format("root at level {}", levels[0]));
+        }
+        for (size_t i = 1; i < levels.size(); ++i) {
+            if (levels[i] == 0 || levels[i] > levels[i - 1] + 1) {
+                invalidRecord(format, std::format("node {} at level {} after level {}",
+                                                  i, levels[i], levels[i - 1]));
+            }
+        }
+    }
+
+    std::optional<Tree> decodeText(std::string_view& input) {
+        size_t end = input.find('\n');
+        if (end == std::string_view::npos) {
+            return std::nullopt;
+        }
+        std::vector<Level> levels;
+        int depth = -1;
+        for (char c : input.substr(0, end)) {
+            if (c == '(') {
+                if (depth == -1 && !levels.empty()) {
+                    invalidRecord("text", "more than one root");
+                }
+                if (depth + 1 > static_cast<int>(std::numeric_limits<Level>::max())) {
+                    invalidRecord("text", "tree too deep");
+                }
+                levels.push_back(static_cast<Level>(++depth));
+            } else if (c == ')') {
+                if (depth < 0) {
+                    invalidRecord("text", "unbalanced ')'");
+                }
+                --depth;
+            } else if (c != ',') {
+                invalidRecord("text", std::format("unexpected byte 0x{:02x}", static_cast<unsigned char>(c)));
+            }
+        }
+        if (levels.empty()) {
+            invalidRecord("text", "empty line");
+        }
+        if (depth != -1) {
+            invalidRecord("text", "unbalanced '('");
+        }
+        input.remove_prefix(end + 1);
+        return Tree::fromLevelSequence(levels);
+    }
+}
+
+TreeSink::TreeSink(int fd, OutputFormat format, size_t bufferSize)
+    : fd_(fd), format_(format), bufferSize_(bufferSize),
+      id_(nextSinkId.fetch_add(1, std::memory_order_relaxed)) {
+    if (bufferSize == 0) {
+        throw std::invalid_argument("TreeSink: buffer size must be positive");
+    }
+}
+
+TreeSink::~TreeSink() {
+    try {
+        flush();
+    } catch (const std::system_error&) {
+        // Destructors must not throw; callers that care flush() explicitly
+    }
+}
+
+void TreeSink::encode(const Tree& tree, OutputFormat format, std::string& out) {
+    std::span<const Level> seq = tree.getLevels();
+    switch (format) {
+    case OutputFormat::Text:
+        encodeText(seq, out);
+        break;
+    case OutputFormat::Levels:
+        appendCount(out, seq.size());
+        for (Level level : seq) {
+            out += static_cast<char>(level & 0xff);
+            if (seq.size() > 256) {
+                out += static_cast<char>(level >> 8);
+            }
+        }
+        break;
+    case OutputFormat::Parens:
+        appendCount(out, seq.size());
+        encodeParens(seq, out);
+        break;
+    }
+}
+
+std::optional<Tree> TreeSink::decode(std::string_view& input, OutputFormat format) {
+    if (format == OutputFormat::Text) {
+        return decodeText(input);
+    }
+    if (input.size() < 2) {
+        return std::nullopt;
+    }
+    size_t nodes = static_cast<unsigned char>(input[0]) |
+                   (static_cast<size_t>(static_cast<unsigned char>(input[1])) << 8);
+    const char* name = (format == OutputFormat::Levels) ? "levels" : "parens";
+    if (nodes == 0) {
+        invalidRecord(name, "zero nodes");
+    }
+
+    std::vector<Level> levels;
+    levels.reserve(nodes);
+    size_t payload;
+    if (format == OutputFormat::Levels) {
+        size_t width = nodes > 256 ? 2 : 1;
+        payload = nodes * width;
+        if (input.size() < 2 + payload) {
+            return std::nullopt;
+        }
+        for (size_t i = 0; i < nodes; ++i) {
+            size_t level = static_cast<unsigned char>(input[2 + i * width]);
+            if (width == 2) {
+                level |= static_cast<size_t>(static_cast<unsigned char>(input[3 + i * width])) << 8;
+            }
+            levels.push_back(static_cast<Level>(level));
+        }
+        checkLevels(levels, name);
+    } else {
+        payload = parensBytes(nodes);
+        if (input.size() < 2 + payload) {
+            return std::nullopt;
+        }
+        levels.push_back(0);
+        Level depth = 0;
+        for (size_t bit = 0; bit < 2 * (nodes - 1); ++bit) {
+            bool one = static_cast<unsigned char>(input[2 + bit / 8]) & (0x80 >> (bit % 8));
+            if (one) {
+                if (levels.size() == nodes) {
+                    invalidRecord(name, std::format("more than the header's {} nodes", nodes));
+                }
+                levels.push_back(++depth);
+            } else {
+                if (depth == 0) {
+                    invalidRecord(name, "closes past the root");
+                }
+                --depth;
+            }
+        }
+        // Balanced bits with no extra node leave exactly `nodes` levels
+        if (levels.size() != nodes) {
+            invalidRecord(name, std::format("{} nodes, header says {}", levels.size(), nodes));
+        }
+    }
+    input.remove_prefix(2 + payload);
+    return Tree::fromLevelSequence(levels);
+}
+
+size_t TreeSink::read(int fd, OutputFormat format, const std::function<void(const Tree&)>& visit) {
+    constexpr size_t kChunk = 1 << 20;
+    std::string pending;
+    size_t records = 0;
+    while (true) {
+        size_t used = pending.size();
+        pending.resize(used + kChunk);
+        ssize_t n;
+        do {
+            n = ::read(fd, pending.data() + used, kChunk);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            throw std::system_error(errno, std::generic_category(), "TreeSink: read failed");
+        }
+        pending.resize(used + static_cast<size_t>(n));
+        if (n == 0) {
+            break;
+        }
+
+        // Decode every complete record; a partial one waits for the next chunk
+        std::string_view view(pending);
+        while (auto tree = decode(view, format)) {
+            visit(*tree);
+            ++records;
+        }
+        pending.erase(0, pending.size() - view.size());
+    }
+    if (!pending.empty()) {
+        throw std::runtime_error(std::format("TreeSink: {} bytes of truncated record at end of input",
+                                             pending.size()));
+    }
+    return records;
+}
+
+std::optional<OutputFormat> TreeSink::parseFormat(std::string_view name) {
+    if (name == "text") return OutputFormat::Text;
+    if (name == "levels") return OutputFormat::Levels;
+    if (name == "parens") return OutputFormat::Parens;
+    return std::nullopt;
+}
+
+TreeSink::Buffer& TreeSink::localBuffer() {
+    // Per-thread cache of (sink id, buffer); usually a single entry
+    thread_local std::vector<std::pair<std::uint64_t, Buffer*>> cache;
+    for (const auto& [id, buffer] : cache) {
+        if (id == id_) {
+            return *buffer;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& buffer = buffers_.emplace_back(std::make_unique<Buffer>());
+    buffer->data.reserve(bufferSize_ + 256);
+    // Entries of destroyed sinks never match again; keep the cache small
+    if (cache.size() >= kThreadCacheEntries) {
+        cache.erase(cache.begin());
+    }
+    cache.emplace_back(id_, buffer.get());
+    return *buffer;
+}
+
+void TreeSink::write(const Tree& tree) {
+    Buffer& buffer = localBuffer();
+    encode(tree, format_, buffer.data);
+    written_.fetch_add(1, std::memory_order_relaxed);
+
+    if (buffer.data.size() >= bufferSize_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        writeAll(buffer.data.data(), buffer.data.size());
+        buffer.data.clear();
+    }
+}
+
+void TreeSink::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<iovec> pieces;
+    size_t total = 0;
+    for (auto& buffer : buffers_) {
+        if (!buffer->data.empty()) {
+            pieces.push_back({buffer->data.data(), buffer->data.size()});
+            total += buffer->data.size();
+        }
+    }
+    if (pieces.empty()) {
+        return;
+    }
+
+    // One gathered write for the common case; finish any short write piecewise
+    size_t done = 0;
+    if (pieces.size() <= static_cast<size_t>(IOV_MAX)) {
+        ssize_t n;
+        do {
+            n = ::writev(fd_, pieces.data(), static_cast<int>(pieces.size()));
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            throw std::system_error(errno, std::generic_category(), "TreeSink: writev failed");
+        }
+        done = static_cast<size_t>(n);
+    }
+    if (done < total) {
+        for (const auto& piece : pieces) {
+            if (done >= piece.iov_len) {
+                done -= piece.iov_len;
+                continue;
+            }
+            writeAll(static_cast<const char*>(piece.iov_base) + done, piece.iov_len - done);
+            done = 0;
+        }
+    }
+
+    for (auto& buffer : buffers_) {
+        buffer->data.clear();
+    }
+}
+
+void TreeSink::writeAll(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd_, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "TreeSink: write failed");
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+} // namespace vinci
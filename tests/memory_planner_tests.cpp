@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include "memory_planner.h"
+#include "tree_generator.h"
+#include <algorithm>
+#include <limits>
+#include <span>
+
+using namespace vinci;
+
+namespace {
+    constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+}
+
+TEST(MemoryPlannerTest, PredictionBoundsTheSubtreeStore) {
+    TreeGenerator generator;
+    generator.setEngine(TreeGenerator::Engine::Memoized);
+    generator.setMemoryBudget(kUnlimited);
+    generator.generate(16, 6, [](const Tree&) {}, false);
+
+    const MemoryPlan& plan = generator.getMemoryPlan();
+    EXPECT_TRUE(plan.fits);
+    EXPECT_GT(generator.getCachedSubtreeCount(), 0u);
+    EXPECT_GE(plan.cacheBytes, generator.getCachedSubtreeCount() * sizeof(Tree));
+    EXPECT_EQ(MemoryPlanner(16, 6).memoized(1, kUnlimited).cacheBytes, plan.cacheBytes);
+}
+
+TEST(MemoryPlannerTest, TreeBytesCountHeapSpill) {
+    EXPECT_EQ(MemoryPlanner::treeBytes(Tree::kInlineCapacity), sizeof(Tree));
+    EXPECT_GT(MemoryPlanner::treeBytes(Tree::kInlineCapacity + 1), sizeof(Tree));
+}
+
+TEST(MemoryPlannerTest, BudgetLowersThreadsAndBuffers) {
+    MemoryPlanner planner(20, 8);
+    MemoryPlan unlimited = planner.memoized(8, kUnlimited);
+    EXPECT_TRUE(unlimited.fits);
+    EXPECT_EQ(unlimited.threads, 8u);
+    EXPECT_EQ(unlimited.flushTrees, MemoryPlanner::kMaxFlushTrees);
+
+    // Room for two workers at the smallest flush buffer
+    size_t spare = (unlimited.flushTrees - MemoryPlanner::kMinFlushTrees) * MemoryPlanner::treeBytes(20);
+    size_t minimumWorker = unlimited.workerBytes - spare;
+    size_t budget = unlimited.cacheBytes + unlimited.batchBytes + 2 * minimumWorker;
+    MemoryPlan tight = planner.memoized(8, budget);
+    EXPECT_TRUE(tight.fits);
+    EXPECT_EQ(tight.threads, 2u);
+    EXPECT_EQ(tight.flushTrees, MemoryPlanner::kMinFlushTrees);
+    EXPECT_LE(tight.peakBytes(), budget);
+
+    MemoryPlan over = planner.memoized(8, unlimited.cacheBytes);
+    EXPECT_FALSE(over.fits);
+    EXPECT_FALSE(planner.exactLeaves(1).fits);
+}
+
+TEST(MemoryPlannerTest, PrewarmDepthFollowsCellBytes) {
+    MemoryPlanner planner(12, 4);
+    size_t previous = 12;
+    for (size_t threads : {1, 32, 128, 1024}) {
+        MemoryPlan plan = planner.memoized(threads, kUnlimited);
+        size_t share = plan.cacheBytes / plan.threads;
+        size_t cumulative = 0;
+        for (size_t j = 1; j <= plan.prewarmDepth; ++j) {
+            cumulative += planner.levelBytes(j);
+        }
+        // The deepest level within one worker's share of the cache, up to n/2
+        EXPECT_LE(cumulative, share);
+        if (plan.prewarmDepth < 6) {
+            EXPECT_GT(cumulative + planner.levelBytes(plan.prewarmDepth + 1), share);
+        }
+        EXPECT_LE(plan.prewarmDepth, previous);
+        previous = plan.prewarmDepth;
+    }
+    EXPECT_EQ(planner.memoized(1, kUnlimited).prewarmDepth, 6u);
+    EXPECT_LT(previous, 6u);
+
+    // A budget with no room past the smallest worker and the batch pre-warms nothing
+    MemoryPlan full = planner.memoized(1, kUnlimited);
+    size_t spare = (full.flushTrees - MemoryPlanner::kMinFlushTrees) * MemoryPlanner::treeBytes(12);
+    MemoryPlan starved = planner.memoized(1, full.batchBytes + full.workerBytes - spare);
+    EXPECT_FALSE(starved.fits);
+    EXPECT_EQ(starved.prewarmDepth, 0u);
+}
+
+TEST(MemoryPlannerTest, BatchesStayWithinFlushBuffer) {
+    // A budget that leaves one worker 100 trees above the smallest flush buffer
+    MemoryPlan unlimited = MemoryPlanner(16, 16).memoized(1, kUnlimited);
+    size_t spare = (unlimited.flushTrees - MemoryPlanner::kMinFlushTrees) * MemoryPlanner::treeBytes(16);
+    size_t budget = unlimited.peakBytes() - spare + 100 * MemoryPlanner::treeBytes(16);
+
+    TreeGenerator generator;
+    generator.setEngine(TreeGenerator::Engine::Memoized);
+    generator.setMemoryBudget(budget);
+    size_t largest = 0;
+    size_t total = 0;
+    generator.generateBatches(16, 16, [&](std::span<const Tree> batch) {
+        largest = std::max(largest, batch.size());
+        total += batch.size();
+    }, false);
+
+    EXPECT_EQ(generator.getMemoryPlan().flushTrees, MemoryPlanner::kMinFlushTrees + 100);
+    EXPECT_EQ(total, static_cast<size_t>(TreeGenerator::count(16, 16)));
+    EXPECT_GT(largest, 0u);
+    EXPECT_LE(largest, generator.getMemoryPlan().flushTrees);
+}
+
+TEST(MemoryPlannerTest, OverBudgetRunsFallBackOrAreRefused) {
+    size_t expected = static_cast<size_t>(TreeGenerator::count(9, 5));
+    size_t seen = 0;
+    auto counting = [&seen](const Tree&) { ++seen; };
+
+    TreeGenerator automatic;
+    automatic.setMemoryBudget(1);
+    EXPECT_EQ(automatic.generate(9, 5, counting, false), expected);
+    EXPECT_EQ(seen, expected);
+
+    seen = 0;
+    TreeGenerator memoized;
+    memoized.setEngine(TreeGenerator::Engine::Memoized);
+    memoized.setMemoryBudget(1);
+    EXPECT_EQ(memoized.generate(9, 5, counting, false), 0u);
+    EXPECT_EQ(seen, 0u);
+    EXPECT_FALSE(memoized.getMemoryPlan().fits);
+}
+
+TEST(MemoryPlannerTest, ConstrainedRunsAreNotSentToTheLevelWalk) {
+    GenerationConstraints constraints;
+    constraints.minLeaves = 5;
+
+    TreeGenerator generator;
+    generator.setConstraints(constraints);
+    generator.setMemoryBudget(1);
+    size_t below = 0;
+    size_t returned = generator.generate(14, 7, [&below](const Tree& tree) {
+        below += tree.getLeafCount() < 5;
+    }, false);
+    EXPECT_EQ(below, 0u);
+    EXPECT_EQ(returned, 0u);
+
+    // With room, the same run keeps the limit
+    generator.setMemoryBudget(0);
+    returned = generator.generate(14, 7, [&below](const Tree& tree) {
+        below += tree.getLeafCount() < 5;
+    }, false);
+    EXPECT_EQ(below, 0u);
+    EXPECT_EQ(returned, 22868u);
+}
+
+TEST(MemoryPlannerTest, LargeNIsPlannedNotRefused) {
+    // Past the old fixed N <= 30 limit, a narrow leaf limit keeps the run small
+    TreeGenerator generator;
+    generator.setEngine(TreeGenerator::Engine::Memoized);
+    size_t seen = 0;
+    generator.generate(40, 2, [&seen](const Tree&) { ++seen; }, false);
+    EXPECT_EQ(seen, static_cast<size_t>(TreeGenerator::count(40, 2)));
+    EXPECT_TRUE(generator.getMemoryPlan().fits);
+}
+
+TEST(MemoryPlannerTest, AvailableMemoryIsKnownOnLinux) {
+#ifdef __linux__
+    EXPECT_GT(MemoryPlanner::availableMemory(), 0u);
+#endif
+}
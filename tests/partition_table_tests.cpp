@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include "partition_table.h"
+#include "tree_optimizer.h"
+#include <algorithm>
+#include <numeric>
+#include <thread>
+
+using namespace vinci;
+
+namespace {
+    // p(n, <= k parts) by the standard recurrence
+    std::vector<std::vector<size_t>> partitionCounts(size_t maxN) {
+        std::vector<std::vector<size_t>> p(maxN + 1, std::vector<size_t>(maxN + 1, 0));
+        for (size_t k = 0; k <= maxN; ++k) {
+            p[0][k] = 1;
+        }
+        for (size_t n = 1; n <= maxN; ++n) {
+            for (size_t k = 1; k <= maxN; ++k) {
+                p[n][k] = p[n][k - 1] + (n >= k ? p[n - k][k] : 0);
+            }
+        }
+        return p;
+    }
+}
+
+TEST(PartitionTableTest, IteratorVisitsEachPartitionInDecreasingOrder) {
+    const size_t maxN = 24;
+    auto counts = partitionCounts(maxN);
+    for (size_t n = 0; n <= maxN; ++n) {
+        for (size_t k = 0; k <= n + 1; ++k) {
+            std::vector<size_t> previous;
+            size_t visited = 0;
+            for (PartitionIterator it(n, k); it.valid(); it.next()) {
+                Partition partition = it.current();
+                std::vector<size_t> parts(partition.begin(), partition.end());
+                EXPECT_EQ(std::accumulate(parts.begin(), parts.end(), size_t(0)), n);
+                EXPECT_LE(parts.size(), k);
+                EXPECT_TRUE(std::is_sorted(parts.rbegin(), parts.rend()));
+                if (visited > 0) {
+                    EXPECT_TRUE(parts < previous) << "n=" << n << " k=" << k;
+                }
+                previous = std::move(parts);
+                ++visited;
+            }
+            size_t expected = (k == 0) ? (n == 0) : counts[n][std::min(k, n)];
+            EXPECT_EQ(visited, expected) << "n=" << n << " k=" << k;
+        }
+    }
+}
+
+TEST(PartitionTableTest, ListsAreBuiltOnceAndShared) {
+    PartitionTable table(20);
+    const auto& all = table.get(20, 20);
+    EXPECT_EQ(all.size(), 627u);
+    EXPECT_EQ(&table.get(20, 50), &all);
+    EXPECT_EQ(all[0].size(), 1u);
+    EXPECT_EQ(all[all.size() - 1].size(), 20u);
+
+    // Concurrent first requests all see the one published list
+    std::vector<const PartitionTable::List*> seen(8);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < seen.size(); ++t) {
+        threads.emplace_back([&, t] { seen[t] = &table.get(18, 4); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto* list : seen) {
+        EXPECT_EQ(list, seen[0]);
+    }
+    EXPECT_EQ(seen[0]->size(), partitionCounts(18)[18][4]);
+
+    // Growing keeps published lists in place
+    table.grow(30);
+    EXPECT_EQ(&table.get(20, 20), &all);
+    EXPECT_EQ(table.get(30, 30).size(), 5604u);
+}
+
+TEST(PartitionTableTest, ExactPartsWithMinimum) {
+    std::vector<size_t> current;
+    std::vector<std::vector<size_t>> result;
+    TreeOptimizer::generateIntegerPartitions(10, 3, 2, current, result);
+
+    std::vector<std::vector<size_t>> expected = {{6, 2, 2}, {5, 3, 2}, {4, 4, 2}, {4, 3, 3}};
+    EXPECT_EQ(result, expected);
+
+    result.clear();
+    current = {3};
+    TreeOptimizer::generateIntegerPartitions(6, 2, 1, current, result);
+    expected = {{3, 3, 3}};
+    EXPECT_EQ(result, expected);
+}
@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+#include "subtree_cache_file.h"
+#include "tree_generator.h"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <unistd.h>
+
+using namespace vinci;
+
+namespace {
+    std::string tempPath(const char* tag) {
+        return std::string("/tmp/subtree_cache_") + tag + "_" + std::to_string(::getpid());
+    }
+
+    std::set<std::string> generateAll(TreeGenerator& generator, size_t n, size_t m) {
+        std::set<std::string> trees;
+        generator.generate(n, m, [&](const Tree& tree) { trees.insert(tree.toString()); });
+        return trees;
+    }
+}
+
+TEST(SubtreeCacheFileTest, WriteAndMapCells) {
+    std::string path = tempPath("cells");
+    std::vector<Tree> all;
+    TreeGenerator generator;
+    for (size_t n = 1; n <= 6; ++n) {
+        generator.generate(n, n, [&](const Tree& tree) { all.push_back(tree); }, false);
+    }
+
+    SubtreeCacheFile::write(path, 6, 3, [&](size_t n, size_t leaves) {
+        std::vector<const Tree*> cell;
+        for (const auto& tree : all) {
+            if (tree.getNodeCount() == n && tree.getLeafCount() == leaves) {
+                cell.push_back(&tree);
+            }
+        }
+        return cell;
+    });
+
+    auto file = SubtreeCacheFile::open(path);
+    ASSERT_NE(file, nullptr);
+    EXPECT_EQ(file->maxNodes(), 6u);
+    EXPECT_EQ(file->maxLeaves(), 3u);
+
+    // 6 nodes with exactly 1, 2, 3 leaves: 1, 6, 8 trees
+    EXPECT_EQ(file->cellSize(6, 1), 1u);
+    EXPECT_EQ(file->cellSize(6, 2), 6u);
+    EXPECT_EQ(file->cellSize(6, 3), 8u);
+    EXPECT_EQ(file->cellSize(6, 4), 0u);
+    EXPECT_EQ(file->cellLevels(6, 2).size(), 36u);
+
+    std::vector<Tree> loaded;
+    file->appendCell(5, 2, loaded);
+    ASSERT_EQ(loaded.size(), 4u);
+    for (const auto& tree : loaded) {
+        EXPECT_EQ(tree.getNodeCount(), 5u);
+        EXPECT_EQ(tree.getLeafCount(), 2u);
+    }
+
+    // Every tree of up to 4 nodes is present; 6 nodes with 4+ leaves is not
+    EXPECT_TRUE(file->covers(4, 10));
+    EXPECT_TRUE(file->covers(6, 3));
+    EXPECT_FALSE(file->covers(6, 4));
+    EXPECT_FALSE(file->covers(7, 1));
+
+    std::remove(path.c_str());
+}
+
+TEST(SubtreeCacheFileTest, RejectsInvalidFiles) {
+    std::string path = tempPath("invalid");
+    EXPECT_EQ(SubtreeCacheFile::open(path), nullptr);
+
+    std::ofstream(path) << "definitely not a subtree cache";
+    EXPECT_EQ(SubtreeCacheFile::open(path), nullptr);
+    std::remove(path.c_str());
+}
+
+TEST(SubtreeCacheFileTest, RejectsOverflowingSizes) {
+    std::string path = tempPath("overflow");
+    Tree pair = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1});
+    auto writeValid = [&] {
+        SubtreeCacheFile::write(path, 2, 1, [&](size_t n, size_t) {
+            return n == 2 ? std::vector<const Tree*>{&pair} : std::vector<const Tree*>{};
+        });
+        ASSERT_NE(SubtreeCacheFile::open(path), nullptr);
+    };
+    auto patch = [&](std::streamoff offset, auto value) {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(offset);
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+
+    // Header: 8-byte magic, then version, byte order, maxNodes, maxLeaves (uint32 each)
+    writeValid();
+    patch(16, std::uint32_t(0xFFFFFFFF));
+    EXPECT_EQ(SubtreeCacheFile::open(path), nullptr);
+
+    // Entries follow the 24-byte header as (offset, count) uint64 pairs;
+    // a count of 2^63 two-node trees wraps the byte size to 0
+    writeValid();
+    patch(24 + 5 * 16 + 8, std::uint64_t(1) << 63);
+    EXPECT_EQ(SubtreeCacheFile::open(path), nullptr);
+
+    std::remove(path.c_str());
+}
+
+TEST(SubtreeCacheFileTest, GeneratorReusesCacheAcrossRuns) {
+    std::string path = tempPath("generator");
+    std::remove(path.c_str());
+
+    TreeGenerator plain;
+    plain.setEngine(TreeGenerator::Engine::Memoized);
+    auto expected = generateAll(plain, 14, 6);
+
+    // First run writes the file, a fresh generator then maps it
+    TreeGenerator writer;
+    writer.setEngine(TreeGenerator::Engine::Memoized);
+    writer.setCacheFile(path);
+    EXPECT_EQ(generateAll(writer, 14, 6), expected);
+
+    auto file = SubtreeCacheFile::open(path);
+    ASSERT_NE(file, nullptr);
+    EXPECT_TRUE(file->covers(7, 6));
+
+    TreeGenerator reader;
+    reader.setEngine(TreeGenerator::Engine::Memoized);
+    reader.setCacheFile(path);
+    EXPECT_EQ(generateAll(reader, 14, 6), expected);
+
+    // A smaller leaf limit is served by the same file
+    TreeGenerator narrower;
+    narrower.setEngine(TreeGenerator::Engine::Memoized);
+    auto narrowExpected = generateAll(narrower, 13, 4);
+    reader.setEngine(TreeGenerator::Engine::Memoized);
+    EXPECT_EQ(generateAll(reader, 13, 4), narrowExpected);
+
+    std::remove(path.c_str());
+}
+
+TEST(SubtreeCacheFileTest, SerialRunsUseTheFile) {
+    std::string path = tempPath("serial");
+    std::remove(path.c_str());
+
+    TreeGenerator plain;
+    plain.setEngine(TreeGenerator::Engine::Memoized);
+    std::set<std::string> expected;
+    plain.generate(12, 5, [&](const Tree& tree) { expected.insert(tree.toString()); }, false);
+
+    TreeGenerator serial;
+    serial.setEngine(TreeGenerator::Engine::Memoized);
+    serial.setCacheFile(path);
+    std::set<std::string> trees;
+    serial.generate(12, 5, [&](const Tree& tree) { trees.insert(tree.toString()); }, false);
+    EXPECT_EQ(trees, expected);
+
+    auto file = SubtreeCacheFile::open(path);
+    ASSERT_NE(file, nullptr);
+    EXPECT_TRUE(file->covers(6, 5));
+
+    std::remove(path.c_str());
+}
+
+TEST(SubtreeCacheFileTest, ShallowerRunKeepsDeeperFile) {
+    std::string path = tempPath("merge");
+    std::remove(path.c_str());
+
+    // A deep, narrow file, then a shallow, wider run
+    TreeGenerator deep;
+    deep.setEngine(TreeGenerator::Engine::Memoized);
+    deep.setCacheFile(path);
+    generateAll(deep, 16, 3);
+    auto before = SubtreeCacheFile::open(path);
+    ASSERT_NE(before, nullptr);
+    size_t deepNodes = before->maxNodes();
+    before.reset();
+
+    TreeGenerator plain;
+    plain.setEngine(TreeGenerator::Engine::Memoized);
+    auto expected = generateAll(plain, 10, 6);
+
+    TreeGenerator shallow;
+    shallow.setEngine(TreeGenerator::Engine::Memoized);
+    shallow.setCacheFile(path);
+    EXPECT_EQ(generateAll(shallow, 10, 6), expected);
+
+    // The rewrite holds both ranges
+    auto after = SubtreeCacheFile::open(path);
+    ASSERT_NE(after, nullptr);
+    EXPECT_EQ(after->maxNodes(), deepNodes);
+    EXPECT_TRUE(after->covers(deepNodes, 3));
+    EXPECT_TRUE(after->covers(5, 6));
+
+    // Its cells match a fresh build
+    TreeGenerator reader;
+    reader.setEngine(TreeGenerator::Engine::Memoized);
+    reader.setCacheFile(path);
+    TreeGenerator fresh;
+    fresh.setEngine(TreeGenerator::Engine::Memoized);
+    EXPECT_EQ(generateAll(reader, 16, 3), generateAll(fresh, 16, 3));
+
+    std::remove(path.c_str());
+}
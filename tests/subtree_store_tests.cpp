@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include "subtree_store.h"
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+using namespace vinci;
+
+TEST(SubtreeStoreTest, InternsEachTreeOnce) {
+    SubtreeStore store(4, 4);
+    Tree cherry = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 1});
+
+    const Tree* first = store.intern(Tree(cherry));
+    const Tree* second = store.intern(Tree(cherry));
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(*first, cherry);
+    EXPECT_EQ(store.internedCount(), 1);
+    EXPECT_EQ(store.internHits(), 1);
+}
+
+TEST(SubtreeStoreTest, CellsShareInternedTrees) {
+    SubtreeStore store(3, 2);
+    Tree chain = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 2});
+    Tree cherry = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 1});
+
+    EXPECT_EQ(store.find(3, 1), nullptr);
+    const auto& oneLeaf = store.getOrBuild(3, 1, [&] { return std::vector<Tree>{chain}; });
+    const auto& twoLeaves = store.getOrBuild(3, 2, [&] { return std::vector<Tree>{chain, cherry}; });
+
+    ASSERT_EQ(oneLeaf.size(), 1);
+    ASSERT_EQ(twoLeaves.size(), 2);
+    EXPECT_EQ(oneLeaf[0], twoLeaves[0]);
+    EXPECT_EQ(store.find(3, 2), &twoLeaves);
+    EXPECT_EQ(store.internedCount(), 2);
+    EXPECT_EQ(store.internHits(), 1);
+}
+
+TEST(SubtreeStoreTest, ConcurrentRequestsBuildOnce) {
+    SubtreeStore store(2, 1);
+    std::atomic<int> builds{0};
+    std::vector<const SubtreeStore::Cell*> seen(8);
+
+    {
+        std::vector<std::jthread> threads;
+        for (size_t t = 0; t < seen.size(); ++t) {
+            threads.emplace_back([&, t] {
+                seen[t] = &store.getOrBuild(2, 1, [&] {
+                    ++builds;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    return std::vector<Tree>{Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1})};
+                });
+            });
+        }
+    }
+
+    EXPECT_EQ(builds.load(), 1);
+    for (const auto* cell : seen) {
+        EXPECT_EQ(cell, seen[0]);
+    }
+}
+
+TEST(SubtreeStoreTest, FailedBuildReleasesTheCell) {
+    SubtreeStore store(2, 1);
+    std::atomic<int> builds{0};
+    std::vector<const SubtreeStore::Cell*> seen(8, nullptr);
+    std::atomic<int> failures{0};
+
+    // The first build throws while the others wait on it; one of them must
+    // take over instead of waiting forever
+    {
+        std::vector<std::jthread> threads;
+        for (size_t t = 0; t < seen.size(); ++t) {
+            threads.emplace_back([&, t] {
+                try {
+                    seen[t] = &store.getOrBuild(2, 1, [&] {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                        if (builds++ == 0) {
+                            throw std::runtime_error("build failed");
+                        }
+                        return std::vector<Tree>{Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1})};
+                    });
+                } catch (const std::runtime_error&) {
+                    ++failures;
+                }
+            });
+        }
+    }
+
+    EXPECT_EQ(failures.load(), 1);
+    EXPECT_EQ(builds.load(), 2);
+    const SubtreeStore::Cell* cell = store.find(2, 1);
+    ASSERT_NE(cell, nullptr);
+    EXPECT_EQ(cell->size(), 1u);
+    for (const auto* other : seen) {
+        EXPECT_TRUE(other == nullptr || other == cell);
+    }
+}
+
+TEST(SubtreeStoreTest, GrowKeepsPublishedCells) {
+    SubtreeStore store(3, 1);
+    Tree chain = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 2});
+    Tree cherry = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 1});
+    store.getOrBuild(3, 1, [&] { return std::vector<Tree>{chain}; });
+
+    store.grow(5, 2);
+    EXPECT_EQ(store.maxNodes(), 5u);
+    EXPECT_EQ(store.maxLeaves(), 2u);
+    ASSERT_NE(store.find(3, 1), nullptr);
+    EXPECT_EQ(*(*store.find(3, 1))[0], chain);
+    EXPECT_EQ(store.findSuperset(3, 1), nullptr);
+
+    // A wider cell can seed a narrower one with the same interned pointers
+    const auto& wide = store.getOrBuild(3, 2, [&] { return std::vector<Tree>{chain, cherry}; });
+    EXPECT_EQ(store.findSuperset(3, 0), store.find(3, 1));
+    EXPECT_EQ(store.findSuperset(3, 1), &wide);
+    const auto& derived = store.getOrBuild(3, 0, [&] { return SubtreeStore::Cell{wide[1]}; });
+    EXPECT_EQ(derived[0], wide[1]);
+    EXPECT_EQ(store.internedCount(), 2u);
+
+    // Growing within the current bounds is a no-op
+    store.grow(4, 1);
+    EXPECT_EQ(store.maxNodes(), 5u);
+    EXPECT_EQ(store.find(3, 2), &wide);
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include "task_pool.h"
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace vinci;
+
+TEST(TaskPoolTest, RunsEveryTaskOnce) {
+    TaskPool pool(4);
+    std::vector<std::atomic<int>> runs(100);
+
+    std::vector<TaskPool::Task> tasks;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        tasks.emplace_back([&runs, i](size_t) { runs[i].fetch_add(1); });
+    }
+    pool.start(std::move(tasks));
+    pool.wait();
+
+    for (const auto& count : runs) {
+        EXPECT_EQ(count.load(), 1);
+    }
+}
+
+TEST(TaskPoolTest, WaitsForSpawnedTasks) {
+    TaskPool pool(3);
+    std::atomic<int> leaves{0};
+    bool doneRan = false;
+
+    // Each task splits in two until depth 6, giving 2^6 leaf tasks
+    std::function<void(int)> spawn = [&](int depth) {
+        if (depth == 6) {
+            leaves.fetch_add(1);
+            return;
+        }
+        pool.submit([&, depth](size_t) { spawn(depth + 1); });
+        pool.submit([&, depth](size_t) { spawn(depth + 1); });
+    };
+
+    std::vector<TaskPool::Task> tasks;
+    tasks.emplace_back([&](size_t) { spawn(0); });
+    pool.start(std::move(tasks), [&] { doneRan = true; });
+    pool.wait();
+
+    EXPECT_EQ(leaves.load(), 64);
+    EXPECT_TRUE(doneRan);
+}
+
+TEST(TaskPoolTest, ReusableAcrossBatches) {
+    TaskPool pool(2);
+    std::atomic<int> total{0};
+
+    for (int batch = 0; batch < 3; ++batch) {
+        std::vector<TaskPool::Task> tasks;
+        for (int i = 0; i < 10; ++i) {
+            tasks.emplace_back([&](size_t worker) {
+                EXPECT_LT(worker, 2u);
+                total.fetch_add(1);
+            });
+        }
+        pool.start(std::move(tasks));
+        pool.wait();
+    }
+    EXPECT_EQ(total.load(), 30);
+
+    // An empty batch completes immediately
+    pool.start({});
+    pool.wait();
+}
+
+TEST(TaskPoolTest, InitRunsOnEachPinnedWorker) {
+    std::vector<std::thread::id> ids(4);
+    TaskPool pool(4, true, [&ids](size_t worker) { ids[worker] = std::this_thread::get_id(); });
+
+    // The constructor only returns once every worker has run its init
+    for (const auto& id : ids) {
+        EXPECT_NE(id, std::thread::id());
+        EXPECT_NE(id, std::this_thread::get_id());
+    }
+
+    std::vector<std::atomic<int>> byWorker(4);
+    std::vector<TaskPool::Task> tasks;
+    for (int i = 0; i < 16; ++i) {
+        tasks.emplace_back([&](size_t worker) {
+            EXPECT_EQ(ids[worker], std::this_thread::get_id());
+            byWorker[worker].fetch_add(1);
+        });
+    }
+    pool.start(std::move(tasks));
+    pool.wait();
+
+    int total = 0;
+    for (const auto& count : byWorker) {
+        total += count.load();
+    }
+    EXPECT_EQ(total, 16);
+}
+
+TEST(TaskPoolTest, ThrowingTaskFailsTheBatch) {
+    TaskPool pool(3);
+    std::atomic<int> ran{0};
+
+    // The batch still completes and wait() rethrows the task's exception
+    std::vector<TaskPool::Task> tasks;
+    tasks.emplace_back([](size_t) { throw std::runtime_error("task failed"); });
+    for (int i = 0; i < 20; ++i) {
+        tasks.emplace_back([&](size_t) { ran.fetch_add(1); });
+    }
+    pool.start(std::move(tasks));
+    EXPECT_THROW(pool.wait(), std::runtime_error);
+    EXPECT_LE(ran.load(), 20);
+
+    // The failure is reported once and the pool stays usable
+    EXPECT_NO_THROW(pool.wait());
+    ran = 0;
+    std::vector<TaskPool::Task> next;
+    for (int i = 0; i < 10; ++i) {
+        next.emplace_back([&](size_t) { ran.fetch_add(1); });
+    }
+    pool.start(std::move(next));
+    EXPECT_NO_THROW(pool.wait());
+    EXPECT_EQ(ran.load(), 10);
+
+    // A failed batch nobody waits for does not escape the destructor
+    TaskPool unwaited(2);
+    std::vector<TaskPool::Task> failing;
+    failing.emplace_back([](size_t) { throw std::runtime_error("unwaited"); });
+    unwaited.start(std::move(failing));
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include "tree_counter.h"
+#include "tree_enumerator.h"
+#include "tree_generator.h"
+#include "tree_optimizer.h"
+#include <stdexcept>
+
+using namespace vinci;
+
+TEST(TreeCounterTest, MatchesOEIS_A000081) {
+    // https://oeis.org/A000081, n = 1..30
+    std::vector<size_t> expected = {
+        1, 1, 2, 4, 9, 20, 48, 115, 286, 719, 1842, 4766, 12486, 32973, 87811,
+        235381, 634847, 1721159, 4688676, 12826228, 35221832, 97055181,
+        268282855, 743724984, 2067174645, 5759636510, 16083734329,
+        45007066269, 126186554308, 354426847597
+    };
+
+    TreeCounter counter(expected.size(), expected.size());
+    for (size_t n = 1; n <= expected.size(); ++n) {
+        EXPECT_EQ(counter.atMost(n, n), TreeCount(expected[n - 1])) << "n=" << n;
+    }
+}
+
+TEST(TreeCounterTest, ExactLeavesMatchEnumerator) {
+    TreeCounter counter(12, 12);
+    for (size_t n = 1; n <= 12; ++n) {
+        std::vector<size_t> perLeafCount(n + 1, 0);
+        for (TreeEnumerator it(n, n); it.valid(); it.next()) {
+            ++perLeafCount[it.leafCount()];
+        }
+        for (size_t k = 0; k <= n; ++k) {
+            EXPECT_EQ(counter.exact(n, k), TreeCount(perLeafCount[k])) << "n=" << n << ", k=" << k;
+        }
+    }
+}
+
+TEST(TreeCounterTest, GeneratorCount) {
+    EXPECT_EQ(TreeGenerator::count(8, 5), TreeCount(108));
+    EXPECT_EQ(TreeGenerator::count(30, 3), TreeCount(13661));
+    EXPECT_EQ(TreeGenerator::count(0, 5), TreeCount(0));
+    EXPECT_EQ(TreeGenerator::count(3, 0), TreeCount(0));
+
+    // Well beyond the N <= 30 limit of generate()
+    EXPECT_EQ(countToString(TreeGenerator::count(60, 60)), "16486885726043465205200778");
+}
+
+TEST(TreeCounterTest, OverflowIsReported) {
+    EXPECT_THROW(TreeGenerator::count(100, 100), std::overflow_error);
+}
+
+TEST(TreeCounterTest, RankFollowsExactEngineOrder) {
+    TreeCounter counter(11, 11, TreeCounter::Tables::Ranking);
+    for (size_t n = 1; n <= 11; ++n) {
+        for (size_t m : {size_t(1), size_t(3), n}) {
+            TreeCount index = 0;
+            TreeOptimizer::generateAllWithCallback(n, m, [&](const Tree& tree) {
+                ASSERT_EQ(counter.rank(tree), index) << tree.toString();
+                ASSERT_EQ(counter.unrank(n, m, index), tree) << "n=" << n << ", index=" << countToString(index);
+                ++index;
+            });
+            EXPECT_EQ(index, counter.atMost(n, m));
+            EXPECT_THROW(counter.unrank(n, m, index), std::out_of_range);
+        }
+    }
+}
+
+TEST(TreeCounterTest, RankSeeksFarBeyondGeneration) {
+    // 60 nodes: far too many trees to walk, but ranks are polynomial
+    TreeCounter counter(60, 6, TreeCounter::Tables::Ranking);
+    TreeCount total = counter.atMost(60, 6);
+    for (TreeCount index : {TreeCount(0), TreeCount(1), total / 3, total / 2 + 12345, total - 1}) {
+        Tree tree = counter.unrank(60, 6, index);
+        EXPECT_EQ(tree.getNodeCount(), 60u);
+        EXPECT_LE(tree.getLeafCount(), 6u);
+        EXPECT_EQ(counter.rank(tree), index);
+    }
+
+    Tree scrambled = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 1, 2});
+    EXPECT_THROW(counter.rank(scrambled), std::invalid_argument);
+    EXPECT_THROW(TreeCounter(5, 5).rank(Tree()), std::logic_error);
+}
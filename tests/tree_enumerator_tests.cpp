@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include "tree_enumerator.h"
+#include "tree_generator.h"
+#include "tree_hash_set.h"
+#include <algorithm>
+#include <chrono>
+#include <ranges>
+
+using namespace vinci;
+
+namespace {
+    // Walk the enumerator, checking canonical form, uniqueness and the leaf limit
+    size_t enumerateAndCheck(size_t n, size_t m) {
+        TreeHashSet seen;
+        size_t count = 0;
+        for (TreeEnumerator it(n, m); it.valid(); it.next()) {
+            Tree tree = it.tree();
+            Tree canonical = tree;
+            canonical.sortToCanonical();
+
+            EXPECT_EQ(tree, canonical) << "Non-canonical sequence: " << tree.toString();
+            EXPECT_TRUE(seen.insert(tree)) << "Duplicate tree: " << tree.toString();
+            EXPECT_EQ(tree.getNodeCount(), n);
+            EXPECT_LE(tree.getLeafCount(), m);
+            EXPECT_EQ(it.leafCount(), tree.getLeafCount());
+            ++count;
+        }
+        return count;
+    }
+}
+
+TEST(TreeEnumeratorTest, EmptyCases) {
+    EXPECT_FALSE(TreeEnumerator(0, 5).valid());
+    EXPECT_FALSE(TreeEnumerator(4, 0).valid());
+}
+
+TEST(TreeEnumeratorTest, StartsAtPathEndsAtStar) {
+    std::vector<Tree> trees;
+    for (TreeEnumerator it(5, 5); it.valid(); it.next()) {
+        trees.push_back(it.tree());
+    }
+    ASSERT_EQ(trees.size(), 9);
+    EXPECT_EQ(trees.front().toString(), "((((()))))");
+    EXPECT_EQ(trees.back().toString(), "((),(),(),())");
+
+    // Decreasing lexicographic order of level sequences
+    for (size_t i = 1; i < trees.size(); ++i) {
+        EXPECT_GT(trees[i - 1], trees[i]);
+    }
+}
+
+TEST(TreeEnumeratorTest, MatchesOEIS_A000081) {
+    std::vector<size_t> expected = {1, 1, 2, 4, 9, 20, 48, 115, 286, 719, 1842, 4766, 12486, 32973};
+    for (size_t n = 1; n <= expected.size(); ++n) {
+        EXPECT_EQ(enumerateAndCheck(n, n), expected[n - 1]) << "n=" << n;
+    }
+}
+
+TEST(TreeEnumeratorTest, LeafLimitMatchesMemoizedGenerator) {
+    for (size_t n = 1; n <= 11; ++n) {
+        for (size_t m = 1; m <= 6; ++m) {
+            TreeGenerator generator;
+            generator.setEngine(TreeGenerator::Engine::Memoized);
+            size_t expected = generator.generate(n, m, [](const Tree&) {}, false);
+            EXPECT_EQ(enumerateAndCheck(n, m), expected) << "n=" << n << ", m=" << m;
+        }
+    }
+}
+
+TEST(TreeEnumeratorTest, GeneratorSelectsLevelSequenceEngine) {
+    TreeGenerator generator;
+    generator.setEngine(TreeGenerator::Engine::LevelSequence);
+    size_t count = generator.generate(8, 5, [](const Tree&) {});
+    EXPECT_EQ(count, 108);
+    EXPECT_EQ(generator.getCount(), 108);
+}
+
+TEST(TreeEnumeratorTest, RangeIsLazy) {
+    static_assert(std::ranges::input_range<TreeRange>);
+
+    std::vector<Tree> expected;
+    for (TreeEnumerator it(12, 4); it.valid(); it.next()) {
+        expected.push_back(it.tree());
+    }
+    std::vector<Tree> pulled;
+    for (const Tree& tree : TreeGenerator::trees(12, 4)) {
+        pulled.push_back(tree);
+    }
+    EXPECT_EQ(pulled, expected);
+
+    // N=40 has about 10^17 trees; only the ones taken are ever built
+    auto start = std::chrono::steady_clock::now();
+    TreeRange huge(40, 40);
+    size_t taken = 0;
+    for (const Tree& tree : huge | std::views::take(5)) {
+        EXPECT_EQ(tree.getNodeCount(), 40u);
+        ++taken;
+    }
+    EXPECT_EQ(taken, 5u);
+
+    TreeRange walk(40, 40);
+    auto first = std::ranges::find_if(walk, [](const Tree& tree) { return tree.getLeafCount() == 3; });
+    ASSERT_NE(first, walk.end());
+    EXPECT_EQ(first.leafCount(), 3u);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
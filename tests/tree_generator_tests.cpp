@@ -1,6 +1,14 @@
 #include <gtest/gtest.h>
 #include "tree_generator.h"
+#include "tree_optimizer.h"
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <memory>
 #include <set>
+#include <span>
+#include <stdexcept>
+#include <thread>
 
 using namespace vinci;
 
@@ -115,6 +123,363 @@ TEST_F(TreeGeneratorTest, MultithreadingConsistency) {
     EXPECT_EQ(countSingle, countMulti);
 }
 
+TEST_F(TreeGeneratorTest, StreamingParallelMatchesSingleThreaded) {
+    // n >= 10 takes the parallel path, where workers stream through bounded
+    // queues; the output must be the same set of trees as the serial path
+    size_t n = 12;
+    size_t m = 5;
+
+    std::set<std::string> single;
+    generator.generate(n, m, [&](const Tree& tree) { single.insert(tree.toString()); }, false);
+
+    TreeGenerator generator2;
+    generator2.setEngine(TreeGenerator::Engine::Memoized);
+    std::set<std::string> streamed;
+    size_t callbacks = 0;
+    size_t total = generator2.generate(n, m, [&](const Tree& tree) {
+        streamed.insert(tree.toString());
+        ++callbacks;
+    }, true);
+
+    EXPECT_GT(single.size(), TreeGenerator::kStreamQueueDepth);
+    EXPECT_EQ(total, callbacks);
+    EXPECT_EQ(callbacks, streamed.size());
+    EXPECT_EQ(streamed, single);
+}
+
+TEST_F(TreeGeneratorTest, ExplicitThreadCountWithAffinity) {
+    // More workers than this host may have cores, pinned round-robin; the
+    // result must not depend on the worker count
+    size_t n = 14;
+    size_t m = 6;
+
+    for (size_t threads : {1, 3, 8}) {
+        TreeGenerator pinned;
+        pinned.setEngine(TreeGenerator::Engine::Memoized);
+        pinned.setThreadCount(threads);
+        pinned.setCpuAffinity(true);
+        std::set<std::string> seen;
+        size_t total = pinned.generate(n, m, [&](const Tree& tree) { seen.insert(tree.toString()); });
+
+        EXPECT_EQ(total, static_cast<size_t>(TreeGenerator::count(n, m))) << threads << " threads";
+        EXPECT_EQ(seen.size(), total) << threads << " threads";
+    }
+}
+
+TEST_F(TreeGeneratorTest, CacheGrowsAcrossCalls) {
+    // One long-lived generator must match fresh generators on every query,
+    // and a narrower query must be served entirely from the existing cache
+    auto collect = [](TreeGenerator& g, size_t n, size_t m) {
+        std::set<std::string> trees;
+        g.generate(n, m, [&](const Tree& tree) { trees.insert(tree.toString()); });
+        return trees;
+    };
+    auto fresh = [&](size_t n, size_t m) {
+        TreeGenerator g;
+        g.setEngine(TreeGenerator::Engine::Memoized);
+        return collect(g, n, m);
+    };
+
+    generator.setEngine(TreeGenerator::Engine::Memoized);
+    EXPECT_EQ(collect(generator, 11, 4), fresh(11, 4));
+    size_t afterFirst = generator.getCachedSubtreeCount();
+
+    EXPECT_EQ(collect(generator, 14, 7), fresh(14, 7));
+    size_t afterGrow = generator.getCachedSubtreeCount();
+    EXPECT_GT(afterGrow, afterFirst);
+
+    EXPECT_EQ(collect(generator, 13, 5), fresh(13, 5));
+    EXPECT_EQ(generator.getCachedSubtreeCount(), afterGrow);
+
+    generator.clearCache();
+    EXPECT_EQ(generator.getCachedSubtreeCount(), 0u);
+    EXPECT_EQ(collect(generator, 12, 3), fresh(12, 3));
+}
+
+TEST_F(TreeGeneratorTest, TightLeafBudgets) {
+    // Small M with many nodes is where the per-position leaf budget prunes
+    // most; every tree must still appear, within the limit
+    generator.setEngine(TreeGenerator::Engine::Memoized);
+    for (auto [n, m] : {std::pair<size_t, size_t>{9, 1}, {9, 2}, {14, 2}, {14, 3}, {20, 3}, {24, 2}}) {
+        for (bool parallel : {false, true}) {
+            size_t count = 0;
+            generator.generate(n, m, [&](const Tree& tree) {
+                EXPECT_LE(tree.getLeafCount(), m);
+                ++count;
+            }, parallel);
+            EXPECT_EQ(TreeCount(count), TreeGenerator::count(n, m)) << "n=" << n << " m=" << m;
+        }
+    }
+}
+
+TEST_F(TreeGeneratorTest, ShardsSplitRootPartitions) {
+    // Every root partition goes to exactly one shard, the same way each time
+    PartitionTable table(17);
+    size_t total = table.get(17, 17).size();
+    for (size_t shards : {1, 2, 3, 7}) {
+        std::vector<int> owner(total, -1);
+        for (size_t shard = 0; shard < shards; ++shard) {
+            auto assigned = TreeGenerator::shardPartitions(18, 6, shard, shards);
+            EXPECT_EQ(assigned, TreeGenerator::shardPartitions(18, 6, shard, shards));
+            EXPECT_TRUE(std::is_sorted(assigned.begin(), assigned.end()));
+            for (size_t idx : assigned) {
+                ASSERT_LT(idx, total);
+                EXPECT_EQ(owner[idx], -1) << "partition " << idx << " in two shards";
+                owner[idx] = static_cast<int>(shard);
+            }
+        }
+        EXPECT_EQ(std::count(owner.begin(), owner.end(), -1), 0);
+    }
+
+    EXPECT_THROW(generator.setShard(3, 3), std::invalid_argument);
+    EXPECT_THROW(TreeGenerator::shardPartitions(10, 3, 0, 0), std::invalid_argument);
+}
+
+TEST_F(TreeGeneratorTest, ShardedRunsCoverEveryTreeOnce) {
+    for (bool parallel : {false, true}) {
+        std::set<std::string> all;
+        size_t total = 0;
+        for (size_t shard = 0; shard < 4; ++shard) {
+            TreeGenerator sharded;
+            sharded.setEngine(TreeGenerator::Engine::LevelSequence);  // overridden by sharding
+            sharded.setShard(shard, 4);
+            total += sharded.generate(14, 5, [&](const Tree& tree) {
+                EXPECT_TRUE(all.insert(tree.toString()).second) << "duplicate " << tree.toString();
+            }, parallel);
+        }
+        EXPECT_EQ(TreeCount(total), TreeGenerator::count(14, 5));
+        EXPECT_EQ(all.size(), total);
+    }
+}
+
+TEST_F(TreeGeneratorTest, BatchesMatchPerTreeCallback) {
+    for (auto engine : {TreeGenerator::Engine::Memoized, TreeGenerator::Engine::LevelSequence,
+                        TreeGenerator::Engine::ExactLeaves}) {
+        for (bool parallel : {false, true}) {
+            TreeGenerator batched;
+            batched.setEngine(engine);
+            batched.setThreadCount(3);
+            std::set<std::string> seen;
+            std::thread::id caller = std::this_thread::get_id();
+            size_t total = batched.generateBatches(15, 5, [&](std::span<const Tree> batch) {
+                EXPECT_FALSE(batch.empty());
+                EXPECT_EQ(std::this_thread::get_id(), caller);
+                for (const Tree& tree : batch) {
+                    EXPECT_TRUE(seen.insert(tree.toString()).second) << "duplicate " << tree.toString();
+                }
+            }, parallel);
+            EXPECT_EQ(TreeCount(total), TreeGenerator::count(15, 5));
+            EXPECT_EQ(seen.size(), total);
+        }
+    }
+}
+
+TEST_F(TreeGeneratorTest, TemplatedCallbackMatchesFunction) {
+    static_assert(TreeCallbackType<TreeGenerator::TreeCallback>);
+    static_assert(!TreeCallbackType<int (*)(const Tree&)>);
+
+    for (auto engine : {TreeGenerator::Engine::Memoized, TreeGenerator::Engine::LevelSequence,
+                        TreeGenerator::Engine::ExactLeaves}) {
+        generator.setEngine(engine);
+        std::vector<std::string> viaFunction;
+        TreeGenerator::TreeCallback collect = [&](const Tree& tree) { viaFunction.push_back(tree.toString()); };
+        size_t functionCount = generator.generate(14, 4, collect, false);
+
+        std::vector<std::string> inlined;
+        size_t inlinedCount = generator.generate(14, 4, [&](const Tree& tree) {
+            inlined.push_back(tree.toString());
+        }, false);
+        EXPECT_EQ(inlinedCount, functionCount);
+        EXPECT_EQ(inlined, viaFunction);
+    }
+
+    size_t optimized = 0;
+    EXPECT_EQ(TreeOptimizer::generateAllWithCallback(12, 4, [&](const Tree&) { ++optimized; }),
+              TreeGenerator::count(12, 4));
+    EXPECT_EQ(TreeCount(optimized), TreeGenerator::count(12, 4));
+}
+
+TEST_F(TreeGeneratorTest, SlicesResumeTheRankOrder) {
+    std::vector<Tree> all;
+    TreeOptimizer::generateAllWithCallback(13, 5, [&](const Tree& tree) { all.push_back(tree); });
+
+    // Consecutive slices, cut across leaf-count cells, rebuild the full run
+    std::vector<Tree> sliced;
+    for (TreeCount start = 0; start < all.size(); start += 700) {
+        size_t got = generator.generate(13, 5, start, 700, [&](const Tree& tree) { sliced.push_back(tree); });
+        EXPECT_EQ(got, std::min<size_t>(700, all.size() - static_cast<size_t>(start)));
+    }
+    EXPECT_EQ(sliced, all);
+
+    size_t past = 0;
+    EXPECT_EQ(generator.generate(13, 5, all.size(), 10, [&](const Tree&) { ++past; }), 0u);
+    EXPECT_EQ(past, 0u);
+
+    // The slice must not leak into later full runs
+    EXPECT_EQ(generator.generate(13, 5, [](const Tree&) {}, false), all.size());
+}
+
+TEST_F(TreeGeneratorTest, PerThreadConsumersNeedNoLock) {
+    // Each consumer owns its state and must only ever run on one thread
+    struct Consumer {
+        std::vector<std::string> trees;
+        std::set<std::thread::id> threads;
+    };
+    for (bool parallel : {false, true}) {
+        TreeGenerator perThread;
+        perThread.setThreadCount(4);
+        std::vector<std::unique_ptr<Consumer>> consumers;
+        size_t total = perThread.generatePerThread(16, 6, [&](size_t worker) {
+            EXPECT_EQ(worker, consumers.size());
+            Consumer* consumer = consumers.emplace_back(std::make_unique<Consumer>()).get();
+            return [consumer](std::span<const Tree> batch) {
+                consumer->threads.insert(std::this_thread::get_id());
+                for (const Tree& tree : batch) {
+                    consumer->trees.push_back(tree.toString());
+                }
+            };
+        }, parallel);
+
+        EXPECT_EQ(consumers.size(), parallel ? 4u : 1u);
+        std::set<std::string> all;
+        for (const auto& consumer : consumers) {
+            EXPECT_LE(consumer->threads.size(), 1u);
+            all.insert(consumer->trees.begin(), consumer->trees.end());
+        }
+        EXPECT_EQ(TreeCount(total), TreeGenerator::count(16, 6));
+        EXPECT_EQ(all.size(), total);
+    }
+}
+
+TEST_F(TreeGeneratorTest, AutoRunsInParallelWhenAsked) {
+    using Engine = TreeGenerator::Engine;
+    TreeGenerator automatic;
+    EXPECT_EQ(automatic.resolvedEngine(8, false, true), Engine::Memoized);
+    EXPECT_EQ(automatic.resolvedEngine(16, false, false), Engine::LevelSequence);
+
+    // An explicit thread count above one, or parallel per-worker consumers,
+    // keep the parallel memoized engine
+    automatic.setThreadCount(4);
+    EXPECT_EQ(automatic.resolvedEngine(16, false, true), Engine::Memoized);
+    EXPECT_EQ(automatic.resolvedEngine(16, false, false), Engine::LevelSequence);
+    automatic.setThreadCount(1);
+    EXPECT_EQ(automatic.resolvedEngine(16, false, true), Engine::LevelSequence);
+    EXPECT_EQ(automatic.resolvedEngine(16, true, true), Engine::LevelSequence);
+
+    automatic.setThreadCount(0);
+    if (std::thread::hardware_concurrency() > 1) {
+        EXPECT_EQ(automatic.resolvedEngine(16, true, true), Engine::Memoized);
+    }
+
+    automatic.setThreadCount(4);
+    automatic.setStatsEnabled(true);
+    size_t seen = 0;
+    automatic.generate(14, 5, [&seen](const Tree&) { ++seen; }, true);
+    EXPECT_EQ(TreeCount(seen), TreeGenerator::count(14, 5));
+    EXPECT_EQ(automatic.getStats().threads, 4u);
+}
+
+TEST_F(TreeGeneratorTest, ExactLeavesUsesTheThreadSettings) {
+    // The cell table is built on the generator's own pinned workers
+    TreeGenerator exact;
+    exact.setEngine(TreeGenerator::Engine::ExactLeaves);
+    exact.setThreadCount(3);
+    exact.setCpuAffinity(true);
+    exact.setStatsEnabled(true);
+    size_t seen = 0;
+    exact.generate(14, 5, [&seen](const Tree&) { ++seen; }, true);
+    EXPECT_EQ(TreeCount(seen), TreeGenerator::count(14, 5));
+    EXPECT_EQ(exact.getStats().threads, 3u);
+}
+
+TEST_F(TreeGeneratorTest, KeptTreesOutliveTheArena) {
+    // 40-node trees spill to the heap, so copies must not come from the
+    // generator's arena, which clearCache() and the destructor release
+    for (bool parallel : {false, true}) {
+        std::vector<Tree> kept;
+        std::vector<std::string> expected;
+        {
+            TreeGenerator owner;
+            owner.setEngine(TreeGenerator::Engine::Memoized);
+            owner.setThreadCount(2);
+            owner.generate(40, 2, [&](const Tree& tree) {
+                kept.push_back(tree);
+                expected.push_back(tree.toString());
+            }, parallel);
+            ASSERT_FALSE(kept.empty());
+            ASSERT_GT(kept.front().getNodeCount(), Tree::kInlineCapacity);
+
+            owner.clearCache();
+            owner.generate(12, 3, [](const Tree&) {}, parallel);
+            for (size_t i = 0; i < kept.size(); ++i) {
+                EXPECT_EQ(kept[i].toString(), expected[i]);
+            }
+        }
+        for (size_t i = 0; i < kept.size(); ++i) {
+            EXPECT_EQ(kept[i].toString(), expected[i]);
+        }
+    }
+}
+
+TEST_F(TreeGeneratorTest, ThrowingConsumerStopsParallelRun) {
+    // The workers keep producing after the consumer gives up, so queues they
+    // block on must be released for the run to end and rethrow
+    for (bool perWorker : {false, true}) {
+        TreeGenerator parallel;
+        parallel.setEngine(TreeGenerator::Engine::Memoized);
+        parallel.setThreadCount(4);
+        auto consumer = [](std::span<const Tree>) { throw std::runtime_error("consumer failed"); };
+        if (perWorker) {
+            EXPECT_THROW(parallel.generatePerThread(18, 8, [&](size_t) { return consumer; }, true),
+                         std::runtime_error);
+        } else {
+            EXPECT_THROW(parallel.generateBatches(18, 8, consumer, true), std::runtime_error);
+        }
+
+        // The generator stays usable afterwards
+        size_t seen = 0;
+        parallel.generate(12, 4, [&seen](const Tree&) { ++seen; }, true);
+        EXPECT_EQ(TreeCount(seen), TreeGenerator::count(12, 4));
+    }
+}
+
+TEST_F(TreeGeneratorTest, StatsCountPhasesAndCells) {
+    for (bool parallel : {false, true}) {
+        TreeGenerator timed;
+        timed.setEngine(TreeGenerator::Engine::Memoized);
+        timed.setThreadCount(2);
+        timed.setStatsEnabled(true);
+        timed.setProgressInterval(std::chrono::milliseconds(1));
+        size_t total = timed.generate(16, 6, [](const Tree&) {}, parallel);
+
+        const GenerationStats& stats = timed.getStats();
+        EXPECT_EQ(stats.trees, total);
+        EXPECT_EQ(TreeCount(total), TreeGenerator::count(16, 6));
+        EXPECT_EQ(stats.threads, parallel ? 2u : 1u);
+        EXPECT_GT(stats.rootPartitions, 0u);
+        EXPECT_GE(stats.candidates, total);
+        EXPECT_GT(stats.leafPrunedOptions, 0u);
+        EXPECT_GT(stats.cacheHits, 0u);
+        EXPECT_GT(stats.cacheMisses, 0u);
+        EXPECT_GT(stats.combinations.count(), 0);
+        EXPECT_GT(stats.callback.count(), 0);
+        EXPECT_LE(stats.callback, stats.elapsed * stats.threads);
+
+        std::string json = stats.toJson();
+        EXPECT_NE(json.find("\"phases_ms\""), std::string::npos);
+        EXPECT_NE(json.find(std::format("\"trees\":{}", total)), std::string::npos);
+    }
+
+    // With stats off only the totals are filled in
+    generator.setEngine(TreeGenerator::Engine::Memoized);
+    size_t total = generator.generate(12, 4, [](const Tree&) {}, false);
+    const GenerationStats& stats = generator.getStats();
+    EXPECT_EQ(stats.trees, total);
+    EXPECT_GT(stats.elapsed.count(), 0);
+    EXPECT_EQ(stats.candidates, 0u);
+    EXPECT_EQ(stats.combinations.count(), 0);
+}
+
 TEST_F(TreeGeneratorTest, Assignment_N8M5) {
     // First assignment case: N=8, M=5
     std::cout << "\nTesting N=8, M=5...\n";
@@ -129,10 +494,13 @@ TEST_F(TreeGeneratorTest, Assignment_N8M5) {
 
     std::cout << "Total trees for N=8, M=5: " << count << "\n";
     EXPECT_EQ(count, 108);
+    EXPECT_EQ(TreeCount(count), TreeGenerator::count(8, 5));
 }
 
 TEST_F(TreeGeneratorTest, Assignment_N30M3) {
-    // Second assignment case: N=30, M=3 (now optimized!)
+    // Second assignment case: N=30, M=3 (level sequence enumerator)
+    // 13661 = sum of rooted trees with 1, 2 or 3 leaves; the old count of 267
+    // only covered trees whose branching happens at the root
     std::cout << "\nTesting N=30, M=3...\n";
 
     size_t count = 0;
@@ -144,7 +512,8 @@ TEST_F(TreeGeneratorTest, Assignment_N30M3) {
     }, true);
 
     std::cout << "Total trees for N=30, M=3: " << count << "\n";
-    EXPECT_EQ(count, 267);
+    EXPECT_EQ(count, 13661);
+    EXPECT_EQ(TreeCount(count), TreeGenerator::count(30, 3));
 }
 // OEIS A000081: Number of rooted trees with n nodes
 // Reference: https://oeis.org/A000081
@@ -178,6 +547,7 @@ TEST_F(TreeGeneratorTest, OEIS_A000081_Small) {
         EXPECT_EQ(count, tc.expected)
             << "OEIS A000081 mismatch for n=" << tc.n
             << " (expected " << tc.expected << ", got " << count << ")";
+        EXPECT_EQ(TreeGenerator::count(tc.n, 50), TreeCount(tc.expected));
     }
 }
 
@@ -195,11 +565,17 @@ TEST_F(TreeGeneratorTest, OEIS_A000081_Medium) {
         {14, 32973}
     };
 
-    for (const auto& tc : testCases) {
-        size_t count = 0;
-        generator.generate(tc.n, 50, [&](const Tree&) { ++count; }, true);
-        EXPECT_EQ(count, tc.expected)
-            << "OEIS A000081 mismatch for n=" << tc.n
-            << " (expected " << tc.expected << ", got " << count << ")";
+    // Every back end must agree; Auto alone would only exercise one of them
+    for (auto engine : {TreeGenerator::Engine::Memoized, TreeGenerator::Engine::LevelSequence,
+                        TreeGenerator::Engine::ExactLeaves}) {
+        generator.setEngine(engine);
+        for (const auto& tc : testCases) {
+            size_t count = 0;
+            generator.generate(tc.n, 50, [&](const Tree&) { ++count; }, true);
+            EXPECT_EQ(count, tc.expected)
+                << "OEIS A000081 mismatch for n=" << tc.n
+                << " (expected " << tc.expected << ", got " << count << ")";
+            EXPECT_EQ(TreeGenerator::count(tc.n, 50), TreeCount(tc.expected));
+        }
     }
 }
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+#include "tree_hash_set.h"
+
+using namespace vinci;
+
+namespace {
+    Tree fromLevels(std::vector<Tree::Level> levels) {
+        return Tree::fromLevelSequence(levels);
+    }
+}
+
+TEST(TreeHashSetTest, InsertRejectsDuplicates) {
+    TreeHashSet set;
+    EXPECT_TRUE(set.empty());
+
+    EXPECT_TRUE(set.insert(fromLevels({0, 1, 1})));
+    EXPECT_TRUE(set.insert(fromLevels({0, 1, 2})));
+    EXPECT_FALSE(set.insert(fromLevels({0, 1, 1})));
+
+    EXPECT_EQ(set.size(), 2);
+    EXPECT_TRUE(set.contains(fromLevels({0, 1, 2})));
+    EXPECT_FALSE(set.contains(fromLevels({0, 1})));
+}
+
+TEST(TreeHashSetTest, GrowsAndKeepsInsertionOrder) {
+    // Stars of increasing size: all distinct, enough to force several rehashes
+    TreeHashSet set;
+    std::vector<Tree> expected;
+    Tree star;
+    for (size_t i = 0; i < 200; ++i) {
+        star.addChild(Tree());
+        expected.push_back(star);
+        EXPECT_TRUE(set.insert(star));
+    }
+    for (const auto& tree : expected) {
+        EXPECT_FALSE(set.insert(tree));
+    }
+
+    auto released = set.release();
+    EXPECT_EQ(released, expected);
+    EXPECT_TRUE(set.empty());
+    EXPECT_TRUE(set.insert(expected.front()));
+}
@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include "tree_optimizer.h"
+#include "tree_counter.h"
+#include "tree_generator.h"
+#include "tree_hash_set.h"
+#include <algorithm>
+#include <iterator>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+using namespace vinci;
+
+TEST(TreeOptimizerTest, ExactCellsMatchCounter) {
+    // Every (n, k) cell must hold exactly the counted number of distinct,
+    // canonical trees with n nodes and k leaves
+    const size_t maxN = 13;
+    TreeCounter counter(maxN, maxN);
+    SubtreeStore cells(maxN, maxN, SubtreeStore::Interning::Append);
+    TreeOptimizer::buildCacheParallel(maxN, maxN, cells);
+
+    for (size_t n = 1; n <= maxN; ++n) {
+        for (size_t k = 1; k <= std::max<size_t>(n - 1, 1); ++k) {
+            ASSERT_NE(cells.find(n, k), nullptr) << "n=" << n << " k=" << k;
+            const auto& cell = *cells.find(n, k);
+            EXPECT_EQ(TreeCount(cell.size()), counter.exact(n, k)) << "n=" << n << " k=" << k;
+
+            TreeHashSet unique(cell.size());
+            for (const Tree* stored : cell) {
+                const Tree& tree = *stored;
+                EXPECT_EQ(tree.getNodeCount(), n);
+                EXPECT_EQ(tree.getLeafCount(), k);
+                Tree canonical = tree;
+                canonical.sortToCanonical();
+                EXPECT_EQ(canonical, tree);
+                EXPECT_TRUE(unique.insert(tree)) << "duplicate " << tree.toString();
+            }
+        }
+    }
+}
+
+TEST(TreeOptimizerTest, WavefrontOnExplicitPool) {
+    // More workers than cells in the early levels; the same pool is reused
+    TaskPool pool(6);
+    TreeCounter counter(15, 7);
+    for (size_t maxK : {3, 7}) {
+        SubtreeStore cells(15, maxK, SubtreeStore::Interning::Append);
+        TreeOptimizer::buildCacheParallel(15, maxK, cells, &pool);
+        for (size_t n = 1; n <= 15; ++n) {
+            for (size_t k = 1; k <= std::min<size_t>(maxK, std::max<size_t>(n - 1, 1)); ++k) {
+                ASSERT_NE(cells.find(n, k), nullptr);
+                EXPECT_EQ(TreeCount(cells.find(n, k)->size()), counter.exact(n, k))
+                    << "n=" << n << " k=" << k << " maxK=" << maxK;
+            }
+        }
+    }
+}
+
+TEST(TreeOptimizerTest, FailingCellIsRethrown) {
+    // Trees past the inline capacity spill to a resource that refuses every
+    // allocation, so cells above 32 nodes throw on the pool's workers
+    TaskPool pool(3);
+    for (TaskPool* target : {&pool, static_cast<TaskPool*>(nullptr)}) {
+        SubtreeStore cells(36, 2, SubtreeStore::Interning::Append);
+        Tree::ArenaScope refusing(std::pmr::null_memory_resource());
+        EXPECT_THROW(TreeOptimizer::buildCacheParallel(36, 2, cells, target), std::bad_alloc);
+        EXPECT_NE(cells.find(32, 2), nullptr);
+    }
+
+    // Both pools still work afterwards
+    SubtreeStore cells(12, 3, SubtreeStore::Interning::Append);
+    TreeOptimizer::buildCacheParallel(12, 3, cells, &pool);
+    EXPECT_EQ(TreeCount(cells.find(12, 3)->size()), TreeCounter(12, 3).exact(12, 3));
+    SubtreeStore shared(12, 3, SubtreeStore::Interning::Append);
+    TreeOptimizer::buildCacheParallel(12, 3, shared);
+    EXPECT_EQ(TreeCount(shared.find(12, 3)->size()), TreeCounter(12, 3).exact(12, 3));
+}
+
+TEST(TreeOptimizerTest, ConcurrentLazyCells) {
+    // Threads racing on an empty table each get the one published cell; the
+    // inputs they need are built once, by whichever thread gets there first
+    const size_t n = 14;
+    TreeCounter counter(n, 6);
+    SubtreeStore cells(n, 6, SubtreeStore::Interning::Append);
+
+    std::vector<const SubtreeStore::Cell*> seen(8);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < seen.size(); ++t) {
+        threads.emplace_back([&, t] {
+            size_t k = 1 + t % 6;
+            seen[t] = &TreeOptimizer::exactCell(n, k, cells);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (size_t t = 0; t < seen.size(); ++t) {
+        size_t k = 1 + t % 6;
+        EXPECT_EQ(seen[t], cells.find(n, k));
+        EXPECT_EQ(TreeCount(seen[t]->size()), counter.exact(n, k)) << "k=" << k;
+    }
+}
+
+TEST(TreeOptimizerTest, ExactLeavesForLargerK) {
+    // M = 5..8 is the range the old k <= 4 fast paths never covered
+    TreeCounter counter(16, 8);
+    for (size_t k = 5; k <= 8; ++k) {
+        std::vector<Tree> trees;
+        TreeOptimizer::generateWithExactLeaves(16, k, trees);
+        EXPECT_EQ(TreeCount(trees.size()), counter.exact(16, k)) << "k=" << k;
+    }
+
+    std::vector<Tree> none;
+    TreeOptimizer::generateWithExactLeaves(6, 6, none);
+    EXPECT_TRUE(none.empty());
+}
+
+TEST(TreeOptimizerTest, EngineMatchesCounts) {
+    TreeGenerator generator;
+    generator.setEngine(TreeGenerator::Engine::ExactLeaves);
+    for (auto [n, m] : {std::pair<size_t, size_t>{1, 1}, {8, 5}, {12, 5}, {17, 6}, {30, 3}}) {
+        size_t total = generator.generate(n, m, [](const Tree&) {});
+        EXPECT_EQ(TreeCount(total), TreeGenerator::count(n, m)) << "n=" << n << " m=" << m;
+    }
+}
+
+TEST(TreeOptimizerTest, ConstraintsMatchFilteredGeneration) {
+    std::vector<GenerationConstraints> cases = {
+        {.maxDepth = 3},
+        {.maxChildren = 2},
+        {.maxDepth = 4, .maxChildren = 3},
+        {.maxDepth = 5, .maxChildren = 2, .minLeaves = 3},
+        {.minLeaves = 4},
+        {.maxDepth = 0},
+        {.maxChildren = 1},
+    };
+    for (size_t n = 1; n <= 11; ++n) {
+        for (size_t m : {size_t(3), n}) {
+            std::vector<Tree> all;
+            TreeOptimizer::generateAllWithCallback(n, m, [&](const Tree& tree) { all.push_back(tree); });
+            for (const GenerationConstraints& limits : cases) {
+                std::vector<Tree> expected;
+                std::copy_if(all.begin(), all.end(), std::back_inserter(expected),
+                             [&](const Tree& tree) { return limits.admits(tree); });
+
+                std::vector<Tree> constrained;
+                size_t count = TreeOptimizer::generateAllInBatches(n, m, limits, [&](std::span<const Tree> batch) {
+                    constrained.insert(constrained.end(), batch.begin(), batch.end());
+                });
+                EXPECT_EQ(count, expected.size()) << "n=" << n << ", m=" << m;
+                std::sort(expected.begin(), expected.end());
+                std::sort(constrained.begin(), constrained.end());
+                EXPECT_EQ(constrained, expected) << "n=" << n << ", m=" << m;
+            }
+        }
+    }
+}
+
+TEST(TreeOptimizerTest, ConstrainedRunsScaleWithOutput) {
+    // The only 40-node tree of depth 3 and out-degree 3 is the complete ternary tree
+    TreeGenerator generator;
+    generator.setConstraints({.maxDepth = 3, .maxChildren = 3});
+    std::vector<Tree> trees;
+    EXPECT_EQ(generator.generate(40, 40, [&](const Tree& tree) { trees.push_back(tree); }), 1u);
+    ASSERT_EQ(trees.size(), 1u);
+    EXPECT_EQ(trees[0].getLeafCount(), 27u);
+
+    generator.setShard(0, 2);
+    EXPECT_THROW(generator.generate(10, 3, [](const Tree&) {}), std::invalid_argument);
+}
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include "tree_sampler.h"
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+using namespace vinci;
+
+TEST(TreeSamplerTest, DrawsAreUniform) {
+    // 9 nodes, at most 4 leaves: every tree is hit about 20000 / population times
+    TreeSampler sampler(9, 4);
+    TreeCounter counter(9, 4, TreeCounter::Tables::Ranking);
+    ASSERT_EQ(sampler.population(), counter.atMost(9, 4));
+
+    const size_t draws = 20000;
+    size_t cells = static_cast<size_t>(sampler.population());
+    std::vector<size_t> hits(cells, 0);
+    sampler.sample(draws, 7, [&](const Tree& tree) {
+        ++hits[static_cast<size_t>(counter.rank(tree))];
+    });
+
+    // Chi-squared with cells - 1 degrees of freedom; the bound is about six
+    // standard deviations above the mean, so only a biased sampler fails it
+    double expected = double(draws) / double(cells);
+    double chiSquared = 0;
+    for (size_t count : hits) {
+        chiSquared += (count - expected) * (count - expected) / expected;
+    }
+    double dof = double(cells - 1);
+    EXPECT_LT(chiSquared, dof + 6 * std::sqrt(2 * dof));
+}
+
+TEST(TreeSamplerTest, SeedFixesOutputAtAnyThreadCount) {
+    TreeSampler sampler(60, 6);
+    auto draw = [&](std::uint64_t seed, size_t threads) {
+        std::vector<Tree> trees;
+        sampler.sample(1000, seed, [&](const Tree& tree) { trees.push_back(tree); }, threads);
+        return trees;
+    };
+
+    std::vector<Tree> serial = draw(42, 1);
+    ASSERT_EQ(serial.size(), 1000u);
+    EXPECT_EQ(draw(42, 4), serial);
+    EXPECT_NE(draw(43, 4), serial);
+}
+
+TEST(TreeSamplerTest, SizesBeyondEnumeration) {
+    TreeSampler sampler(300, 5);
+    TreeSampler::Rng rng(1);
+    for (int i = 0; i < 20; ++i) {
+        Tree tree = sampler.sample(rng);
+        EXPECT_EQ(tree.getNodeCount(), 300u);
+        EXPECT_LE(tree.getLeafCount(), 5u);
+        Tree canonical = tree;
+        canonical.sortToCanonical();
+        EXPECT_EQ(canonical, tree);
+    }
+
+    EXPECT_THROW(TreeSampler(4, 0).sample(rng), std::out_of_range);
+}
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+#include "tree_sink.h"
+#include "tree_generator.h"
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace vinci;
+
+namespace {
+    // Temporary file removed when the test ends
+    struct TempFile {
+        std::string path;
+        int fd;
+        TempFile() {
+            char name[] = "/tmp/tree_sink_testXXXXXX";
+            fd = mkstemp(name);
+            path = name;
+        }
+        ~TempFile() {
+            ::close(fd);
+            std::remove(path.c_str());
+        }
+        std::string contents() const {
+            std::ifstream in(path, std::ios::binary);
+            std::ostringstream out;
+            out << in.rdbuf();
+            return out.str();
+        }
+    };
+
+    std::vector<Tree> sampleTrees() {
+        std::vector<Tree> trees;
+        TreeGenerator generator;
+        generator.generate(9, 9, [&](const Tree& tree) { trees.push_back(tree); }, false);
+        return trees;
+    }
+}
+
+TEST(TreeSinkTest, EncodingsRoundTrip) {
+    for (OutputFormat format : {OutputFormat::Text, OutputFormat::Levels, OutputFormat::Parens}) {
+        std::string encoded;
+        auto trees = sampleTrees();
+        for (const auto& tree : trees) {
+            TreeSink::encode(tree, format, encoded);
+        }
+
+        std::string_view input = encoded;
+        for (const auto& tree : trees) {
+            auto decoded = TreeSink::decode(input, format);
+            ASSERT_TRUE(decoded.has_value());
+            EXPECT_EQ(*decoded, tree);
+        }
+        EXPECT_TRUE(input.empty());
+        EXPECT_FALSE(TreeSink::decode(input, format).has_value());
+    }
+}
+
+TEST(TreeSinkTest, CompactBinaryLayouts) {
+    // Node 0 with children (0, 1, 2) and (0, 1): levels 0 1 2 3 1 2
+    Tree tree = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 2, 3, 1, 2});
+
+    std::string text;
+    TreeSink::encode(tree, OutputFormat::Text, text);
+    EXPECT_EQ(text, tree.toString() + "\n");
+
+    std::string levels;
+    TreeSink::encode(tree, OutputFormat::Levels, levels);
+    EXPECT_EQ(levels, std::string("\x06\x00\x00\x01\x02\x03\x01\x02", 8));
+
+    // 111000 1100 -> 11100011 00 (padded)
+    std::string parens;
+    TreeSink::encode(tree, OutputFormat::Parens, parens);
+    EXPECT_EQ(parens, std::string("\x06\x00\xe3\x00", 4));
+
+    // A truncated record is rejected without consuming input
+    std::string_view partial(parens.data(), 3);
+    EXPECT_FALSE(TreeSink::decode(partial, OutputFormat::Parens).has_value());
+    EXPECT_EQ(partial.size(), 3u);
+}
+
+TEST(TreeSinkTest, ParseFormatNames) {
+    EXPECT_EQ(TreeSink::parseFormat("text"), OutputFormat::Text);
+    EXPECT_EQ(TreeSink::parseFormat("levels"), OutputFormat::Levels);
+    EXPECT_EQ(TreeSink::parseFormat("parens"), OutputFormat::Parens);
+    EXPECT_FALSE(TreeSink::parseFormat("json").has_value());
+}
+
+TEST(TreeSinkTest, ConcurrentWritersKeepRecordsWhole) {
+    TempFile file;
+    auto trees = sampleTrees();
+    {
+        // A tiny buffer forces many intermediate writes from every thread
+        TreeSink sink(file.fd, OutputFormat::Parens, 64);
+        std::vector<std::jthread> writers;
+        for (int t = 0; t < 4; ++t) {
+            writers.emplace_back([&] {
+                for (const auto& tree : trees) {
+                    sink.write(tree);
+                }
+            });
+        }
+        writers.clear();
+        sink.flush();
+        EXPECT_EQ(sink.written(), trees.size() * 4);
+    }
+
+    std::string data = file.contents();
+    std::string_view input = data;
+    std::multiset<std::string> seen;
+    while (auto tree = TreeSink::decode(input, OutputFormat::Parens)) {
+        seen.insert(tree->toString());
+    }
+    EXPECT_TRUE(input.empty());
+    ASSERT_EQ(seen.size(), trees.size() * 4);
+    for (const auto& tree : trees) {
+        EXPECT_EQ(seen.count(tree.toString()), 4u);
+    }
+}
+
+TEST(TreeSinkTest, ReadStreamsWholeFile) {
+    auto trees = sampleTrees();
+    for (OutputFormat format : {OutputFormat::Text, OutputFormat::Levels, OutputFormat::Parens}) {
+        TempFile file;
+        {
+            TreeSink sink(file.fd, format, 64);
+            for (const auto& tree : trees) {
+                sink.write(tree);
+            }
+            sink.flush();
+        }
+
+        int fd = ::open(file.path.c_str(), O_RDONLY);
+        std::vector<Tree> read;
+        EXPECT_EQ(TreeSink::read(fd, format, [&](const Tree& tree) { read.push_back(tree); }), trees.size());
+        ::close(fd);
+        EXPECT_EQ(read, trees);
+    }
+
+    // A record cut short at end of file is reported
+    TempFile file;
+    std::string encoded;
+    TreeSink::encode(trees.back(), OutputFormat::Levels, encoded);
+    encoded.pop_back();
+    ASSERT_EQ(::write(file.fd, encoded.data(), encoded.size()), static_cast<ssize_t>(encoded.size()));
+    int fd = ::open(file.path.c_str(), O_RDONLY);
+    EXPECT_THROW(TreeSink::read(fd, OutputFormat::Levels, [](const Tree&) {}), std::runtime_error);
+    ::close(fd);
+}
+
+TEST(TreeSinkTest, MalformedRecordsAreRejected) {
+    auto rejects = [](std::string bytes, OutputFormat format) {
+        std::string_view view(bytes);
+        EXPECT_THROW(TreeSink::decode(view, format), std::runtime_error) << "record of " << bytes.size() << " bytes";
+    };
+    auto record = [](std::initializer_list<int> bytes) {
+        std::string out;
+        for (int byte : bytes) {
+            out += static_cast<char>(byte);
+        }
+        return out;
+    };
+
+    // Levels: root not at 0, a second root, a jump of two levels, no nodes
+    rejects(record({3, 0, 1, 1, 2}), OutputFormat::Levels);
+    rejects(record({3, 0, 0, 1, 0}), OutputFormat::Levels);
+    rejects(record({3, 0, 0, 2, 1}), OutputFormat::Levels);
+    rejects(record({0, 0}), OutputFormat::Levels);
+
+    // Parens over 3 nodes (4 bits): closing past the root, and one node too many
+    rejects(record({3, 0, 0b01000000}), OutputFormat::Parens);
+    rejects(record({3, 0, 0b11100000}), OutputFormat::Parens);
+
+    // Text: two roots, unbalanced, stray characters, an empty line
+    rejects("()()\n", OutputFormat::Text);
+    rejects("(()\n", OutputFormat::Text);
+    rejects("())\n", OutputFormat::Text);
+    rejects("(x)\n", OutputFormat::Text);
+    rejects("\n", OutputFormat::Text);
+
+    // Valid records still decode, and an incomplete one still waits for more
+    std::string valid = record({3, 0, 0, 1, 1});
+    std::string_view view(valid);
+    auto tree = TreeSink::decode(view, OutputFormat::Levels);
+    ASSERT_TRUE(tree);
+    EXPECT_EQ(tree->getNodeCount(), 3u);
+    EXPECT_TRUE(view.empty());
+    std::string partial = "(()";
+    std::string_view partialView(partial);
+    EXPECT_FALSE(TreeSink::decode(partialView, OutputFormat::Text));
+
+    // read() reports a malformed record in the middle of a file
+    TempFile file;
+    std::string bytes = valid + record({3, 0, 0, 2, 1}) + valid;
+    ASSERT_EQ(::write(file.fd, bytes.data(), bytes.size()), static_cast<ssize_t>(bytes.size()));
+    int fd = ::open(file.path.c_str(), O_RDONLY);
+    size_t seen = 0;
+    EXPECT_THROW(TreeSink::read(fd, OutputFormat::Levels, [&seen](const Tree&) { ++seen; }), std::runtime_error);
+    EXPECT_EQ(seen, 1u);
+    ::close(fd);
+}
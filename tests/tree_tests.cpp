@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 #include "tree.h"
+#include <algorithm>
+#include <memory_resource>
+#include <unordered_set>
 
 using namespace vinci;
 
@@ -124,3 +127,198 @@ TEST_F(TreeTest, ComparisonOperators) {
 
     EXPECT_FALSE(parent1 == parent2);
 }
+
+TEST_F(TreeTest, LevelSequenceEncoding) {
+    // Root with a chain child and a leaf child: canonical order puts the chain first
+    Tree root;
+    root.addChild(Tree());
+    Tree chain;
+    chain.addChild(Tree());
+    root.addChild(chain);
+    root.sortToCanonical();
+
+    std::vector<Tree::Level> expected = {0, 1, 2, 1};
+    auto levels = root.getLevels();
+    EXPECT_EQ(std::vector<Tree::Level>(levels.begin(), levels.end()), expected);
+    EXPECT_EQ(root.toString(), "((()),())");
+    EXPECT_EQ(Tree::fromLevelSequence(expected), root);
+}
+
+TEST_F(TreeTest, GetChildrenRoundTrip) {
+    std::vector<Tree::Level> levels = {0, 1, 2, 2, 1, 1};
+    Tree tree = Tree::fromLevelSequence(levels);
+
+    auto children = tree.getChildren();
+    ASSERT_EQ(children.size(), 3);
+    EXPECT_EQ(children[0].toString(), "((),())");
+    EXPECT_TRUE(children[1].isLeaf());
+    EXPECT_EQ(Tree(children), tree);
+}
+
+TEST_F(TreeTest, LargeTreeSpillsToHeap) {
+    // A star with more nodes than fit inline must survive copies and moves
+    Tree star;
+    for (size_t i = 0; i < 2 * Tree::kInlineCapacity; ++i) {
+        star.addChild(Tree());
+    }
+    EXPECT_EQ(star.getNodeCount(), 2 * Tree::kInlineCapacity + 1);
+    EXPECT_EQ(star.getLeafCount(), 2 * Tree::kInlineCapacity);
+
+    Tree copy = star;
+    EXPECT_EQ(copy, star);
+
+    Tree moved = std::move(copy);
+    EXPECT_EQ(moved, star);
+    EXPECT_TRUE(copy.isLeaf());
+
+    copy = moved;
+    EXPECT_EQ(copy.toString(), star.toString());
+}
+
+TEST_F(TreeTest, CachedLeafCount) {
+    // The cached count must agree with the level sequence however a tree was built
+    auto countFromLevels = [](const Tree& tree) {
+        auto levels = tree.getLevels();
+        size_t leaves = 1;
+        for (size_t i = 0; i + 1 < levels.size(); ++i) {
+            leaves += levels[i + 1] <= levels[i];
+        }
+        return leaves;
+    };
+
+    Tree deep = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 2, 2, 1, 2, 3, 1});
+    EXPECT_EQ(deep.getLeafCount(), 4u);
+
+    Tree built;
+    for (const auto& child : deep.getChildren()) {
+        EXPECT_EQ(child.getLeafCount(), countFromLevels(child));
+        built.addChild(child);
+        EXPECT_EQ(built.getLeafCount(), countFromLevels(built));
+    }
+    built.sortToCanonical();
+    EXPECT_EQ(built.getLeafCount(), deep.getLeafCount());
+
+    Tree wide{std::vector<Tree>{deep, built, Tree()}};
+    EXPECT_EQ(wide.getLeafCount(), 9u);
+    Tree moved = std::move(wide);
+    EXPECT_EQ(moved.getLeafCount(), 9u);
+    EXPECT_EQ(wide.getLeafCount(), 1u);
+    wide = moved;
+    EXPECT_EQ(wide.getLeafCount(), countFromLevels(wide));
+}
+
+TEST_F(TreeTest, FromCanonicalChildrenMatchesSortingConstructor) {
+    Tree chain = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 2});
+    Tree cherry = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 1});
+    Tree deep = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 2, 2, 1});
+    deep.sortToCanonical();
+    Tree leaf;
+
+    // Every order of the children, with repeats, gives the same canonical tree
+    std::vector<const Tree*> children{&leaf, &cherry, &chain, &deep, &cherry};
+    std::sort(children.begin(), children.end());
+    do {
+        std::vector<Tree> copies;
+        for (const Tree* child : children) {
+            copies.push_back(*child);
+        }
+        Tree expected{copies};
+        Tree built = Tree::fromCanonicalChildren(children);
+        ASSERT_EQ(built, expected);
+        EXPECT_EQ(built.getHash(), expected.getHash());
+        EXPECT_EQ(built.getLeafCount(), expected.getLeafCount());
+    } while (std::next_permutation(children.begin(), children.end()));
+
+    EXPECT_EQ(Tree::fromCanonicalChildren({}), Tree());
+}
+
+TEST_F(TreeTest, StructuralOrdering) {
+    // Level sequences compare lexicographically: the chain (0,1,2) sorts above
+    // the cherry (0,1,1), and a prefix sorts below its extensions
+    Tree chain = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 2});
+    Tree cherry = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1, 1});
+    Tree edge = Tree::fromLevelSequence(std::vector<Tree::Level>{0, 1});
+
+    EXPECT_EQ(chain <=> cherry, std::strong_ordering::greater);
+    EXPECT_EQ(edge <=> cherry, std::strong_ordering::less);
+    EXPECT_EQ(cherry <=> cherry, std::strong_ordering::equal);
+
+    std::vector<Tree> trees = {edge, chain, cherry};
+    std::sort(trees.begin(), trees.end());
+    EXPECT_EQ(trees[0], edge);
+    EXPECT_EQ(trees[2], chain);
+}
+
+TEST_F(TreeTest, CanonicalHash) {
+    // Same shape built in two child orders hashes identically after canonicalization
+    Tree pair;
+    pair.addChild(Tree());
+    pair.addChild(Tree());
+
+    Tree a;
+    a.addChild(Tree());
+    a.addChild(pair);
+    Tree b;
+    b.addChild(pair);
+    b.addChild(Tree());
+
+    a.sortToCanonical();
+    b.sortToCanonical();
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(a.getHash(), b.getHash());
+    EXPECT_NE(a.getHash(), pair.getHash());
+
+    // Building through addChild keeps the cached hash in sync with the sequence
+    EXPECT_EQ(pair.getHash(), Tree::fromLevelSequence(pair.getLevels()).getHash());
+
+    std::unordered_set<Tree> set = {a, b, pair};
+    EXPECT_EQ(set.size(), 2);
+}
+
+TEST_F(TreeTest, HeapSpillUsesScopedResource) {
+    // Count the bytes a tree beyond the inline capacity takes from the arena
+    struct CountingResource : std::pmr::memory_resource {
+        size_t live = 0;
+        size_t allocations = 0;
+        void* do_allocate(size_t bytes, size_t align) override {
+            live += bytes;
+            ++allocations;
+            return std::pmr::new_delete_resource()->allocate(bytes, align);
+        }
+        void do_deallocate(void* p, size_t bytes, size_t align) override {
+            live -= bytes;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    } arena;
+
+    std::vector<Tree::Level> chain(Tree::kInlineCapacity + 8);
+    for (size_t i = 0; i < chain.size(); ++i) {
+        chain[i] = static_cast<Tree::Level>(i);
+    }
+
+    Tree outside;
+    {
+        Tree::ArenaScope scope(&arena);
+        EXPECT_EQ(Tree::heapResource(), &arena);
+
+        Tree big = Tree::fromLevelSequence(chain);
+        Tree small(std::vector<Tree>{Tree(), Tree()});
+        EXPECT_EQ(arena.allocations, 1u);
+        EXPECT_GT(arena.live, 0u);
+
+        // A tree allocated in the arena is freed there even after the scope ends
+        outside = std::move(big);
+    }
+    EXPECT_EQ(Tree::heapResource(), std::pmr::new_delete_resource());
+    EXPECT_EQ(outside.getNodeCount(), chain.size());
+
+    Tree copy(outside);  // allocated from the default resource
+    EXPECT_EQ(arena.allocations, 1u);
+    EXPECT_EQ(copy, outside);
+
+    outside = Tree();
+    EXPECT_EQ(arena.live, 0u);
+}